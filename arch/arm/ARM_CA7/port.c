@@ -5,6 +5,8 @@
 #include "schedule.h"
 #include "config.h"
 #include "port.h"
+#include "trace.h"
+#include "heap.h"
 
 /* A variable is used to keep track of the critical section nesting.  This
 variable has to be stored as part of the task context and must be initialised to
@@ -13,9 +15,13 @@ the scheduler starts.  As it is stored as part of the task context it will
 automatically be set to 0 when the first task is started. */
 volatile uint32_t ulCriticalNesting = 9999UL;
 
-/* Saved as part of the task context.  If ulPortTaskHasFPUContext is non-zero then
-a floating point context must be saved and restored for the task. */
-volatile uint32_t ulPortTaskHasFPUContext = 0;
+/* Saved as part of the task context, the address of the task's FPU save area
+(D0-D31 and FPSCR), 0 until the task executes its first VFP instruction. */
+volatile uint32_t ulPortFPUContext = 0;
+
+/* The save area whose registers are live in the FPU.  A context switch leaves
+the FPU on only for this task, see RTOS_UNDEF_Handler. */
+volatile uint32_t ulPortFPUOwner = 0;
 
 /* Set to 1 to pend a context switch from an ISR. */
 volatile uint32_t ulPortYieldRequired = 0;
@@ -39,7 +45,9 @@ void RTOS_Tick_Handler( void )
 						"isb		\n" );
 	__asm volatile ( "CPSIE i" );
 
+	trace_isr_enter(TraceTickISR);
 	CheckTicks();
+	trace_isr_exit(TraceTickISR);
 
 	__asm volatile ( "CPSID i" );											
 	portICCPMR_PRIORITY_MASK_REGISTER = 0XFFUL;			
@@ -74,13 +82,46 @@ uint32_t *StackInit( uint32_t *pxTopOfStack, TaskFunction_t pxCode, void *pvPara
 		.LR = (uint32_t)ErrorHandle,
 		.r0 = (uint32_t)pvParameters,
 		.critical = 0,
-		.floatReg = 0
+		.fpuContext = 0
 	};
 	
 	return pxTopOfStack;
 }
 
 
+#define portFPU_CONTEXT_WORDS	( 32 * 2 + 1 )
+
+/*
+ * Called from RTOS_UNDEF_Handler on a task's first VFP instruction, after the
+ * previous owner's registers are saved, so the FPU is free to use here.
+ */
+void PortFPUContextAlloc( void )
+{
+	uint32_t *context = ( uint32_t * ) heap_malloc( portFPU_CONTEXT_WORDS * sizeof( uint32_t ) );
+
+	if( context == NULL ) {
+		ErrorHandle();
+	}
+	for( uint32_t i = 0; i < portFPU_CONTEXT_WORDS; i++ ) {
+		context[i] = 0;
+	}
+	ulPortFPUContext = ( uint32_t ) context;
+}
+
+//the task is switched out, its save area address is the first word of its frame
+void PortTaskFree( uint32_t *pxTopOfStack )
+{
+	struct Stack_register *stack = ( struct Stack_register * ) pxTopOfStack;
+
+	if( stack->fpuContext != 0 ) {
+		if( ulPortFPUOwner == stack->fpuContext ) {
+			ulPortFPUOwner = 0;
+		}
+		heap_free( ( void * ) stack->fpuContext );
+	}
+}
+
+
 
 #define portBINARY_POINT_BITS			( ( uint8_t ) 0x03 )
 #define portAPSR_MODE_BITS_MASK			( 0x1F )
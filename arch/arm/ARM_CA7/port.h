@@ -4,7 +4,7 @@
 
 
 struct Stack_register {
-	uint32_t floatReg;
+	uint32_t fpuContext;
 	uint32_t critical;
     uint32_t r0;
     uint32_t r1;
@@ -27,7 +27,53 @@ struct Stack_register {
 uint32_t *StackInit(uint32_t *pxTopOfStack, TaskFunction_t pxCode, void *pvParameters);
 void StartFirstTask(void);
 
-#define schedule()  __asm volatile ( "SWI 0" )
+/*
+ * Lazy FPU switching, the VFP registers are only saved and loaded when a task
+ * that is not their owner executes its first VFP instruction, which traps
+ * into RTOS_UNDEF_Handler. Map it onto the startup's undefined instruction
+ * vector like RTOS_IRQ_Handler and RTOS_SWI_Handler.
+ * PortTaskFree is called by the kernel before a deleted task's stack is freed.
+ */
+void PortTaskFree(uint32_t *pxTopOfStack);
+
+extern volatile uint32_t ulPortYieldRequired;
+extern volatile uint32_t ulPortInterruptNesting;
+
+/*
+ * SWI can not be taken from IRQ mode, inside an interrupt the switch
+ * is pended and done by the IRQ handler on its way out.
+ */
+#define schedule()\
+do {\
+    if (ulPortInterruptNesting) {\
+        ulPortYieldRequired = 1;\
+    } else {\
+        __asm volatile ( "SWI 0" );\
+    }\
+} while (0)
+
+#define schedule_from_isr(woken)\
+do { if (woken) { ulPortYieldRequired = 1; } } while (0)
+
+/*
+ * PMU cycle counter: PMCR.E enables the PMU, PMCR.C resets PMCCNTR,
+ * bit 31 of PMCNTENSET starts it.
+ */
+#define CycleCounterInit()\
+do {\
+    uint32_t pmcr;\
+    __asm volatile ( "MRC p15, 0, %0, c9, c12, 0" : "=r" ( pmcr ) );\
+    __asm volatile ( "MCR p15, 0, %0, c9, c12, 0" :: "r" ( pmcr | 0x5UL ) );\
+    __asm volatile ( "MCR p15, 0, %0, c9, c12, 1" :: "r" ( 1UL << 31 ) );\
+    __asm volatile ( "ISB" );\
+} while (0)
+
+static inline uint32_t CycleCounterGet(void)
+{
+    uint32_t ccnt;
+    __asm volatile ( "MRC p15, 0, %0, c9, c13, 0" : "=r" ( ccnt ) );
+    return ccnt;
+}
 
 void ErrorHandle(void);    
 uint32_t xEnterCritical();
@@ -25,6 +25,7 @@
 
 #include "port.h"
 #include "config.h"
+#include "trace.h"
 
 struct Stack_register {
     //automatic stacking
@@ -209,11 +210,13 @@ struct SysTicks {
 
 void SysTick_Handler(void)
 {
+    trace_isr_enter(TraceTickISR);
     uint32_t xre = EnterCritical();
 
     CheckTicks();
 
     ExitCritical(xre);
+    trace_isr_exit(TraceTickISR);
 }
 
 
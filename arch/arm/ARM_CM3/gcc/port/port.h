@@ -37,6 +37,30 @@ uint32_t *StackInit( uint32_t *pxTopOfStack, TaskFunction_t pxCode,void *pvParam
 #define schedule()\
 *( ( volatile uint32_t * ) 0xe000ed04 ) = 1UL << 28UL
 
+/*
+ * Called once at the end of an interrupt handler with the flag collected by the
+ * _from_isr functions, PendSV tail-chains after the last nested interrupt returns.
+ */
+#define schedule_from_isr(woken)\
+do { if (woken) { schedule(); } } while (0)
+
+/*
+ * DWT cycle counter, counts core clock cycles.
+ */
+#define CycleCounterInit()\
+do {\
+    *( ( volatile uint32_t * ) 0xe000edfc ) |= 1UL << 24UL;\
+    *( ( volatile uint32_t * ) 0xe0001004 ) = 0;\
+    *( ( volatile uint32_t * ) 0xe0001000 ) |= 1UL;\
+} while (0)
+
+#define CycleCounterGet()\
+( *( ( volatile uint32_t * ) 0xe0001004 ) )
+
+//no FPU state kept per task
+#define PortTaskFree(pxTopOfStack)\
+do { } while (0)
+
 
 
 
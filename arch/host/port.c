@@ -0,0 +1,326 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 skaiui2
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *  https://github.com/skaiui2/SKRTOS_sparrow
+ */
+
+#define _GNU_SOURCE
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <ucontext.h>
+#include "port.h"
+#include "config.h"
+#include "trace.h"
+
+extern TaskHandle_t volatile schedule_currentTCB;
+extern void TaskSwitchContext(void);
+extern void CheckTicks(void);
+
+/*
+ * HostNesting is the interrupt mask: the tick handler only counts a pending tick
+ * while it is not zero, the outermost ExitCritical delivers the pending ticks and switch.
+ * It starts at 1, interrupts stay masked until the first task runs.
+ */
+static volatile uint32_t HostNesting = 1;
+static volatile uint32_t HostSwitchPending = 0;
+static volatile uint32_t HostTickPending = 0;
+volatile uint64_t HostTickStamp = 0;
+
+static void *HostMainStack = NULL;
+static uint8_t HostIrqStack[configHostIrqStack];
+
+//scratch of the HostIrqEntry tail, nothing can interrupt it
+uint64_t HostIrqScratch;
+uint64_t HostIrqReturn;
+
+extern char __executable_start[];
+extern char etext[];
+
+void HostSwitch(void **save, void *next);
+void HostTaskEntry(void);
+void HostIrqEntry(void);
+void HostIrqEnd(void);
+
+/*
+ * HostSwitch saves the callee-saved registers on the current stack and its
+ * stack pointer to *save, then resumes the stack next the same way.
+ * HostTaskEntry is where a new stack built by StackInit "returns" to.
+ * HostIrqEntry is pushed onto a preempted task by the tick handler, it keeps
+ * the caller-saved registers and flags, calls HostPreempt and goes back to the
+ * interrupted instruction. The FPU/SSE state is not saved, the kernel and the
+ * tasks are built with -mgeneral-regs-only.
+ */
+__asm__ (
+        "   .text                       \n"
+        "   .globl HostSwitch           \n"
+        "HostSwitch:                    \n"
+        "   push %rbp                   \n"
+        "   push %rbx                   \n"
+        "   push %r12                   \n"
+        "   push %r13                   \n"
+        "   push %r14                   \n"
+        "   push %r15                   \n"
+        "   mov %rsp, (%rdi)            \n"
+        "   mov %rsi, %rsp              \n"
+        "   pop %r15                    \n"
+        "   pop %r14                    \n"
+        "   pop %r13                    \n"
+        "   pop %r12                    \n"
+        "   pop %rbx                    \n"
+        "   pop %rbp                    \n"
+        "   ret                         \n"
+        "                               \n"
+        "   .globl HostTaskEntry        \n"
+        "HostTaskEntry:                 \n"
+        "   mov %r12, %rdi              \n"
+        "   mov %r13, %rsi              \n"
+        "   call HostTaskStart          \n"
+        "   call ErrorHandle            \n"
+        "                               \n"
+        "   .globl HostIrqEntry         \n"
+        "HostIrqEntry:                  \n"
+        "   pushfq                      \n"
+        "   push %rax                   \n"
+        "   push %rcx                   \n"
+        "   push %rdx                   \n"
+        "   push %rsi                   \n"
+        "   push %rdi                   \n"
+        "   push %r8                    \n"
+        "   push %r9                    \n"
+        "   push %r10                   \n"
+        "   push %r11                   \n"
+        "   call HostPreempt            \n"
+        "   pop %r11                    \n"
+        "   pop %r10                    \n"
+        "   pop %r9                     \n"
+        "   pop %r8                     \n"
+        "   pop %rdi                    \n"
+        "   pop %rsi                    \n"
+        "   pop %rdx                    \n"
+        "   pop %rcx                    \n"
+        "   pop %rax                    \n"
+        "   popfq                       \n"
+        "   mov %rax, HostIrqScratch(%rip)  \n"
+        "   mov (%rsp), %rax            \n"
+        "   mov %rax, HostIrqReturn(%rip)   \n"
+        "   mov HostIrqScratch(%rip), %rax  \n"
+        "   mov 8(%rsp), %rsp           \n"
+        "   jmp *HostIrqReturn(%rip)    \n"
+        "   .globl HostIrqEnd           \n"
+        "HostIrqEnd:                    \n"
+        );
+
+
+/*
+ * If the program runs here, there is a problem with the use of the RTOS,
+ * such as the stack allocation space is too small, and the use of undefined operations
+ */
+void ErrorHandle(void)
+{
+    fprintf(stderr, "ErrorHandle: task %p\n", (void *)schedule_currentTCB);
+    abort();
+}
+
+
+static void HostTick(void)
+{
+    trace_isr_enter(TraceTickISR);
+    CheckTicks();
+    trace_isr_exit(TraceTickISR);
+}
+
+/*
+ * Called with HostNesting == 0 when there is something pending,
+ * runs the pended ticks and switches while it stays masked.
+ */
+static void HostDeliver(void)
+{
+    HostNesting = 1;
+    while (HostTickPending || HostSwitchPending) {
+        uint32_t ticks = __atomic_exchange_n(&HostTickPending, 0, __ATOMIC_SEQ_CST);
+        while (ticks--) {
+            HostTick();
+        }
+        if (HostSwitchPending) {
+            TaskHandle_t prev = schedule_currentTCB;
+            HostSwitchPending = 0;
+            TaskSwitchContext();
+            if (schedule_currentTCB != prev) {
+                HostSwitch((void **)prev, *(void **)schedule_currentTCB);
+            }
+        }
+    }
+    HostNesting = 0;
+}
+
+void HostPreempt(void)
+{
+    HostDeliver();
+}
+
+void HostTaskStart(TaskFunction_t pxCode, void *pvParameters)
+{
+    ExitCritical(0);
+    pxCode(pvParameters);
+}
+
+
+uint32_t *StackInit( uint32_t *pxTopOfStack,
+                     TaskFunction_t pxCode,
+                     void *pvParameters)
+{
+    uint64_t *Stack = (uint64_t *)(((uintptr_t)pxTopOfStack & ~(uintptr_t)15) - 72);
+
+    //r15, r14, r13, r12, rbx, rbp, return address, HostSwitch pops them in this order
+    Stack[0] = 0;
+    Stack[1] = 0;
+    Stack[2] = (uint64_t)pvParameters;
+    Stack[3] = (uint64_t)pxCode;
+    Stack[4] = 0;
+    Stack[5] = 0;
+    Stack[6] = (uint64_t)HostTaskEntry;
+
+    return (uint32_t *)Stack;
+}
+
+uint32_t *pxPortInitialiseStack( uint32_t *pxTopOfStack,
+                                 TaskFunction_t pxCode,
+                                 void *pvParameters)
+{
+    return StackInit(pxTopOfStack, pxCode, pvParameters);
+}
+
+
+uint32_t EnterCritical( void )
+{
+    HostNesting++;
+    return 0;
+}
+
+void ExitCritical( uint32_t xReturn )
+{
+    (void)xReturn;
+    if ((--HostNesting == 0) && (HostTickPending || HostSwitchPending)) {
+        HostDeliver();
+    }
+}
+
+/*
+ * Kernels that bring their own xEnterCritical (EDF suspends the scheduler) override these.
+ */
+__attribute__((weak)) uint32_t xEnterCritical( void )
+{
+    return EnterCritical();
+}
+
+__attribute__((weak)) void xExitCritical( uint32_t xReturn )
+{
+    ExitCritical(xReturn);
+}
+
+void HostSchedule(void)
+{
+    HostSwitchPending = 1;
+    if (HostNesting == 0) {
+        HostDeliver();
+    }
+}
+
+
+/*
+ * The tick interrupt, on the alternate stack.
+ * Masked, inside HostIrqEntry or in code that is not ours (libc may use the red zone)
+ * the tick is only counted. Otherwise the ticks run here and if a switch is due
+ * the task is made to call HostIrqEntry, as the hardware would stack an exception frame.
+ */
+static void HostTickHandler(int sig, siginfo_t *info, void *context)
+{
+    ucontext_t *uc = (ucontext_t *)context;
+    greg_t *gregs = uc->uc_mcontext.gregs;
+    char *pc = (char *)gregs[REG_RIP];
+    (void)sig;
+    (void)info;
+
+    HostTickStamp = __builtin_ia32_rdtsc();
+    __atomic_add_fetch(&HostTickPending, 1, __ATOMIC_SEQ_CST);
+    if (HostNesting ||
+        ((pc >= (char *)HostIrqEntry) && (pc < (char *)HostIrqEnd)) ||
+        (pc < __executable_start) || (pc >= etext)) {
+        return;
+    }
+
+    HostNesting = 1;
+    uint32_t ticks = __atomic_exchange_n(&HostTickPending, 0, __ATOMIC_SEQ_CST);
+    while (ticks--) {
+        HostTick();
+    }
+    HostNesting = 0;
+
+    if (HostSwitchPending) {
+        uint64_t *sp = (uint64_t *)(((uint64_t)gregs[REG_RSP] & ~(uint64_t)15) - 16);
+        sp[0] = (uint64_t)gregs[REG_RIP];
+        sp[1] = (uint64_t)gregs[REG_RSP];
+        gregs[REG_RSP] = (greg_t)sp;
+        gregs[REG_RIP] = (greg_t)HostIrqEntry;
+    }
+}
+
+
+void StartFirstTask(void)
+{
+    stack_t ss = {
+            .ss_sp = HostIrqStack,
+            .ss_size = sizeof(HostIrqStack),
+            .ss_flags = 0
+    };
+    struct sigaction sa = {
+            .sa_sigaction = HostTickHandler,
+            .sa_flags = SA_SIGINFO | SA_ONSTACK | SA_RESTART
+    };
+    struct itimerval tick = {
+            .it_interval = { .tv_sec = 0, .tv_usec = 1000000 / configTickRateHz },
+            .it_value = { .tv_sec = 0, .tv_usec = 1000000 / configTickRateHz }
+    };
+
+    sigaltstack(&ss, NULL);
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGALRM, &sa, NULL);
+    setitimer(ITIMER_REAL, &tick, NULL);
+
+    //comes back here when a task calls HostStop
+    HostSwitch(&HostMainStack, *(void **)schedule_currentTCB);
+}
+
+/*
+ * Stop the tick and return from SchedulerStart to main, the tasks are left as they are.
+ */
+void HostStop(void)
+{
+    struct itimerval off = { 0 };
+    void *dummy;
+
+    HostNesting = 1;
+    setitimer(ITIMER_REAL, &off, NULL);
+    HostSwitch(&dummy, HostMainStack);
+}
@@ -0,0 +1,80 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 skaiui2
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *  https://github.com/skaiui2/SKRTOS_sparrow
+ */
+
+#ifndef PORT_H
+#define PORT_H
+
+#include "class.h"
+#include "schedule.h"
+
+/*
+ * Hosted port, the kernel runs as one Linux x86-64 process.
+ * Tasks are stacks inside the kernel heap switched by a small asm routine,
+ * SIGALRM is the tick interrupt and a nesting counter stands in for basepri.
+ * It exists to run the kernels and the benchmarks (bench/) on a PC, it is not a simulator
+ * of any board: cycles are TSC ticks and the tick comes from the host timer.
+ * Build with -no-pie -mno-red-zone, the kernel keeps addresses in uint32_t.
+ */
+#if !defined(__x86_64__)
+#error "arch/host only supports x86-64"
+#endif
+
+uint32_t  EnterCritical( void );
+void ExitCritical( uint32_t xReturn );
+uint32_t  xEnterCritical( void );
+void xExitCritical( uint32_t xReturn );
+void StartFirstTask(void);
+uint32_t *StackInit( uint32_t *pxTopOfStack, TaskFunction_t pxCode,void *pvParameters);
+uint32_t *pxPortInitialiseStack( uint32_t *pxTopOfStack, TaskFunction_t pxCode,void *pvParameters);
+void ErrorHandle(void);
+
+void HostSchedule(void);
+void HostStop(void);
+
+//TSC value when the last tick interrupt was taken
+extern volatile uint64_t HostTickStamp;
+
+#define schedule()\
+HostSchedule()
+
+/*
+ * Inside the tick handler the nesting counter is raised, so the switch is
+ * pended and done when the handler returns.
+ */
+#define schedule_from_isr(woken)\
+do { if (woken) { HostSchedule(); } } while (0)
+
+#define CycleCounterInit()\
+do { } while (0)
+
+#define CycleCounterGet()\
+( ( uint32_t ) __builtin_ia32_rdtsc() )
+
+//the host port keeps nothing per task outside the stack
+#define PortTaskFree(pxTopOfStack)\
+do { } while (0)
+
+
+#endif
@@ -0,0 +1,160 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 skaiui2
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *  https://github.com/skaiui2/SKRTOS_sparrow
+ */
+
+/*
+ * Read scaling of the concurrent hashmap (chashmap) against the chained hashmap
+ * behind a pthread rwlock, see lib/DataStruct.
+ *
+ * 1 to 16 reader threads look up random keys of a 100K int key table for
+ * BenchMillis each, while one writer replaces or removes and puts back a key
+ * every BenchWriteMicros. Results are lookups per second over all readers.
+ * Scaling needs as many cores as readers, check nproc before reading the table.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "hashmap.h"
+#include "chashmap.h"
+
+#define BenchEntries      100000
+#define BenchMillis       500
+#define BenchWriteMicros  100
+#define BenchMaxThreads   16
+
+static struct chashmap Concurrent;
+static struct hashmap Locked;
+static pthread_rwlock_t LockedLock = PTHREAD_RWLOCK_INITIALIZER;
+static atomic_int Stop;
+static int UseConcurrent;
+
+//a bijection, so distinct i give distinct keys
+static uword_t key_of(uint64_t i)
+{
+    i ^= i >> 31;
+    i *= 0x7fb5d329728ea185ULL;
+    i ^= i >> 27;
+    return (uword_t)(i | 1);
+}
+
+static void *reader(void *arg)
+{
+    uint64_t *lookups = arg;
+    uint64_t seed = (uint64_t)(uintptr_t)arg;
+    uint64_t n = 0;
+    uword_t sink = 0;
+    struct chashmap_reader self;
+
+    if (UseConcurrent)
+        chashmap_reader_register(&Concurrent, &self);
+    while (!atomic_load_explicit(&Stop, memory_order_relaxed)) {
+        for (int i = 0; i < 64; i++) {
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            void *key = (void *)key_of((seed >> 33) % BenchEntries);
+            if (UseConcurrent) {
+                sink += (uword_t)chashmap_get(&Concurrent, &self, key);
+            } else {
+                pthread_rwlock_rdlock(&LockedLock);
+                sink += (uword_t)hashmap_get(&Locked, key);
+                pthread_rwlock_unlock(&LockedLock);
+            }
+        }
+        n += 64;
+    }
+    if (UseConcurrent)
+        chashmap_reader_unregister(&Concurrent, &self);
+    *lookups = n + (sink == 1);
+    return NULL;
+}
+
+static void *writer(void *arg)
+{
+    (void)arg;
+    uint64_t i = 0;
+    while (!atomic_load_explicit(&Stop, memory_order_relaxed)) {
+        void *key = (void *)key_of(i++ % BenchEntries);
+        if (UseConcurrent) {
+            if (i & 1) {
+                chashmap_put(&Concurrent, key, key);
+            } else {
+                chashmap_remove(&Concurrent, key);
+                chashmap_put(&Concurrent, key, key);
+            }
+        } else {
+            pthread_rwlock_wrlock(&LockedLock);
+            if (!(i & 1))
+                hashmap_remove(&Locked, key);
+            hashmap_put(&Locked, key, key);
+            pthread_rwlock_unlock(&LockedLock);
+        }
+        usleep(BenchWriteMicros);
+    }
+    return NULL;
+}
+
+static double run(int threads)
+{
+    pthread_t tid[BenchMaxThreads + 1];
+    uint64_t lookups[BenchMaxThreads] __attribute__((aligned(64)));
+    uint64_t total = 0;
+
+    atomic_store(&Stop, 0);
+    for (int i = 0; i < threads; i++)
+        pthread_create(&tid[i], NULL, reader, &lookups[i]);
+    pthread_create(&tid[threads], NULL, writer, NULL);
+    usleep(BenchMillis * 1000);
+    atomic_store(&Stop, 1);
+    for (int i = 0; i <= threads; i++)
+        pthread_join(tid[i], NULL);
+    for (int i = 0; i < threads; i++)
+        total += lookups[i];
+    return (double)total / (BenchMillis / 1000.0);
+}
+
+int main(void)
+{
+    chashmap_init(&Concurrent, BenchEntries, 64, HASHMAP_KEY_INT, NULL);
+    hashmap_init(&Locked, BenchEntries, HASHMAP_KEY_INT);
+    for (uint64_t i = 0; i < BenchEntries; i++) {
+        chashmap_put(&Concurrent, (void *)key_of(i), (void *)key_of(i));
+        hashmap_put(&Locked, (void *)key_of(i), (void *)key_of(i));
+    }
+
+    printf("M lookups/s over all readers, %ld cores online\n", sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%-8s %12s %12s\n", "readers", "chashmap", "rwlock");
+    for (int threads = 1; threads <= BenchMaxThreads; threads *= 2) {
+        UseConcurrent = 1;
+        double concurrent = run(threads);
+        UseConcurrent = 0;
+        double locked = run(threads);
+        printf("%-8d %12.1f %12.1f\n", threads, concurrent / 1e6, locked / 1e6);
+    }
+
+    chashmap_destroy(&Concurrent);
+    hashmap_destroy(&Locked);
+    return 0;
+}
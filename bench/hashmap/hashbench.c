@@ -0,0 +1,250 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 skaiui2
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *  https://github.com/skaiui2/SKRTOS_sparrow
+ */
+
+/*
+ * Host benchmark of the chained hashmap (struct hashmap) against the open
+ * addressing swissmap, see lib/DataStruct. The slab rows are the chained map
+ * with its entries cut from slabs instead of one malloc each.
+ *
+ * insert  put of every key into a map sized for them up front
+ * hit     get of every key, in random order
+ * miss    get of as many keys that are not in the map
+ * remove  remove of every key, in random order
+ * grow    put of every key into a map created for 16 entries, timed one put at a time
+ * worst   the slowest single put of the grow pass
+ *
+ * Int keys are pointer sized scrambled integers, string keys topic names around
+ * them, "sensor/<decimal>/telemetry", 24 to 43 bytes.
+ * Results are ns per operation, averaged over the whole pass. grow includes the
+ * clock read around each put, compare it between the maps only.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "hashmap.h"
+#include "swissmap.h"
+
+#define BenchMaxEntries  10000000
+#define BenchSlab        1024       //entries per slab of the "slab" rows
+
+enum {
+    BenchInsert,
+    BenchHit,
+    BenchMiss,
+    BenchRemove,
+    BenchGrow,
+    BenchWorst,
+    BenchNumber
+};
+
+static const char *BenchName[BenchNumber] = {
+        [BenchInsert] = "insert",
+        [BenchHit]    = "hit",
+        [BenchMiss]   = "miss",
+        [BenchRemove] = "remove",
+        [BenchGrow]   = "grow",
+        [BenchWorst]  = "worst"
+};
+
+//keys[0, n) go into the map, keys[n, 2n) are the misses, order is a shuffle of [0, n)
+static void **Keys;
+static size_t *Order;
+static char *Text;
+static uword_t Sink;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+//a bijection, so distinct i give distinct keys
+static uint64_t scramble(uint64_t x)
+{
+    x ^= x >> 31;
+    x *= 0x7fb5d329728ea185ULL;
+    x ^= x >> 27;
+    x *= 0x81dadef4bc2dd44dULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static void keys_make(size_t n, int key_type)
+{
+    char *p = Text;
+    for (size_t i = 0; i < 2 * n; i++) {
+        uword_t v = (uword_t)scramble(i + 1);
+        if (key_type == HASHMAP_KEY_STRING) {
+            Keys[i] = p;
+            p += sprintf(p, "sensor/%llu/telemetry", (unsigned long long)v) + 1;
+        } else {
+            Keys[i] = (void *)v;
+        }
+    }
+
+    uint64_t seed = n;
+    for (size_t i = 0; i < n; i++)
+        Order[i] = i;
+    for (size_t i = n - 1; i > 0; i--) {
+        seed = scramble(seed);
+        size_t j = (size_t)(seed % (i + 1));
+        size_t t = Order[i];
+        Order[i] = Order[j];
+        Order[j] = t;
+    }
+}
+
+static void worst(double *ns, uint64_t put)
+{
+    if ((double)put > ns[BenchWorst])
+        ns[BenchWorst] = (double)put;
+}
+
+static void bench_chained(size_t n, int key_type, size_t slab, double *ns)
+{
+    struct hashmap map;
+    uint64_t t;
+    hashmap_init_alloc(&map, 16, key_type, NULL, slab);
+    ns[BenchWorst] = 0;
+    t = now_ns();
+    for (size_t i = 0; i < n; i++) {
+        uint64_t start = now_ns();
+        hashmap_put(&map, Keys[i], Keys[i]);
+        worst(ns, now_ns() - start);
+    }
+    ns[BenchGrow] = (double)(now_ns() - t) / n;
+    hashmap_destroy(&map);
+
+    hashmap_init_alloc(&map, n, key_type, NULL, slab);
+
+    t = now_ns();
+    for (size_t i = 0; i < n; i++)
+        hashmap_put(&map, Keys[i], Keys[i]);
+    ns[BenchInsert] = (double)(now_ns() - t) / n;
+
+    t = now_ns();
+    for (size_t i = 0; i < n; i++)
+        Sink += (uword_t)hashmap_get(&map, Keys[Order[i]]);
+    ns[BenchHit] = (double)(now_ns() - t) / n;
+
+    t = now_ns();
+    for (size_t i = 0; i < n; i++)
+        Sink += (uword_t)hashmap_get(&map, Keys[n + Order[i]]);
+    ns[BenchMiss] = (double)(now_ns() - t) / n;
+
+    t = now_ns();
+    for (size_t i = 0; i < n; i++)
+        Sink += hashmap_remove(&map, Keys[Order[i]]);
+    ns[BenchRemove] = (double)(now_ns() - t) / n;
+
+    hashmap_destroy(&map);
+}
+
+static void bench_swiss(size_t n, int key_type, double *ns)
+{
+    struct swissmap map;
+    uint64_t t;
+    swissmap_init(&map, 16, key_type);
+    ns[BenchWorst] = 0;
+    t = now_ns();
+    for (size_t i = 0; i < n; i++) {
+        uint64_t start = now_ns();
+        swissmap_put(&map, Keys[i], Keys[i]);
+        worst(ns, now_ns() - start);
+    }
+    ns[BenchGrow] = (double)(now_ns() - t) / n;
+    swissmap_destroy(&map);
+
+    swissmap_init(&map, n, key_type);
+
+    t = now_ns();
+    for (size_t i = 0; i < n; i++)
+        swissmap_put(&map, Keys[i], Keys[i]);
+    ns[BenchInsert] = (double)(now_ns() - t) / n;
+
+    t = now_ns();
+    for (size_t i = 0; i < n; i++)
+        Sink += (uword_t)swissmap_get(&map, Keys[Order[i]]);
+    ns[BenchHit] = (double)(now_ns() - t) / n;
+
+    t = now_ns();
+    for (size_t i = 0; i < n; i++)
+        Sink += (uword_t)swissmap_get(&map, Keys[n + Order[i]]);
+    ns[BenchMiss] = (double)(now_ns() - t) / n;
+
+    t = now_ns();
+    for (size_t i = 0; i < n; i++)
+        Sink += swissmap_remove(&map, Keys[Order[i]]);
+    ns[BenchRemove] = (double)(now_ns() - t) / n;
+
+    swissmap_destroy(&map);
+}
+
+static void report(const char *keys, size_t n, const char *map, const double *ns)
+{
+    printf("%-7s %9zu  %-8s", keys, n, map);
+    for (int i = 0; i < BenchNumber; i++)
+        printf(" %8.1f", ns[i]);
+    printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+    size_t max = BenchMaxEntries;
+    if (argc > 1)
+        max = strtoul(argv[1], NULL, 0);
+
+    Keys = malloc(sizeof(void *) * 2 * max);
+    Order = malloc(sizeof(size_t) * max);
+    Text = malloc(2 * max * 44);
+    if (!Keys || !Order || !Text) {
+        fprintf(stderr, "hashbench: out of memory for %zu entries\n", max);
+        return 1;
+    }
+
+    printf("ns per operation\n%-7s %9s  %-8s", "keys", "entries", "map");
+    for (int i = 0; i < BenchNumber; i++)
+        printf(" %8s", BenchName[i]);
+    printf("\n");
+
+    const int types[2] = {HASHMAP_KEY_INT, HASHMAP_KEY_STRING};
+    for (int k = 0; k < 2; k++) {
+        const char *name = (types[k] == HASHMAP_KEY_INT) ? "int" : "string";
+        for (size_t n = 1000; n <= max; n *= 10) {
+            double ns[BenchNumber];
+            keys_make(n, types[k]);
+            bench_chained(n, types[k], 0, ns);
+            report(name, n, "chained", ns);
+            bench_chained(n, types[k], BenchSlab, ns);
+            report(name, n, "slab", ns);
+            bench_swiss(n, types[k], ns);
+            report(name, n, "swiss", ns);
+        }
+    }
+    return Sink == 0x5a5a5a5a;
+}
@@ -0,0 +1,405 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 skaiui2
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *  https://github.com/skaiui2/SKRTOS_sparrow
+ */
+
+/*
+ * Scheduler micro-benchmarks, the same program is built against each kernel
+ * (table, list, rbtree, EDF) on the host port (arch/host), see the Makefile.
+ *
+ * switch        release of a semaphore until the higher priority waiter runs
+ * sem pingpong  round trip: release the peer's semaphore, take our own
+ * mutex handoff unlock of a mutex until the higher priority waiter owns it
+ * queue         round trip: queue_send to the peer, queue_receive its reply
+ * delay wake    tick interrupt until a task in TaskDelay(1) runs
+ * timer latency tick interrupt until a periodic timer callback runs
+ * timer jitter  change of the timer latency between two callbacks
+ * TaskCreate    TaskCreate of a lower priority task
+ * TaskDelete    TaskDelete of that task before it ever ran
+ *
+ * Cycles are TSC ticks, ns are converted with the TSC rate measured at start.
+ * The tick driven rows include the host timer, compare them between kernels
+ * only, not with a board.
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include "schedule.h"
+#include "port.h"
+#include "config.h"
+#include "sem.h"
+#include "mutex.h"
+#include "mequeue.h"
+#include "timer.h"
+
+#define BenchStack        1024
+#define BenchForever      60000
+#define BenchRounds       1000
+#define BenchTickRounds   200
+#define BenchWarmup       16
+
+//higher is more urgent, EDF uses 32 - priority as the respond line
+#define PrioDriver        20
+#define PrioTimer         15
+#define PrioHigh          10
+#define PrioLow           5
+#define PrioDummy         3
+
+enum {
+    BenchStamp,
+    BenchSwitch,
+    BenchSemPingPong,
+    BenchMutexHandoff,
+    BenchQueue,
+    BenchCreate,
+    BenchDelete,
+    BenchDelayWake,
+    BenchTimerLatency,
+    BenchTimerJitter,
+    BenchNumber
+};
+
+Class(BenchResult)
+{
+    const char *name;
+    uint32_t    count;
+    uint64_t    min;
+    uint64_t    max;
+    uint64_t    sum;
+};
+
+static BenchResult Results[BenchNumber] = {
+        [BenchStamp]        = { .name = "timestamp" },
+        [BenchSwitch]       = { .name = "switch" },
+        [BenchSemPingPong]  = { .name = "sem pingpong" },
+        [BenchMutexHandoff] = { .name = "mutex handoff" },
+        [BenchQueue]        = { .name = "queue round trip" },
+        [BenchCreate]       = { .name = "TaskCreate" },
+        [BenchDelete]       = { .name = "TaskDelete" },
+        [BenchDelayWake]    = { .name = "delay wake" },
+        [BenchTimerLatency] = { .name = "timer latency" },
+        [BenchTimerJitter]  = { .name = "timer jitter" },
+};
+
+
+#if defined(BENCH_TABLE)
+#define BenchKernel   "table"
+#define BenchTaskCreate(code, priority, self)\
+TaskCreate((TaskFunction_t)(code), BenchStack, NULL, (priority), (self))
+#define BenchTimerInit()\
+TimerInit(PrioTimer, BenchStack, 1)
+#define BenchTimerCreat(CallBack, period)\
+TimerCreat((CallBack), (period), 0, run)
+
+#elif defined(BENCH_LIST)
+#define BenchKernel   "list"
+#define BenchTaskCreate(code, priority, self)\
+TaskCreate((TaskFunction_t)(code), BenchStack, NULL, (priority), (self), 0)
+#define BenchTimerInit()\
+TimerInit(PrioTimer, BenchStack, 1)
+#define BenchTimerCreat(CallBack, period)\
+TimerCreat((CallBack), (period), run)
+
+#elif defined(BENCH_RBTREE)
+#define BenchKernel   "rbtree"
+#define BenchTaskCreate(code, priority, self)\
+TaskCreate((TaskFunction_t)(code), BenchStack, NULL, (priority), (self))
+#define BenchTimerInit()\
+TimerInit(PrioTimer, BenchStack, 1)
+#define BenchTimerCreat(CallBack, period)\
+TimerCreat((CallBack), (period), run)
+
+#elif defined(BENCH_EDF)
+#define BenchKernel   "EDF"
+#define BenchTaskCreate(code, priority, self)\
+TaskCreate((TaskFunction_t)(code), BenchStack, NULL, 0, 32 - (priority), 0xffff, (self))
+#define BenchTimerInit()\
+TimerInit(BenchStack, 1, 32 - PrioTimer, 0xffff, 1)
+#define BenchTimerCreat(CallBack, period)\
+TimerCreat((CallBack), (period), run)
+
+#else
+#error "define one of BENCH_TABLE, BENCH_LIST, BENCH_RBTREE, BENCH_EDF"
+#endif
+
+
+static inline uint64_t BenchNow(void)
+{
+    return __builtin_ia32_rdtsc();
+}
+
+static void BenchRecord(uint8_t index, uint64_t cycles, uint32_t round)
+{
+    BenchResult *result = &Results[index];
+    if (round < BenchWarmup) {
+        return;
+    }
+    if ((result->count == 0) || (cycles < result->min)) {
+        result->min = cycles;
+    }
+    if (cycles > result->max) {
+        result->max = cycles;
+    }
+    result->sum += cycles;
+    result->count++;
+}
+
+static void BenchTaskExit(void)
+{
+    TaskDelete(GetCurrentTCB());
+    while (1) {
+    }
+}
+
+
+static Semaphore_Handle SemHigh;
+static Semaphore_Handle SemLow;
+static Semaphore_Handle SemDone;
+static Mutex_Handle BenchMutex;
+static Queue_Handle QueueHigh;
+static Queue_Handle QueueLow;
+static volatile uint64_t Stamp;
+
+static void PingHigh(void)
+{
+    for (uint32_t i = 0; i < BenchRounds; i++) {
+        semaphore_take(SemHigh, BenchForever);
+        BenchRecord(BenchSwitch, BenchNow() - Stamp, i);
+        semaphore_release(SemLow);
+    }
+    BenchTaskExit();
+}
+
+static void PingLow(void)
+{
+    for (uint32_t i = 0; i < BenchRounds; i++) {
+        uint64_t start = BenchNow();
+        Stamp = start;
+        semaphore_release(SemHigh);
+        semaphore_take(SemLow, BenchForever);
+        BenchRecord(BenchSemPingPong, BenchNow() - start, i);
+    }
+    semaphore_release(SemDone);
+    BenchTaskExit();
+}
+
+
+static void MutexHigh(void)
+{
+    for (uint32_t i = 0; i < BenchRounds; i++) {
+        semaphore_take(SemHigh, BenchForever);
+        mutex_lock(BenchMutex, BenchForever);
+        BenchRecord(BenchMutexHandoff, BenchNow() - Stamp, i);
+        mutex_unlock(BenchMutex);
+    }
+    BenchTaskExit();
+}
+
+//holds the mutex while the high task blocks on it, then hands it over
+static void MutexLow(void)
+{
+    for (uint32_t i = 0; i < BenchRounds; i++) {
+        mutex_lock(BenchMutex, BenchForever);
+        semaphore_release(SemHigh);
+        Stamp = BenchNow();
+        mutex_unlock(BenchMutex);
+    }
+    semaphore_release(SemDone);
+    BenchTaskExit();
+}
+
+
+static void QueueHighTask(void)
+{
+    uint32_t message;
+    for (uint32_t i = 0; i < BenchRounds; i++) {
+        queue_receive(QueueHigh, &message, BenchForever);
+        queue_send(QueueLow, &message, BenchForever);
+    }
+    BenchTaskExit();
+}
+
+static void QueueLowTask(void)
+{
+    for (uint32_t i = 0; i < BenchRounds; i++) {
+        uint32_t message = i;
+        uint64_t start = BenchNow();
+        queue_send(QueueHigh, &message, BenchForever);
+        queue_receive(QueueLow, &message, BenchForever);
+        BenchRecord(BenchQueue, BenchNow() - start, i);
+    }
+    semaphore_release(SemDone);
+    BenchTaskExit();
+}
+
+
+static void DelayTask(void)
+{
+    for (uint32_t i = 0; i < BenchTickRounds; i++) {
+        TaskDelay(1);
+        BenchRecord(BenchDelayWake, BenchNow() - HostTickStamp, i);
+    }
+    semaphore_release(SemDone);
+    BenchTaskExit();
+}
+
+
+static uint32_t TimerRuns = 0;
+static uint64_t TimerLast = 0;
+
+static void BenchTimerCallBack(void *timer)
+{
+    uint64_t latency = BenchNow() - HostTickStamp;
+
+    if (TimerRuns >= BenchTickRounds) {
+        return;
+    }
+    BenchRecord(BenchTimerLatency, latency, TimerRuns);
+    if (TimerRuns) {
+        BenchRecord(BenchTimerJitter, (latency > TimerLast) ? (latency - TimerLast) : (TimerLast - latency), TimerRuns);
+    }
+    TimerLast = latency;
+    if (++TimerRuns == BenchTickRounds) {
+        TimerStop(timer);
+        semaphore_release(SemDone);
+    }
+}
+
+
+static void DummyTask(void)
+{
+    while (1) {
+    }
+}
+
+/*
+ * Run a high and a low priority task against each other until the low one
+ * posts SemDone, then give the leisure task a tick to free them.
+ */
+static void BenchPair(void (*high)(void), void (*low)(void))
+{
+    TaskHandle_t HighTcb = NULL;
+    TaskHandle_t LowTcb = NULL;
+
+    BenchTaskCreate(high, PrioHigh, &HighTcb);
+    BenchTaskCreate(low, PrioLow, &LowTcb);
+    semaphore_take(SemDone, BenchForever);
+    TaskDelay(2);
+}
+
+static void BenchDriver(void)
+{
+    for (uint32_t i = 0; i < BenchRounds; i++) {
+        uint64_t start = BenchNow();
+        BenchRecord(BenchStamp, BenchNow() - start, i);
+    }
+
+    SemHigh = semaphore_creat(0);
+    SemLow = semaphore_creat(0);
+    SemDone = semaphore_creat(0);
+    BenchPair(PingHigh, PingLow);
+
+    BenchMutex = mutex_creat();
+    BenchPair(MutexHigh, MutexLow);
+
+    QueueHigh = queue_creat(1, sizeof(uint32_t));
+    QueueLow = queue_creat(1, sizeof(uint32_t));
+    BenchPair(QueueHighTask, QueueLowTask);
+
+    for (uint32_t i = 0; i < BenchTickRounds; i++) {
+        TaskHandle_t dummy = NULL;
+        uint64_t start = BenchNow();
+        BenchTaskCreate(DummyTask, PrioDummy, &dummy);
+        uint64_t created = BenchNow();
+        TaskDelete(dummy);
+        uint64_t deleted = BenchNow();
+        BenchRecord(BenchCreate, created - start, i);
+        BenchRecord(BenchDelete, deleted - created, i);
+        TaskDelay(1);
+    }
+
+    TaskHandle_t DelayTcb = NULL;
+    BenchTaskCreate(DelayTask, PrioHigh, &DelayTcb);
+    semaphore_take(SemDone, BenchForever);
+    TaskDelay(2);
+
+    BenchTimerInit();
+    BenchTimerCreat(BenchTimerCallBack, 1);
+    semaphore_take(SemDone, BenchForever);
+
+    HostStop();
+}
+
+
+static uint64_t BenchTscHz(void)
+{
+    struct timespec begin, end;
+    int64_t ns;
+
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    uint64_t start = BenchNow();
+    do {
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        ns = (end.tv_sec - begin.tv_sec) * 1000000000LL + (end.tv_nsec - begin.tv_nsec);
+    } while (ns < 100000000LL);
+    return (BenchNow() - start) * 1000000000ULL / (uint64_t)ns;
+}
+
+static unsigned long long BenchNs(uint64_t cycles, uint64_t hz)
+{
+    return (unsigned long long)(cycles * 1000000000ULL / hz);
+}
+
+static void BenchReport(uint64_t hz)
+{
+    printf("kernel %s, TSC %llu MHz, %u ticks/s\n",
+           BenchKernel, (unsigned long long)(hz / 1000000), (unsigned)configTickRateHz);
+    printf("%-18s %7s %9s %9s %9s %9s %9s %9s\n",
+           "test", "samples", "min cyc", "avg cyc", "max cyc", "min ns", "avg ns", "max ns");
+    for (uint8_t i = 0; i < BenchNumber; i++) {
+        BenchResult *result = &Results[i];
+        if (result->count == 0) {
+            printf("%-18s %7u %9s\n", result->name, 0u, "-");
+            continue;
+        }
+        uint64_t avg = result->sum / result->count;
+        printf("%-18s %7u %9llu %9llu %9llu %9llu %9llu %9llu\n",
+               result->name, result->count,
+               (unsigned long long)result->min, (unsigned long long)avg, (unsigned long long)result->max,
+               BenchNs(result->min, hz), BenchNs(avg, hz), BenchNs(result->max, hz));
+    }
+}
+
+
+int main(void)
+{
+    TaskHandle_t DriverTcb = NULL;
+    uint64_t hz = BenchTscHz();
+
+    SchedulerInit();
+    BenchTaskCreate(BenchDriver, PrioDriver, &DriverTcb);
+    SchedulerStart();
+
+    BenchReport(hz);
+    return 0;
+}
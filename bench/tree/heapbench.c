@@ -0,0 +1,272 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 skaiui2
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *  https://github.com/skaiui2/SKRTOS_sparrow
+ */
+
+/*
+ * Host benchmark of the priority queues in lib/DataStruct, the pairing heap and
+ * the radix heap, against the red-black tree as the kernels use it for ready and
+ * delay sets: rb_Insert_node, rb_remove_node and first_node.
+ *
+ * hold    pop the smallest and put it back later, how an EDF job completes and
+ *         gets its next deadline; ns per pop and insert
+ * cancel  remove an arbitrary node and put it back later, a delay cut short by
+ *         a semaphore or a deadline changed; ns per remove and insert
+ * tick    the time moves on one tick, then every node due is popped and put
+ *         back later, a timer wheel firing periodic timers; ns per node fired,
+ *         the check of every tick included
+ *
+ * Every queue holds n nodes throughout and "later" is 1 to BenchRange ticks after
+ * the current time, so the keys only grow as the radix heap needs.
+ * All three get the same keys in the same order.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "rbtree.h"
+#include "pairheap.h"
+#include "radixheap.h"
+
+#define BenchMaxNodes  100000
+#define BenchOps       1000000
+#define BenchRange     1024
+
+enum {
+    BenchHold,
+    BenchCancel,
+    BenchTick,
+    BenchNumber
+};
+
+static const char *BenchName[BenchNumber] = {
+        [BenchHold]   = "hold",
+        [BenchCancel] = "cancel",
+        [BenchTick]   = "tick"
+};
+
+static rb_node *RbNodes;
+static struct pairheap_node *PairNodes;
+static struct radixheap_node *RadixNodes;
+static uint64_t Seed;
+static uint64_t Sink;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+//xorshift64, restarted for every queue so they all see the same numbers
+static uint64_t random_next(void)
+{
+    Seed ^= Seed << 13;
+    Seed ^= Seed >> 7;
+    Seed ^= Seed << 17;
+    return Seed;
+}
+
+static uint64_t later(uint64_t now)
+{
+    return now + 1 + random_next() % BenchRange;
+}
+
+static void report(size_t n, const char *queue, const double *ns)
+{
+    printf("%9zu  %-8s", n, queue);
+    for (int i = 0; i < BenchNumber; i++)
+        printf(" %8.1f", ns[i]);
+    printf("\n");
+}
+
+static void bench_rbtree(size_t n, double *ns)
+{
+    rb_root root;
+    uint64_t now = 0;
+    uint64_t t, fired = 0;
+
+    Seed = 0x9e3779b97f4a7c15ULL;
+    rb_root_init(&root);
+    for (size_t i = 0; i < n; i++) {
+        rb_node_init(&RbNodes[i]);
+        RbNodes[i].value = later(now);
+        rb_Insert_node(&root, &RbNodes[i]);
+    }
+
+    t = now_ns();
+    for (size_t i = 0; i < BenchOps; i++) {
+        rb_node *node = root.first_node;
+        rb_remove_node(&root, node);
+        now = node->value;
+        node->value = later(now);
+        rb_Insert_node(&root, node);
+    }
+    ns[BenchHold] = (double)(now_ns() - t) / BenchOps;
+
+    t = now_ns();
+    for (size_t i = 0; i < BenchOps; i++) {
+        rb_node *node = &RbNodes[random_next() % n];
+        rb_remove_node(&root, node);
+        node->value = later(now);
+        rb_Insert_node(&root, node);
+    }
+    ns[BenchCancel] = (double)(now_ns() - t) / BenchOps;
+
+    t = now_ns();
+    while (fired < BenchOps) {
+        now++;
+        while (root.first_node->value <= now) {
+            rb_node *node = root.first_node;
+            rb_remove_node(&root, node);
+            node->value = later(now);
+            rb_Insert_node(&root, node);
+            fired++;
+        }
+    }
+    ns[BenchTick] = (double)(now_ns() - t) / fired;
+    Sink += now;
+}
+
+static void bench_pairheap(size_t n, double *ns)
+{
+    struct pairheap heap;
+    uint64_t now = 0;
+    uint64_t t, fired = 0;
+
+    Seed = 0x9e3779b97f4a7c15ULL;
+    pairheap_init(&heap);
+    for (size_t i = 0; i < n; i++) {
+        pairheap_node_init(&PairNodes[i]);
+        PairNodes[i].value = later(now);
+        pairheap_insert(&heap, &PairNodes[i]);
+    }
+
+    t = now_ns();
+    for (size_t i = 0; i < BenchOps; i++) {
+        struct pairheap_node *node = pairheap_pop(&heap);
+        now = node->value;
+        node->value = later(now);
+        pairheap_insert(&heap, node);
+    }
+    ns[BenchHold] = (double)(now_ns() - t) / BenchOps;
+
+    t = now_ns();
+    for (size_t i = 0; i < BenchOps; i++) {
+        struct pairheap_node *node = &PairNodes[random_next() % n];
+        pairheap_remove(&heap, node);
+        node->value = later(now);
+        pairheap_insert(&heap, node);
+    }
+    ns[BenchCancel] = (double)(now_ns() - t) / BenchOps;
+
+    t = now_ns();
+    while (fired < BenchOps) {
+        now++;
+        while (pairheap_min(&heap)->value <= now) {
+            struct pairheap_node *node = pairheap_pop(&heap);
+            node->value = later(now);
+            pairheap_insert(&heap, node);
+            fired++;
+        }
+    }
+    ns[BenchTick] = (double)(now_ns() - t) / fired;
+    Sink += now;
+}
+
+static void bench_radixheap(size_t n, double *ns)
+{
+    struct radixheap heap;
+    uint64_t now = 0;
+    uint64_t t, fired = 0;
+
+    Seed = 0x9e3779b97f4a7c15ULL;
+    radixheap_init(&heap, now);
+    for (size_t i = 0; i < n; i++) {
+        radixheap_node_init(&RadixNodes[i]);
+        RadixNodes[i].value = later(now);
+        radixheap_insert(&heap, &RadixNodes[i]);
+    }
+
+    t = now_ns();
+    for (size_t i = 0; i < BenchOps; i++) {
+        struct radixheap_node *node = radixheap_pop(&heap);
+        now = node->value;
+        node->value = later(now);
+        radixheap_insert(&heap, node);
+    }
+    ns[BenchHold] = (double)(now_ns() - t) / BenchOps;
+
+    t = now_ns();
+    for (size_t i = 0; i < BenchOps; i++) {
+        struct radixheap_node *node = &RadixNodes[random_next() % n];
+        radixheap_remove(&heap, node);
+        node->value = later(now);
+        radixheap_insert(&heap, node);
+    }
+    ns[BenchCancel] = (double)(now_ns() - t) / BenchOps;
+
+    t = now_ns();
+    while (fired < BenchOps) {
+        now++;
+        while (radixheap_min(&heap)->value <= now) {
+            struct radixheap_node *node = radixheap_pop(&heap);
+            node->value = later(now);
+            radixheap_insert(&heap, node);
+            fired++;
+        }
+    }
+    ns[BenchTick] = (double)(now_ns() - t) / fired;
+    Sink += now;
+}
+
+int main(int argc, char **argv)
+{
+    size_t max = BenchMaxNodes;
+    if (argc > 1)
+        max = strtoul(argv[1], NULL, 0);
+
+    RbNodes = malloc(sizeof(rb_node) * max);
+    PairNodes = malloc(sizeof(struct pairheap_node) * max);
+    RadixNodes = malloc(sizeof(struct radixheap_node) * max);
+    if (!RbNodes || !PairNodes || !RadixNodes) {
+        fprintf(stderr, "heapbench: out of memory for %zu nodes\n", max);
+        return 1;
+    }
+
+    printf("ns per operation\n%9s  %-8s", "nodes", "queue");
+    for (int i = 0; i < BenchNumber; i++)
+        printf(" %8s", BenchName[i]);
+    printf("\n");
+
+    for (size_t n = 10; n <= max; n *= 10) {
+        double ns[BenchNumber];
+        bench_rbtree(n, ns);
+        report(n, "rbtree", ns);
+        bench_pairheap(n, ns);
+        report(n, "pairing", ns);
+        bench_radixheap(n, ns);
+        report(n, "radix", ns);
+    }
+    return Sink == 0x5a5a5a5a;
+}
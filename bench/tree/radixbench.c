@@ -0,0 +1,362 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 skaiui2
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *  https://github.com/skaiui2/SKRTOS_sparrow
+ */
+
+/*
+ * Host benchmark of the adaptive radix tree (art.c) against the fixed 16 way
+ * radix tree (radix.c), both behind the radix.h API.
+ *
+ * insert  insert of every index, in random order
+ * lookup  lookup of every index, in random order
+ * upper   lookup_upper_bound of an index next to every one in the tree
+ * delete  delete of every index, in random order
+ * bytes   node memory per index once all are in
+ *
+ * dense   IDs 0 to n - 1
+ * sizes   n distinct block sizes, multiples of 8 spread up to 8n, what
+ *         tralloc.c keeps
+ * sparse  scrambled 64 bit indexes
+ * Results are ns per operation. Nodes come from heap_malloc, here malloc with
+ * a count of the bytes in use.
+ *
+ * A second table scans radix.c in index order, in ns per item found:
+ * upper   lookup_upper_bound from just past the last item, a descent per item
+ * gang    gang_lookup, ScanBatch items per call
+ * tagged  next_tag over the one item in ScanTagEvery that carries a tag
+ * filter  the same items found by gang_lookup of all and tag_get on each
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "art.h"
+#include "radix.h"
+
+#define BenchMaxIndexes  100000
+#define ScanBatch        64
+#define ScanTagEvery     64
+
+enum {
+    BenchInsert,
+    BenchLookup,
+    BenchUpper,
+    BenchDelete,
+    BenchBytes,
+    BenchNumber
+};
+
+static const char *BenchName[BenchNumber] = {
+        [BenchInsert] = "insert",
+        [BenchLookup] = "lookup",
+        [BenchUpper]  = "upper",
+        [BenchDelete] = "delete",
+        [BenchBytes]  = "bytes"
+};
+
+enum {
+    ScanUpper,
+    ScanGang,
+    ScanTagged,
+    ScanFilter,
+    ScanNumber
+};
+
+static const char *ScanName[ScanNumber] = {
+        [ScanUpper]  = "upper",
+        [ScanGang]   = "gang",
+        [ScanTagged] = "tagged",
+        [ScanFilter] = "filter"
+};
+
+enum {
+    KeysDense,
+    KeysSizes,
+    KeysSparse,
+    KeysNumber
+};
+
+static const char *KeysName[KeysNumber] = {
+        [KeysDense]  = "dense",
+        [KeysSizes]  = "sizes",
+        [KeysSparse] = "sparse"
+};
+
+//Keys in insert order, Order a shuffle of [0, n)
+static size_t *Keys;
+static size_t *Order;
+static size_t Bytes;
+static uintptr_t Sink;
+
+//radix.c and art.c allocate through the kernel heap
+void *heap_malloc(size_t WantSize)
+{
+    size_t *block = malloc(WantSize + sizeof(size_t));
+    if (block == NULL)
+        return NULL;
+    *block = WantSize;
+    Bytes += WantSize;
+    return block + 1;
+}
+
+void heap_free(void *xReturn)
+{
+    size_t *block = (size_t *)xReturn - 1;
+    Bytes -= *block;
+    free(block);
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+//a bijection, so distinct i give distinct keys
+static uint64_t scramble(uint64_t x)
+{
+    x ^= x >> 31;
+    x *= 0x7fb5d329728ea185ULL;
+    x ^= x >> 27;
+    x *= 0x81dadef4bc2dd44dULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static void keys_make(size_t n, int keys)
+{
+    uint64_t seed = n;
+    for (size_t i = 0; i < n; i++)
+        Order[i] = i;
+    for (size_t i = n - 1; i > 0; i--) {
+        seed = scramble(seed);
+        size_t j = (size_t)(seed % (i + 1));
+        size_t t = Order[i];
+        Order[i] = Order[j];
+        Order[j] = t;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        switch (keys) {
+            case KeysDense:
+                Keys[i] = Order[i];
+                break;
+            case KeysSizes:
+                //every other multiple of 8, so upper bounds land between sizes
+                Keys[i] = 16 * Order[i] + 8;
+                break;
+            default:
+                Keys[i] = (size_t)scramble(i + 1);
+                break;
+        }
+    }
+}
+
+static void bench_art(size_t n, double *ns)
+{
+    struct art_root root;
+    uint64_t t;
+    art_init(&root);
+
+    t = now_ns();
+    for (size_t i = 0; i < n; i++)
+        art_insert(&root, Keys[i], &Keys[i]);
+    ns[BenchInsert] = (double)(now_ns() - t) / n;
+    ns[BenchBytes] = (double)Bytes / n;
+
+    t = now_ns();
+    for (size_t i = 0; i < n; i++)
+        Sink += (uintptr_t)art_lookup(&root, Keys[Order[i]]);
+    ns[BenchLookup] = (double)(now_ns() - t) / n;
+
+    t = now_ns();
+    for (size_t i = 0; i < n; i++)
+        Sink += (uintptr_t)art_lookup_upper_bound(&root, Keys[Order[i]] + 1);
+    ns[BenchUpper] = (double)(now_ns() - t) / n;
+
+    t = now_ns();
+    for (size_t i = 0; i < n; i++)
+        Sink += (uintptr_t)art_delete(&root, Keys[Order[i]]);
+    ns[BenchDelete] = (double)(now_ns() - t) / n;
+}
+
+static void bench_radix(size_t n, double *ns)
+{
+    struct radix_tree_root root;
+    uint64_t t;
+    radix_tree_init(&root);
+
+    t = now_ns();
+    for (size_t i = 0; i < n; i++)
+        radix_tree_insert(&root, Keys[i], &Keys[i]);
+    ns[BenchInsert] = (double)(now_ns() - t) / n;
+    ns[BenchBytes] = (double)Bytes / n;
+
+    t = now_ns();
+    for (size_t i = 0; i < n; i++)
+        Sink += (uintptr_t)radix_tree_lookup(&root, Keys[Order[i]]);
+    ns[BenchLookup] = (double)(now_ns() - t) / n;
+
+    t = now_ns();
+    for (size_t i = 0; i < n; i++)
+        Sink += (uintptr_t)radix_tree_lookup_upper_bound(&root, Keys[Order[i]] + 1);
+    ns[BenchUpper] = (double)(now_ns() - t) / n;
+
+    t = now_ns();
+    for (size_t i = 0; i < n; i++)
+        Sink += (uintptr_t)radix_tree_delete(&root, Keys[Order[i]]);
+    ns[BenchDelete] = (double)(now_ns() - t) / n;
+}
+
+//items are &Keys[i], so each knows its index
+static void bench_scan(size_t n, double *ns)
+{
+    struct radix_tree_root root;
+    void *batch[ScanBatch];
+    size_t tagged = 0;
+    size_t found;
+    size_t index;
+    void *item;
+    uint64_t t;
+    radix_tree_init(&root);
+
+    for (size_t i = 0; i < n; i++) {
+        radix_tree_insert(&root, Keys[i], &Keys[i]);
+        if (i % ScanTagEvery == 0) {
+            radix_tree_tag_set(&root, Keys[i], 0);
+            tagged++;
+        }
+    }
+
+    t = now_ns();
+    found = 0;
+    index = 0;
+    while ((item = radix_tree_lookup_upper_bound(&root, index)) != NULL) {
+        found++;
+        index = *(size_t *)item + 1;
+        if (index == 0)
+            break;
+    }
+    ns[ScanUpper] = (double)(now_ns() - t) / found;
+
+    t = now_ns();
+    found = 0;
+    index = 0;
+    for (;;) {
+        unsigned int got = radix_tree_gang_lookup(&root, batch, index, ScanBatch);
+        found += got;
+        if (got < ScanBatch)
+            break;
+        index = *(size_t *)batch[got - 1] + 1;
+        if (index == 0)
+            break;
+    }
+    ns[ScanGang] = (double)(now_ns() - t) / found;
+
+    t = now_ns();
+    found = 0;
+    index = 0;
+    while ((item = radix_tree_next_tag(&root, &index, 0)) != NULL) {
+        found++;
+        Sink += (uintptr_t)item;
+        if (++index == 0)
+            break;
+    }
+    ns[ScanTagged] = (double)(now_ns() - t) / tagged;
+    if (found != tagged)
+        fprintf(stderr, "radixbench: next_tag found %zu of %zu tagged\n", found, tagged);
+
+    t = now_ns();
+    index = 0;
+    for (;;) {
+        unsigned int got = radix_tree_gang_lookup(&root, batch, index, ScanBatch);
+        for (unsigned int i = 0; i < got; i++)
+            if (radix_tree_tag_get(&root, *(size_t *)batch[i], 0))
+                Sink += (uintptr_t)batch[i];
+        if (got < ScanBatch)
+            break;
+        index = *(size_t *)batch[got - 1] + 1;
+        if (index == 0)
+            break;
+    }
+    ns[ScanFilter] = (double)(now_ns() - t) / tagged;
+
+    for (size_t i = 0; i < n; i++)
+        radix_tree_delete(&root, Keys[i]);
+}
+
+static void report(const char *keys, size_t n, const char *tree, const double *ns)
+{
+    printf("%-7s %9zu  %-6s", keys, n, tree);
+    for (int i = 0; i < BenchNumber; i++)
+        printf(" %8.1f", ns[i]);
+    printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+    size_t max = BenchMaxIndexes;
+    if (argc > 1)
+        max = strtoul(argv[1], NULL, 0);
+
+    Keys = malloc(sizeof(size_t) * max);
+    Order = malloc(sizeof(size_t) * max);
+    if (!Keys || !Order) {
+        fprintf(stderr, "radixbench: out of memory for %zu indexes\n", max);
+        return 1;
+    }
+
+    printf("ns per operation, bytes per index\n%-7s %9s  %-6s", "keys", "indexes", "tree");
+    for (int i = 0; i < BenchNumber; i++)
+        printf(" %8s", BenchName[i]);
+    printf("\n");
+
+    for (int k = 0; k < KeysNumber; k++) {
+        for (size_t n = 1000; n <= max; n *= 10) {
+            double ns[BenchNumber];
+            keys_make(n, k);
+            bench_radix(n, ns);
+            report(KeysName[k], n, "radix", ns);
+            bench_art(n, ns);
+            report(KeysName[k], n, "art", ns);
+        }
+    }
+    printf("\nradix scans, ns per item found\n%-7s %9s        ", "keys", "indexes");
+    for (int i = 0; i < ScanNumber; i++)
+        printf(" %8s", ScanName[i]);
+    printf("\n");
+
+    for (int k = 0; k < KeysNumber; k++) {
+        for (size_t n = 1000; n <= max; n *= 10) {
+            double ns[ScanNumber];
+            keys_make(n, k);
+            bench_scan(n, ns);
+            printf("%-7s %9zu        ", KeysName[k], n);
+            for (int i = 0; i < ScanNumber; i++)
+                printf(" %8.1f", ns[i]);
+            printf("\n");
+        }
+    }
+    return Sink == 0x5a5a5a5a;
+}
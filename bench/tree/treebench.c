@@ -0,0 +1,274 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 skaiui2
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *  https://github.com/skaiui2/SKRTOS_sparrow
+ */
+
+/*
+ * Host benchmark of the B+tree (bptree) against the red-black tree (rbtree.c),
+ * both from lib/DataStruct, as an index of uint64_t keys.
+ *
+ * insert  insert of every key, in random order, into an empty tree
+ * lookup  lookup of every key, in random order
+ * next    in-order walk from the smallest key, per step
+ * remove  remove of every key, in random order. rb_remove_node is handed the node,
+ *         bptree_remove looks the key up first
+ * sorted  the tree built from the keys in ascending order: bptree_bulk_load for
+ *         the B+tree, rb_Insert_node in ascending order for the red-black tree
+ * popmin  take the smallest key and remove it until the tree is empty, what a
+ *         ready or timer queue does. The red-black tree keeps its first node,
+ *         the B+tree descends to it
+ *
+ * Small trees are run again until each cell has timed about BenchOps operations.
+ * Results are ns per operation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "bptree.h"
+#include "rbtree.h"
+
+#define BenchMaxKeys  1000000
+#define BenchOps      1000000
+
+enum {
+    BenchInsert,
+    BenchLookup,
+    BenchNext,
+    BenchRemove,
+    BenchSorted,
+    BenchPopMin,
+    BenchNumber
+};
+
+static const char *BenchName[BenchNumber] = {
+        [BenchInsert] = "insert",
+        [BenchLookup] = "lookup",
+        [BenchNext]   = "next",
+        [BenchRemove] = "remove",
+        [BenchSorted] = "sorted",
+        [BenchPopMin] = "popmin"
+};
+
+//Keys in insert order, Sorted the same ascending, Order a shuffle of [0, n)
+static uint64_t *Keys;
+static uint64_t *Sorted;
+static void **Values;
+static size_t *Order;
+static rb_node *Nodes;
+static uint64_t Sink;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+//a bijection, so distinct i give distinct keys
+static uint64_t scramble(uint64_t x)
+{
+    x ^= x >> 31;
+    x *= 0x7fb5d329728ea185ULL;
+    x ^= x >> 27;
+    x *= 0x81dadef4bc2dd44dULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static int key_compare(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void keys_make(size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        Keys[i] = scramble(i + 1);
+        Sorted[i] = Keys[i];
+    }
+    qsort(Sorted, n, sizeof(uint64_t), key_compare);
+    for (size_t i = 0; i < n; i++)
+        Values[i] = (void *)(uintptr_t)Sorted[i];
+
+    uint64_t seed = n;
+    for (size_t i = 0; i < n; i++)
+        Order[i] = i;
+    for (size_t i = n - 1; i > 0; i--) {
+        seed = scramble(seed);
+        size_t j = (size_t)(seed % (i + 1));
+        size_t t = Order[i];
+        Order[i] = Order[j];
+        Order[j] = t;
+    }
+}
+
+static rb_node *rb_lookup(rb_root *root, uint64_t key)
+{
+    rb_node *node = root->rb_node;
+    while (node != NULL) {
+        if (key < node->value)
+            node = node->rb_left;
+        else if (key > node->value)
+            node = node->rb_right;
+        else
+            return node;
+    }
+    return NULL;
+}
+
+static void bench_rbtree(size_t n, size_t reps, double *ns)
+{
+    rb_root root;
+    uint64_t t;
+    rb_root_init(&root);
+
+    for (size_t r = 0; r < reps; r++) {
+        t = now_ns();
+        for (size_t i = 0; i < n; i++) {
+            rb_node_init(&Nodes[i]);
+            Nodes[i].value = Keys[i];
+            rb_Insert_node(&root, &Nodes[i]);
+        }
+        ns[BenchInsert] += (double)(now_ns() - t);
+
+        t = now_ns();
+        for (size_t i = 0; i < n; i++)
+            Sink += (uintptr_t)rb_lookup(&root, Keys[Order[i]]);
+        ns[BenchLookup] += (double)(now_ns() - t);
+
+        t = now_ns();
+        for (rb_node *node = root.first_node; node != NULL; node = rb_next(node))
+            Sink += node->value;
+        ns[BenchNext] += (double)(now_ns() - t);
+
+        t = now_ns();
+        for (size_t i = 0; i < n; i++)
+            rb_remove_node(&root, &Nodes[Order[i]]);
+        ns[BenchRemove] += (double)(now_ns() - t);
+
+        t = now_ns();
+        for (size_t i = 0; i < n; i++) {
+            rb_node_init(&Nodes[i]);
+            Nodes[i].value = Sorted[i];
+            rb_Insert_node(&root, &Nodes[i]);
+        }
+        ns[BenchSorted] += (double)(now_ns() - t);
+
+        t = now_ns();
+        while (root.count != 0) {
+            rb_node *node = root.first_node;
+            Sink += node->value;
+            rb_remove_node(&root, node);
+        }
+        ns[BenchPopMin] += (double)(now_ns() - t);
+    }
+}
+
+static void bench_bptree(size_t n, size_t reps, double *ns)
+{
+    struct bptree tree;
+    struct bptree_iter iter;
+    uint64_t t;
+    bptree_init(&tree);
+
+    for (size_t r = 0; r < reps; r++) {
+        t = now_ns();
+        for (size_t i = 0; i < n; i++)
+            bptree_put(&tree, Keys[i], &Keys[i]);
+        ns[BenchInsert] += (double)(now_ns() - t);
+
+        t = now_ns();
+        for (size_t i = 0; i < n; i++)
+            Sink += (uintptr_t)bptree_get(&tree, Keys[Order[i]]);
+        ns[BenchLookup] += (double)(now_ns() - t);
+
+        t = now_ns();
+        for (int more = bptree_first(&tree, &iter); more; more = bptree_next(&iter))
+            Sink += bptree_iter_key(&iter);
+        ns[BenchNext] += (double)(now_ns() - t);
+
+        t = now_ns();
+        for (size_t i = 0; i < n; i++)
+            bptree_remove(&tree, Keys[Order[i]]);
+        ns[BenchRemove] += (double)(now_ns() - t);
+
+        t = now_ns();
+        bptree_bulk_load(&tree, Sorted, Values, n);
+        ns[BenchSorted] += (double)(now_ns() - t);
+
+        t = now_ns();
+        while (bptree_first(&tree, &iter)) {
+            uint64_t key = bptree_iter_key(&iter);
+            Sink += key;
+            bptree_remove(&tree, key);
+        }
+        ns[BenchPopMin] += (double)(now_ns() - t);
+    }
+    bptree_destroy(&tree);
+}
+
+static void report(size_t n, size_t reps, const char *tree, const double *ns)
+{
+    printf("%9zu  %-8s", n, tree);
+    for (int i = 0; i < BenchNumber; i++)
+        printf(" %8.1f", ns[i] / (double)(n * reps));
+    printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+    size_t max = BenchMaxKeys;
+    if (argc > 1)
+        max = strtoul(argv[1], NULL, 0);
+
+    Keys = malloc(sizeof(uint64_t) * max);
+    Sorted = malloc(sizeof(uint64_t) * max);
+    Values = malloc(sizeof(void *) * max);
+    Order = malloc(sizeof(size_t) * max);
+    Nodes = malloc(sizeof(rb_node) * max);
+    if (!Keys || !Sorted || !Values || !Order || !Nodes) {
+        fprintf(stderr, "treebench: out of memory for %zu keys\n", max);
+        return 1;
+    }
+
+    printf("ns per operation\n%9s  %-8s", "keys", "tree");
+    for (int i = 0; i < BenchNumber; i++)
+        printf(" %8s", BenchName[i]);
+    printf("\n");
+
+    for (size_t n = 10; n <= max; n *= 10) {
+        size_t reps = (n < BenchOps) ? BenchOps / n : 1;
+        double ns[BenchNumber] = {0};
+        keys_make(n);
+        bench_rbtree(n, reps, ns);
+        report(n, reps, "rbtree", ns);
+        for (int i = 0; i < BenchNumber; i++)
+            ns[i] = 0;
+        bench_bptree(n, reps, ns);
+        report(n, reps, "bptree", ns);
+    }
+    return Sink == 0x5a5a5a5a;
+}
@@ -31,6 +31,7 @@
 typedef struct Oo_buffer *Oo_buffer_handle;
 Oo_buffer_handle Oo_buffer_creat(uint8_t buffer_size);
 void Oo_insert(Oo_buffer_handle Oo_buffer1, int object);
+uint8_t Oo_insert_from_isr(Oo_buffer_handle Oo_buffer1, int object, uint8_t *woken);
 int Oo_remove(Oo_buffer_handle Oo_buffer1);
 void Oo_buffer_delete(Oo_buffer_handle Oo_buffer1);
 
@@ -31,6 +31,8 @@
 //!!!! You must use the atomic for global variable!!Not a local variable or a malloc address.
 //Operand must be byte aligned!!
 
+#if defined(__arm__) || defined(__thumb__)
+
 /*
  * ldrex is used to read data from memory address i to register %0 (output).
 To perform the specified operation (such as add or sub), the operands are registers %0 and v, and the result is stored in %0.
@@ -73,6 +75,25 @@ static inline void atomic_##op( uint32_t i,uint32_t *v)        \
     );                                                      \
 }
 
+#else
+
+/*
+ * Hosted builds (arch/host) have no ldrex/strex, the compiler builtins do the same job.
+ */
+#define ATOMIC_OP_RETURN(op)                                \
+static inline int atomic_##op##_return( uint32_t i,uint32_t *v)        \
+{                                                           \
+    return __atomic_##op##_fetch(v, i, __ATOMIC_SEQ_CST);   \
+}
+
+#define ATOMIC_OP(op)                                \
+static inline void atomic_##op( uint32_t i,uint32_t *v)        \
+{                                                           \
+    __atomic_##op##_fetch(v, i, __ATOMIC_SEQ_CST);          \
+}
+
+#endif
+
 #define ATOMIC_OPS(op)  ATOMIC_OP(op) ATOMIC_OP_RETURN(op)
 
 ATOMIC_OPS(add)
@@ -88,6 +109,8 @@ ATOMIC_OPS(sub)
 
 
 
+#if defined(__arm__) || defined(__thumb__)
+
 static inline uint32_t atomic_set_return(uint32_t i, const uint32_t *v) {
     uint32_t tmp, res;
     __asm volatile (
@@ -118,6 +141,48 @@ static inline void atomic_set(uint32_t i, const uint32_t *v) {
 }
 
 
+/*
+ * Store new to v only if v still holds old, returns the value that was found in v,
+ * so the exchange took place when the return equals old.
+ * On a mismatch the exclusive monitor is cleared before leaving.
+ */
+static inline uint32_t atomic_cmpxchg(uint32_t old, uint32_t new, uint32_t *v) {
+    uint32_t prev, res;
+    __asm volatile (
+            "1: ldrex %0, [%2]     \n"
+            "   teq %0, %3         \n"
+            "   bne 2f             \n"
+            "   strex %1, %4, [%2] \n"
+            "   teq %1, #0         \n"
+            "   bne 1b             \n"
+            "   b 3f               \n"
+            "2: clrex              \n"
+            "3:                    \n"
+            : "=&r" (prev), "=&r" (res)
+            : "r" (v), "r" (old), "r" (new)
+            : "cc", "memory"
+            );
+    return prev;
+}
+
+#else
+
+static inline uint32_t atomic_set_return(uint32_t i, const uint32_t *v) {
+    return __atomic_exchange_n((uint32_t *)v, i, __ATOMIC_SEQ_CST);
+}
+
+static inline void atomic_set(uint32_t i, const uint32_t *v) {
+    __atomic_store_n((uint32_t *)v, i, __ATOMIC_SEQ_CST);
+}
+
+static inline uint32_t atomic_cmpxchg(uint32_t old, uint32_t new, uint32_t *v) {
+    __atomic_compare_exchange_n(v, &old, new, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return old;
+}
+
+#endif
+
+
 
 
 
@@ -49,14 +49,29 @@
 #define configTickRateHz			( ( uint32_t ) 1000 )
 
 #define alignment_byte               0x07
+#ifndef config_heap    //the host build (bench/) sets a bigger one
 #define config_heap   (10240)
+#endif
 #define configShieldInterPriority 191
+#define configTraceEnable  0     //1: record scheduling events into the trace ring buffer, see kernel/trace
+#define configRunTimeStats  0    //1: charge the cycles between two switches to the task that ran, see TaskStatsSnapshot
+#define configTaskPool     0     //1: TaskCreate takes the TCB and stack from static pools before the heap
+#define configTaskPoolSize 8     //pooled TCBs, and pooled stacks of each size class
+#define configTaskPoolStack0 128 //stack size classes in words, smallest first
+#define configTaskPoolStack1 256
+#define configTaskPoolStack2 512
 
 
 
 
 typedef  struct TCB_t         *TaskHandle_t;
 
+//memory for the TCB of TaskCreateStatic, the layout is private to schedule.c
+Class(TaskStatic_t)
+{
+    uint64_t space[24];
+};
+
 void TaskCreate(  TaskFunction_t pxTaskCode,
                   uint16_t usStackDepth,
                   void *pvParameters,
@@ -64,6 +79,15 @@ void TaskCreate(  TaskFunction_t pxTaskCode,
                   uint8_t respondLine,
                   uint16_t deadline,
                   TaskHandle_t *self);
+void TaskCreateStatic( TaskFunction_t pxTaskCode,
+                  uint16_t usStackDepth,
+                  void *pvParameters,
+                  uint16_t period,
+                  uint8_t respondLine,
+                  uint16_t deadline,
+                  TaskHandle_t *self,
+                  TaskStatic_t *tcb,
+                  uint32_t *stack);
 void TaskDelete(TaskHandle_t self);
 void TaskDelay(uint16_t ticks);
 uint32_t TaskEnter(void);
@@ -95,4 +119,17 @@ void CheckTicks(void);
 uint32_t xEnterCritical();
 void xExitCritical(uint32_t xre);
 
+
+Class(TaskStats)
+{
+    TaskHandle_t task;
+    uint8_t priority;
+    uint64_t RunTime;       //cycles run since the scheduler started
+    uint16_t usage;         //share of the CPU since the previous snapshot, in 0.01%
+};
+
+uint8_t TaskStatsSnapshot(TaskStats *stats, uint8_t max, uint16_t *idle);
+
+
+
 #endif
@@ -34,6 +34,7 @@ typedef struct Semaphore_struct *Semaphore_Handle;
 Semaphore_Handle semaphore_creat(uint8_t value);
 void semaphore_delete(Semaphore_Handle semaphore);
 uint8_t semaphore_release( Semaphore_Handle semaphore);
+uint8_t semaphore_release_from_isr( Semaphore_Handle semaphore, uint8_t *woken);
 uint8_t semaphore_take(Semaphore_Handle semaphore,uint32_t Ticks);
 
 
@@ -0,0 +1,70 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 skaiui2
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *  https://github.com/skaiui2/SKRTOS_sparrow
+ */
+
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+#include "class.h"
+
+/*
+ * one writer, many reader.
+ * The writer makes sequence odd while it updates the data and even again when done,
+ * a reader copies the data and retries if sequence was odd or has changed meanwhile.
+ * Readers never block and never write the lock, so they can run in ISRs.
+ */
+Class(seqlock)
+{
+    volatile uint32_t sequence;
+};
+
+#if defined(__arm__) || defined(__thumb__)
+#define seqlock_barrier()   __asm volatile ("dmb" ::: "memory")
+#else
+#define seqlock_barrier()   __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
+
+void seqlock_init(seqlock *lock);
+uint32_t write_seqlock(seqlock *lock);
+void write_sequnlock(seqlock *lock, uint32_t xre);
+
+
+static inline uint32_t read_seqbegin(const seqlock *lock)
+{
+    uint32_t sequence = lock->sequence;
+    seqlock_barrier();
+    return sequence;
+}
+
+/*
+ * An ISR that preempts the writer sees an odd sequence until the writer resumes,
+ * so it must not loop on read_seqretry but give up and use its previous copy.
+ */
+static inline uint8_t read_seqretry(const seqlock *lock, uint32_t start)
+{
+    seqlock_barrier();
+    return (start & 1) || (lock->sequence != start);
+}
+
+
+#endif
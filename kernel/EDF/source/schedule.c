@@ -26,6 +26,7 @@
 #include "schedule.h"
 #include "heap.h"
 #include "port.h"
+#include "trace.h"
 #include "rbtree.h"
 #include "atomic.h"
 
@@ -46,8 +47,9 @@ rb_root *OverWakeTicksTree;
 rb_root SuspendTree;
 rb_root DeleteTree;
 
-static volatile uint32_t NowTickCount = ( uint32_t ) 0;
+volatile uint32_t NowTickCount = ( uint32_t ) 0;
 volatile uint64_t AbsoluteClock = 0;
+uint8_t SusPend = 1;
 
 Class(TCB_t)
 {
@@ -61,6 +63,13 @@ Class(TCB_t)
     uint32_t ExitTime;
     uint32_t SmoothTime;
     uint32_t *pxStack;
+    uint8_t SusPend;
+    uint8_t Origin;
+#if configRunTimeStats
+    uint64_t RunTime;
+    uint64_t LastRunTime;
+    struct TCB_t *StatsNext;
+#endif
 };
 
 __attribute__( ( used ) )  TaskHandle_t volatile schedule_currentTCB = NULL;
@@ -129,6 +138,7 @@ void TaskTreeAdd(TaskHandle_t self, uint8_t State)
             SuspendTreeAdd
     };
     TreeAdd[State](node);
+    trace_state(self, (State == Ready) ? TraceReady : TraceSuspend, self->respondLine);
     xExitCritical(xReturn);
 }
 
@@ -151,12 +161,15 @@ void Insert_IPC(TaskHandle_t self, rb_root *root)
     self->IPC_node.root = root;
     self->IPC_node.value = AbsoluteClock + self->respondLine;
     rb_Insert_node(root, &(self->IPC_node));
+    trace_ipc_wait(self, root);
 }
 
 
 void Remove_IPC(TaskHandle_t self)
 {
+    trace_ipc_wake(self, self->IPC_node.root);
     rb_remove_node( self->IPC_node.root , &(self->IPC_node));
+    self->IPC_node.root = NULL;
 }
 
 
@@ -176,12 +189,54 @@ uint8_t CheckIPCState( TaskHandle_t taskHandle)
 }
 
 
+#if configRunTimeStats
+static TCB_t *StatsList = NULL;
+static uint32_t SwitchStamp = 0;
+static uint64_t TotalTime = 0;
+static uint64_t SnapshotTime = 0;
+#endif
+
+/*
+ * Charge the cycles since the last switch to the task leaving the CPU.
+ * The 32-bit difference is right as long as a task keeps the CPU for less than 2^32 cycles.
+ */
+static inline void RunTimeAccount(void)
+{
+#if configRunTimeStats
+    uint32_t now = CycleCounterGet();
+    uint32_t elapsed = now - SwitchStamp;
+    SwitchStamp = now;
+    TotalTime += elapsed;
+    if (schedule_currentTCB != NULL) {
+        schedule_currentTCB->RunTime += elapsed;
+    }
+#endif
+}
+
 uint8_t volatile schedule_PendSV = 0;
 
+#define FromHeap    0   //where the TCB and the stack come from, TaskRelease gives them back there
+#define FromPool    1
+#define FromCaller  2
+
+static TCB_t *PendingRelease = NULL;    //a pooled or static task that deleted itself, released once it is switched out
+static void TaskRelease(TCB_t *self);
+
 void TaskSwitchContext( void )
 {
+    RunTimeAccount();
     schedule_PendSV++;
+    //SusPend is per task, one blocking inside xEnterCritical must not stop the ticks for the next
+    if (schedule_currentTCB != NULL) {
+        schedule_currentTCB->SusPend = SusPend;
+    }
     schedule_currentTCB = TaskFirstRespond(&ReadyTree);
+    SusPend = schedule_currentTCB->SusPend;
+    if (PendingRelease != NULL) {
+        TaskRelease(PendingRelease);
+        PendingRelease = NULL;
+    }
+    trace_switch(schedule_currentTCB, schedule_currentTCB->respondLine);
 }
 
 
@@ -204,6 +259,7 @@ void TaskDelay( uint16_t ticks )
 {
     if (ticks) {
         TaskTreeRemove(schedule_currentTCB, Ready);
+        trace_state(schedule_currentTCB, TraceDelay, schedule_currentTCB->respondLine);
         RecordWakeTime(ticks);
         schedule();
     }
@@ -214,25 +270,89 @@ void TaskDelay( uint16_t ticks )
  *  For ARM, the address of TCB above the stack.
  */
 
-void  TaskCreate( TaskFunction_t pxTaskCode,
-                  const uint16_t usStackDepth,
-                  void * const pvParameters,
-                  uint16_t period,
-                  uint8_t respondLine,
-                  uint16_t deadline,
-                  TaskHandle_t * const self
-                  )
+#if configTaskPool
+/*
+ * Static task pool: TCBs and stacks in three size classes, handed out and given back
+ * in O(1) through stacks of free slots, so a pooled task never touches the heap.
+ */
+static const uint16_t PoolDepth[3] = {configTaskPoolStack0, configTaskPoolStack1, configTaskPoolStack2};
+static TCB_t PoolTcb[configTaskPoolSize];
+static uint32_t PoolStack0[configTaskPoolSize * configTaskPoolStack0] __attribute__((aligned(8)));
+static uint32_t PoolStack1[configTaskPoolSize * configTaskPoolStack1] __attribute__((aligned(8)));
+static uint32_t PoolStack2[configTaskPoolSize * configTaskPoolStack2] __attribute__((aligned(8)));
+static uint32_t *const PoolStack[3] = {PoolStack0, PoolStack1, PoolStack2};
+static uint8_t PoolTcbFree[configTaskPoolSize];
+static uint8_t PoolStackFree[3][configTaskPoolSize];
+static uint8_t PoolTcbCount = 0;
+static uint8_t PoolStackCount[3] = {0, 0, 0};
+
+static void TaskPoolInit(void)
+{
+    for (uint8_t i = 0; i < configTaskPoolSize; i++) {
+        PoolTcbFree[i] = i;
+        for (uint8_t c = 0; c < 3; c++) {
+            PoolStackFree[c][i] = i;
+        }
+    }
+    PoolTcbCount = configTaskPoolSize;
+    for (uint8_t c = 0; c < 3; c++) {
+        PoolStackCount[c] = configTaskPoolSize;
+    }
+}
+
+//a TCB and the smallest free stack that fits, NULL when the pool can't serve the task
+static TCB_t *TaskPoolTake(uint16_t usStackDepth, uint32_t **pxStack)
+{
+    TCB_t *NewTcb = NULL;
+    uint32_t xre = xEnterCritical();
+    for (uint8_t c = 0; (c < 3) && (PoolTcbCount != 0); c++) {
+        if ((usStackDepth <= PoolDepth[c]) && (PoolStackCount[c] != 0)) {
+            *pxStack = PoolStack[c] + PoolStackFree[c][--PoolStackCount[c]] * PoolDepth[c];
+            NewTcb = &PoolTcb[PoolTcbFree[--PoolTcbCount]];
+            break;
+        }
+    }
+    xExitCritical(xre);
+    return NewTcb;
+}
+
+static void TaskPoolGive(TCB_t *self)
+{
+    uint32_t xre = xEnterCritical();
+    for (uint8_t c = 0; c < 3; c++) {
+        if ((self->pxStack >= PoolStack[c]) &&
+            (self->pxStack < PoolStack[c] + configTaskPoolSize * PoolDepth[c])) {
+            PoolStackFree[c][PoolStackCount[c]++] = (uint8_t)((self->pxStack - PoolStack[c]) / PoolDepth[c]);
+            break;
+        }
+    }
+    PoolTcbFree[PoolTcbCount++] = (uint8_t)(self - PoolTcb);
+    xExitCritical(xre);
+}
+#endif
+
+static void TaskInit( TCB_t *NewTcb,
+                      uint32_t *pxStack,
+                      uint8_t Origin,
+                      TaskFunction_t pxTaskCode,
+                      const uint16_t usStackDepth,
+                      void * const pvParameters,
+                      uint16_t period,
+                      uint8_t respondLine,
+                      uint16_t deadline,
+                      TaskHandle_t * const self
+                      )
 {
     uint32_t *topStack = NULL;
-    uint32_t *pxStack = ( uint32_t *) heap_malloc( ( ( ( size_t ) usStackDepth ) * sizeof( uint32_t * ) ) );
-    TCB_t *NewTcb = (TCB_t *)heap_malloc(sizeof(TCB_t));
     *self = ( TCB_t *) NewTcb;
     *NewTcb = (TCB_t){
         .period = period,
         .respondLine = respondLine,
         .deadline = deadline,
         .SmoothTime = 0,
-        .pxStack = pxStack
+        .pxStack = pxStack,
+        .SusPend = 1,
+        .Origin = Origin
     };
     topStack =  NewTcb->pxStack + (usStackDepth - (uint32_t)1) ;
     topStack = ( uint32_t *) (((uint32_t)topStack) & (~((uint32_t) alignment_byte)));
@@ -240,12 +360,73 @@ void  TaskCreate( TaskFunction_t pxTaskCode,
     rb_node_init(&NewTcb->task_node);
     rb_node_init(&NewTcb->IPC_node);
     TaskTreeAdd(NewTcb, Ready);
+#if configRunTimeStats
+    uint32_t xre = xEnterCritical();
+    NewTcb->StatsNext = StatsList;
+    StatsList = NewTcb;
+    xExitCritical(xre);
+#endif
+}
+
+void  TaskCreate( TaskFunction_t pxTaskCode,
+                  const uint16_t usStackDepth,
+                  void * const pvParameters,
+                  uint16_t period,
+                  uint8_t respondLine,
+                  uint16_t deadline,
+                  TaskHandle_t * const self
+                  )
+{
+    uint32_t *pxStack = NULL;
+    TCB_t *NewTcb = NULL;
+#if configTaskPool
+    NewTcb = TaskPoolTake(usStackDepth, &pxStack);
+    if (NewTcb != NULL) {
+        TaskInit(NewTcb, pxStack, FromPool, pxTaskCode, usStackDepth, pvParameters, period, respondLine, deadline, self);
+        return;
+    }
+#endif
+    pxStack = ( uint32_t *) heap_malloc( ( ( ( size_t ) usStackDepth ) * sizeof( uint32_t * ) ) );
+    NewTcb = (TCB_t *)heap_malloc(sizeof(TCB_t));
+    TaskInit(NewTcb, pxStack, FromHeap, pxTaskCode, usStackDepth, pvParameters, period, respondLine, deadline, self);
 }
 
+_Static_assert(sizeof(TaskStatic_t) >= sizeof(TCB_t), "TaskStatic_t must hold a TCB_t");
+
+/*
+ * TaskCreate on memory the caller owns: the TCB goes in tcb, the stack is usStackDepth words at stack.
+ * Nothing is allocated or freed, the memory can be reused once the task is deleted.
+ */
+void  TaskCreateStatic( TaskFunction_t pxTaskCode,
+                        const uint16_t usStackDepth,
+                        void * const pvParameters,
+                        uint16_t period,
+                        uint8_t respondLine,
+                        uint16_t deadline,
+                        TaskHandle_t * const self,
+                        TaskStatic_t *tcb,
+                        uint32_t *stack
+                        )
+{
+    TaskInit((TCB_t *)tcb, stack, FromCaller, pxTaskCode, usStackDepth, pvParameters, period, respondLine, deadline, self);
+}
+
+/*
+ * Heap tasks are freed by the leisureTask, pooled and static ones are given back at once,
+ * or at the next switch when a task deletes itself.
+ */
 void TaskDelete(TaskHandle_t self)
 {
+    uint32_t xre = xEnterCritical();
     TaskTreeRemove(self, Ready);
-    rb_Insert_node(&DeleteTree, &self->task_node);
+    if (self->Origin == FromHeap) {
+        rb_Insert_node(&DeleteTree, &self->task_node);
+    } else if (self == schedule_currentTCB) {
+        PendingRelease = self;
+    } else {
+        TaskRelease(self);
+    }
+    xExitCritical(xre);
     schedule();
 }
 
@@ -285,14 +466,36 @@ void TreeDelayInit(void)
 }
 
 
+static void TaskRelease(TCB_t *self)
+{
+#if configRunTimeStats
+    uint32_t xre = xEnterCritical();
+    TCB_t **link = &StatsList;
+    while (*link != self) {
+        link = &((*link)->StatsNext);
+    }
+    *link = self->StatsNext;
+    xExitCritical(xre);
+#endif
+    PortTaskFree((uint32_t *)self->pxTopOfStack);
+    if (self->Origin == FromHeap) {
+        heap_free((void *)self->pxStack);
+        heap_free((void *)self);
+    }
+#if configTaskPool
+    else if (self->Origin == FromPool) {
+        TaskPoolGive(self);
+    }
+#endif
+}
+
 void TaskFree(void)
 {
     if (DeleteTree.count != 0) {
         rb_node *first_node = rb_last(&DeleteTree);
         TaskHandle_t self = container_of(first_node, TCB_t, task_node);
         rb_remove_node(&DeleteTree, &self->task_node);
-        heap_free((void *)self->pxStack);
-        heap_free((void *)self);
+        TaskRelease(self);
     }
 }
 
@@ -307,6 +510,8 @@ void leisureTask( void )
     while (1) {
         leisureCount++;
         TaskFree();
+        //DeleteTree.count changes under this loop
+        __asm volatile("" ::: "memory");
     }
 }
 
@@ -326,8 +531,17 @@ void LeisureTaskCreat(void)
 
 void SchedulerInit(void)
 {
+#if configRunTimeStats
+    CycleCounterInit();
+#endif
+#if configTraceEnable
+    TraceInit();
+#endif
     ADTTreeInit();
     TreeDelayInit();
+#if configTaskPool
+    TaskPoolInit();
+#endif
     LeisureTaskCreat();
 }
 
@@ -346,7 +560,6 @@ void DelayTreeRemove(TaskHandle_t self)
 }
 
 
-uint8_t SusPend = 1;
 void CheckTicks(void)
 {
     rb_node *rb_node = NULL;
@@ -388,4 +601,37 @@ void xExitCritical(uint32_t xre)
 }
 
 
+#if configRunTimeStats
+/*
+ * top-style snapshot: fills at most max entries, usage is the share of the CPU
+ * each task had since the previous snapshot, idle is the share of the leisureTask.
+ */
+uint8_t TaskStatsSnapshot(TaskStats *stats, uint8_t max, uint16_t *idle)
+{
+    uint8_t n = 0;
+    uint32_t xre = xEnterCritical();
+    RunTimeAccount();
+    uint64_t window = TotalTime - SnapshotTime;
+    SnapshotTime = TotalTime;
+
+    for (TCB_t *task = StatsList; task != NULL; task = task->StatsNext) {
+        uint64_t ran = task->RunTime - task->LastRunTime;
+        uint16_t usage = window ? (uint16_t)((ran * 10000) / window) : 0;
+        task->LastRunTime = task->RunTime;
+        if ((task == leisureTcb) && (idle != NULL)) {
+            *idle = usage;
+        }
+        if (n < max) {
+            stats[n++] = (TaskStats){
+                    .task = task,
+                    .priority = task->respondLine,
+                    .RunTime = task->RunTime,
+                    .usage = usage
+            };
+        }
+    }
+    xExitCritical(xre);
+    return n;
+}
+#endif
 
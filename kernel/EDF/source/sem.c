@@ -26,11 +26,21 @@
 #include "sem.h"
 #include "heap.h"
 #include "port.h"
+#include "atomic.h"
 #include "schedule.h"
 
+/*
+ * value holds the count, SemWaiters is set while tasks are blocked on the semaphore.
+ * take and release only enter the critical section when the ldrex/strex fast path fails,
+ * that is when the count is 0 (take) or a task is waiting (release).
+ * A task preempted between ldrex and strex fails its strex, so the plain stores
+ * made inside the critical section are safe against the fast path.
+ */
+#define SemWaiters    (1UL << 31)
+
 Class(Semaphore_struct)
 {
-    uint8_t value;
+    uint32_t value;
     rb_root WaitTree;
 };
 
@@ -50,23 +60,69 @@ void semaphore_delete(Semaphore_Handle semaphore)
 
 
 extern uint8_t schedule_PendSV;
-uint8_t semaphore_release( Semaphore_Handle semaphore)
-{
-    uint32_t xre = xEnterCritical();
-    TaskHandle_t CurrentTCB = GetCurrentTCB();
-    uint8_t CurrentTcbPriority = GetRespondLine(CurrentTCB);
 
+/*
+ * Slow path of the release, called inside the critical section.
+ * woken is set when the task given the count outranks the current one.
+ */
+static void SemRelease( Semaphore_Handle semaphore, uint8_t *woken)
+{
     if (semaphore->WaitTree.count != 0) {
         TaskHandle_t SendTask = FirstRespond_IPC(&(semaphore->WaitTree));
         DelayTreeRemove(SendTask);
         Remove_IPC(SendTask);
         TaskTreeAdd(SendTask,Ready);
-        if(GetRespondLine(SendTask) > CurrentTcbPriority ){
-            schedule();
+        if (semaphore->WaitTree.count == 0) {
+            semaphore->value = 0;
+        }
+        //The count is handed over to SendTask, it does not go through value.
+        if(GetRespondLine(SendTask) > GetRespondLine(GetCurrentTCB()) ){
+            *woken = true;
         }
+    } else {
+        semaphore->value = (semaphore->value & ~SemWaiters) + 1;
     }
-    (semaphore->value)++;
+}
 
+uint8_t semaphore_release( Semaphore_Handle semaphore)
+{
+    uint32_t value = semaphore->value;
+    while (!(value & SemWaiters)) {
+        uint32_t prev = atomic_cmpxchg(value, value + 1, &(semaphore->value));
+        if (prev == value) {
+            return true;
+        }
+        value = prev;
+    }
+
+    uint8_t woken = false;
+    uint32_t xre = xEnterCritical();
+    SemRelease(semaphore, &woken);
+    if (woken) {
+        schedule();
+    }
+    xExitCritical(xre);
+    return true;
+}
+
+
+/*
+ * For interrupts: never blocks and never schedules, woken collects whether a
+ * higher priority task was made ready, pass it to schedule_from_isr at the end of the handler.
+ */
+uint8_t semaphore_release_from_isr( Semaphore_Handle semaphore, uint8_t *woken)
+{
+    uint32_t value = semaphore->value;
+    while (!(value & SemWaiters)) {
+        uint32_t prev = atomic_cmpxchg(value, value + 1, &(semaphore->value));
+        if (prev == value) {
+            return true;
+        }
+        value = prev;
+    }
+
+    uint32_t xre = xEnterCritical();
+    SemRelease(semaphore, woken);
     xExitCritical(xre);
     return true;
 }
@@ -74,24 +130,33 @@ uint8_t semaphore_release( Semaphore_Handle semaphore)
 
 uint8_t semaphore_take(Semaphore_Handle semaphore,uint32_t Ticks)
 {
+    uint32_t value = semaphore->value;
+    while ((value != 0) && !(value & SemWaiters)) {
+        uint32_t prev = atomic_cmpxchg(value, value - 1, &(semaphore->value));
+        if (prev == value) {
+            return true;
+        }
+        value = prev;
+    }
+
+    if(Ticks == 0 ){
+        return false;
+    }
+
     uint32_t xre = xEnterCritical();
     TaskHandle_t CurrentTCB = GetCurrentTCB();
 
-    if( semaphore->value > 0) {
+    if( (semaphore->value & ~SemWaiters) > 0) {
         (semaphore->value)--;
         xExitCritical(xre);
         return true;
     }
-    if(Ticks == 0 ){
-        return false;
-    }
 
     uint8_t volatile temp = schedule_PendSV;
 
-    if(Ticks > 0){
-        Insert_IPC(CurrentTCB, &(semaphore->WaitTree));
-        TaskDelay(Ticks);
-    }
+    semaphore->value |= SemWaiters;
+    Insert_IPC(CurrentTCB, &(semaphore->WaitTree));
+    TaskDelay(Ticks);
     xExitCritical(xre);
 
     while(temp == schedule_PendSV){ }//It loops until the schedule is start.
@@ -100,12 +165,16 @@ uint8_t semaphore_take(Semaphore_Handle semaphore,uint32_t Ticks)
     //Check whether the wake is due to delay or due to semaphore availability
     if(!CheckIPCState(CurrentTCB)){//if true ,the task is Block!
         Remove_IPC(CurrentTCB);
+        if (semaphore->WaitTree.count == 0) {
+            semaphore->value &= ~SemWaiters;
+        }
         xExitCritical(xReturn);
         return false;
     }else{
-        (semaphore->value)--;
+        //semaphore_release has handed the count over to this task.
         xExitCritical(xReturn);
         return true;
     }
 }
 
+
@@ -39,7 +39,7 @@ Class(timer_struct)
 
 rb_root ClockTree;
 static uint16_t TimerCheckPeriod = 0;
-extern uint32_t NowTickCount;
+extern volatile uint32_t NowTickCount;
 
 void ClockTreeAdd(timer_struct *timer)
 {
@@ -27,6 +27,7 @@
 
 #include "tralloc.h"
 #include "link_list.h"
+#include "art.h"
 
 
 __attribute__( ( always_inline ) ) inline uint8_t log2_clz(uint32_t Table)
@@ -64,7 +65,8 @@ mem_head TheHead = {
 static  uint8_t AllHeap[config_heap];
 static const size_t HeapStructSize = (sizeof(TR_node) + (size_t)(alignment_byte)) & (~alignment_byte);
 
-struct radix_tree_root MemRadixTree;
+//free blocks by size, blocks of the same size chained through next_block
+struct art_root MemRadixTree;
 
 
 #define PTR_SIZE    uint64_t
@@ -75,7 +77,7 @@ void TR_init()
 {
     TR_node *first_node;
     PTR_SIZE start_heap;
-    radix_tree_init(&MemRadixTree);
+    art_init(&MemRadixTree);
     list_node_init(&(TheHead.cache_node));
 
     start_heap = (PTR_SIZE) AllHeap;
@@ -91,22 +93,22 @@ void TR_init()
         .block_size = TheHead.AllSize
     };
     list_add_next(&(TheHead.cache_node), &(first_node->link_node));
-    radix_tree_insert(&MemRadixTree, TheHead.AllSize, first_node);
+    art_insert(&MemRadixTree, TheHead.AllSize, first_node);
 }
 
 
 int mem_node_delete(TR_node *delete_node)
 {
-    TR_node *head = radix_tree_lookup(&MemRadixTree, delete_node->block_size);
+    TR_node *head = art_lookup(&MemRadixTree, delete_node->block_size);
     if (!head) {
         return -1;
     }
 
     TR_node *next_node = head->next_block;
     if (head == delete_node) {
-        radix_tree_delete(&MemRadixTree, head->block_size);
+        art_delete(&MemRadixTree, head->block_size);
         if (next_node) {
-            radix_tree_insert(&MemRadixTree, next_node->block_size, next_node);
+            art_insert(&MemRadixTree, next_node->block_size, next_node);
         }
     } else {
         TR_node *prev_node = head;
@@ -125,15 +127,15 @@ int mem_node_delete(TR_node *delete_node)
 
 int mem_node_insert(TR_node *insert_node)
 {
-    TR_node *head = radix_tree_lookup(&MemRadixTree, insert_node->block_size);
+    TR_node *head = art_lookup(&MemRadixTree, insert_node->block_size);
     if (head) {
         insert_node->next_block = head;
-        radix_tree_delete(&MemRadixTree, head->block_size);
+        art_delete(&MemRadixTree, head->block_size);
     } else {
         insert_node->next_block = NULL;
     }
 
-    radix_tree_insert(&MemRadixTree, insert_node->block_size, insert_node);
+    art_insert(&MemRadixTree, insert_node->block_size, insert_node);
     return 0;
 }
 
@@ -162,7 +164,7 @@ void *TR_alloc(size_t WantSize)
         WantSize = (WantSize + alignment_byte) & (~alignment_byte);
     }
 
-    use_node = radix_tree_lookup_upper_bound(&MemRadixTree, WantSize);
+    use_node = art_lookup_upper_bound(&MemRadixTree, WantSize);
     if (!use_node) {
         goto free;
     }
@@ -50,9 +50,18 @@
 #define configTickRateHz			( ( uint32_t ) 1000 )
 
 #define alignment_byte               0x07
+#ifndef config_heap    //the host build (bench/) sets a bigger one
 #define config_heap   (10*1024)
+#endif
 #define configMaxPriority 32
 #define configShieldInterPriority 191
+#define configTraceEnable  0     //1: record scheduling events into the trace ring buffer, see kernel/trace
+#define configRunTimeStats  0    //1: charge the cycles between two switches to the task that ran, see TaskStatsSnapshot
+#define configTaskPool     0     //1: TaskCreate takes the TCB and stack from static pools before the heap
+#define configTaskPoolSize 8     //pooled TCBs, and pooled stacks of each size class
+#define configTaskPoolStack0 128 //stack size classes in words, smallest first
+#define configTaskPoolStack1 256
+#define configTaskPoolStack2 512
 
 
 
@@ -61,12 +70,26 @@ void TaskDelay( uint16_t ticks );
 typedef void (* TaskFunction_t)( void * );
 typedef  struct TCB_t         *TaskHandle_t;
 
+//memory for the TCB of TaskCreateStatic, the layout is private to schedule.c
+Class(TaskStatic_t)
+{
+    uint64_t space[16];
+};
+
 void TaskCreate( TaskFunction_t pxTaskCode,
                   uint16_t usStackDepth,
                   void *pvParameters,
                   uint32_t uxPriority,
                   TaskHandle_t *self,
                   uint8_t TimeSlice);
+void TaskCreateStatic( TaskFunction_t pxTaskCode,
+                  uint16_t usStackDepth,
+                  void *pvParameters,
+                  uint32_t uxPriority,
+                  TaskHandle_t *self,
+                  uint8_t TimeSlice,
+                  TaskStatic_t *tcb,
+                  uint32_t *stack );
 void TaskDelete(TaskHandle_t self);
 
 uint8_t TaskPrioritySet(TaskHandle_t taskHandle,uint8_t priority);
@@ -91,6 +114,16 @@ TaskHandle_t IPCHighestPriorityTask(TheList *xlist);
 uint8_t GetTaskPriority(TaskHandle_t taskHandle);
 
 
+Class(TaskStats)
+{
+    TaskHandle_t task;
+    uint8_t priority;
+    uint64_t RunTime;       //cycles run since the scheduler started
+    uint16_t usage;         //share of the CPU since the previous snapshot, in 0.01%
+};
+
+uint8_t TaskStatsSnapshot(TaskStats *stats, uint8_t max, uint16_t *idle);
+
 
 
 #endif
@@ -67,6 +67,20 @@ void Oo_insert(Oo_buffer_handle Oo_buffer1, int object)
     semaphore_release(Oo_buffer1->item);
 }
 
+/*
+ * For an interrupt producer: semaphore_take with 0 ticks never blocks,
+ * false means the buffer is full. Pass woken to schedule_from_isr at the end of the handler.
+ */
+uint8_t Oo_insert_from_isr(Oo_buffer_handle Oo_buffer1, int object, uint8_t *woken)
+{
+    if (!semaphore_take(Oo_buffer1->space, 0)) {
+        return false;
+    }
+    Oo_buffer1->buf[Oo_buffer1->in] =  object;
+    Oo_buffer1->in = (Oo_buffer1->in + 1) % Oo_buffer1->size;
+    return semaphore_release_from_isr(Oo_buffer1->item, woken);
+}
+
 int Oo_remove(Oo_buffer_handle Oo_buffer1)
 {
     semaphore_take(Oo_buffer1->item, 1);
@@ -24,98 +24,176 @@
  */
 
 #include "RWlock.h"
-#include "sem.h"
 #include "heap.h"
+#include "port.h"
+#include "atomic.h"
 
 
 /*
  * many reader, many writer.
  *
+ * state holds the reader count, RWWriter while a writer owns the lock and
+ * RWWaiters while tasks are blocked in ReadList or WriteList.
+ * Acquire and release are a single ldrex/strex while nobody waits,
+ * otherwise they go through the critical section and the lock is handed
+ * over directly: a writer to the highest priority writer, or to all waiting readers at once.
  */
+#define RWWriter        (1UL << 31)
+#define RWWaiters       (1UL << 30)
+#define RWReaders(state)    ((state) & ~(RWWriter | RWWaiters))
 
 Class(rwlock)
 {
-    Semaphore_Handle read;
-    Semaphore_Handle write;
-    Semaphore_Handle W_guard;
-    Semaphore_Handle C_guard;
-    int active_reader;
-    int reading_reader;
-    int active_writer;
-    int writing_writer;
+    uint32_t state;
+    uint8_t policy;
+    TheList ReadList;
+    TheList WriteList;
 };
 
 rwlock_handle rwlock_creat(void)
+{
+    return rwlock_policy_creat(RWLockPreferWriter);
+}
+
+/*
+ * RWLockPreferReader lets new readers in while writers wait,
+ * RWLockPreferWriter queues new readers behind a waiting writer.
+ */
+rwlock_handle rwlock_policy_creat(uint8_t policy)
 {
     rwlock_handle rwlock1 = heap_malloc(sizeof (rwlock));
     *rwlock1 = (rwlock){
-            .read = semaphore_creat(0),
-            .write = semaphore_creat(0),
-            .W_guard = semaphore_creat(1),
-            .C_guard = semaphore_creat(1),
-            .active_reader = 0,
-            .reading_reader = 0,
-            .active_writer = 0,
-            .writing_writer = 0
+            .state = 0,
+            .policy = policy
     };
+    ListInit(&(rwlock1->ReadList));
+    ListInit(&(rwlock1->WriteList));
     return rwlock1;
 }
 
+
+extern uint8_t schedule_PendSV;
+
+/*
+ * Block until the lock is handed over, called in the critical section.
+ */
+static void RWLockBlock(TheList *WaitList, uint32_t xre)
+{
+    TaskHandle_t CurrentTCB = GetCurrentTCB();
+    uint8_t volatile temp = schedule_PendSV;
+
+    Insert_IPC(CurrentTCB, WaitList);
+    TaskListRemove(CurrentTCB, Ready);
+    schedule();
+    xExitCritical(xre);
+
+    while(temp == schedule_PendSV){ }//It loops until the schedule is start.
+}
+
+static void RWLockWake(TaskHandle_t WaitTask)
+{
+    Remove_IPC(WaitTask);
+    TaskListAdd(WaitTask, Ready);
+    if (GetTaskPriority(WaitTask) > GetTaskPriority(GetCurrentTCB())) {
+        schedule();
+    }
+}
+
+/*
+ * Hand the free lock to the waiters, called in the critical section.
+ */
+static void RWLockHandOver(rwlock *rwlock1)
+{
+    uint8_t ReaderFirst = (rwlock1->policy == RWLockPreferReader) || (rwlock1->WriteList.count == 0);
+
+    if (ReaderFirst && (rwlock1->ReadList.count != 0)) {
+        uint32_t readers = 0;
+        while (rwlock1->ReadList.count != 0) {
+            RWLockWake(IPCHighestPriorityTask(&(rwlock1->ReadList)));
+            readers++;
+        }
+        rwlock1->state = readers;
+    } else if (rwlock1->WriteList.count != 0) {
+        RWLockWake(IPCHighestPriorityTask(&(rwlock1->WriteList)));
+        rwlock1->state = RWWriter;
+    } else {
+        rwlock1->state = 0;
+    }
+
+    if ((rwlock1->ReadList.count != 0) || (rwlock1->WriteList.count != 0)) {
+        rwlock1->state |= RWWaiters;
+    }
+}
+
+
 void read_acquire(rwlock_handle rwlock1)
 {
-    semaphore_take(rwlock1->C_guard, 1);
-    rwlock1->active_reader += 1;
-    if(rwlock1->active_writer == 0){
-        rwlock1->reading_reader += 1;
-        semaphore_release(rwlock1->read);
+    uint32_t busy = (rwlock1->policy == RWLockPreferReader) ? RWWriter : (RWWriter | RWWaiters);
+    uint32_t state = rwlock1->state;
+    while (!(state & busy)) {
+        uint32_t prev = atomic_cmpxchg(state, state + 1, &(rwlock1->state));
+        if (prev == state) {
+            return;
+        }
+        state = prev;
     }
-    semaphore_release(rwlock1->C_guard);
-    semaphore_take(rwlock1->read, 1);
+
+    uint32_t xre = xEnterCritical();
+    if (!(rwlock1->state & RWWriter) &&
+        ((rwlock1->policy == RWLockPreferReader) || (rwlock1->WriteList.count == 0))) {
+        (rwlock1->state)++;
+        xExitCritical(xre);
+        return;
+    }
+    rwlock1->state |= RWWaiters;
+    RWLockBlock(&(rwlock1->ReadList), xre);
 }
 
 void read_release(rwlock_handle rwlock1)
 {
-    semaphore_take(rwlock1->C_guard, 1);
-    rwlock1->reading_reader -= 1;
-    rwlock1->active_reader -= 1;
-    if(rwlock1->reading_reader == 0){
-        while(rwlock1->writing_writer < rwlock1->active_writer){
-            rwlock1->writing_writer += 1;
-            semaphore_release(rwlock1->write);
+    uint32_t state = rwlock1->state;
+    while (!(state & RWWaiters)) {
+        uint32_t prev = atomic_cmpxchg(state, state - 1, &(rwlock1->state));
+        if (prev == state) {
+            return;
         }
+        state = prev;
     }
-    semaphore_release(rwlock1->C_guard);
+
+    uint32_t xre = xEnterCritical();
+    (rwlock1->state)--;
+    if (RWReaders(rwlock1->state) == 0) {
+        RWLockHandOver(rwlock1);
+    }
+    xExitCritical(xre);
 }
 
 void write_acquire(rwlock_handle rwlock1)
 {
-    semaphore_take(rwlock1->C_guard, 1);
-    rwlock1->active_writer += 1;
-    if(rwlock1->reading_reader == 0){
-        rwlock1->writing_writer += 1;
-        semaphore_release(rwlock1->write);
+    if (atomic_cmpxchg(0, RWWriter, &(rwlock1->state)) == 0) {
+        return;
     }
-    semaphore_release(rwlock1->C_guard);
-    semaphore_take(rwlock1->write, 1);
 
-    semaphore_take(rwlock1->W_guard, 1);
+    uint32_t xre = xEnterCritical();
+    if ((rwlock1->state & ~RWWaiters) == 0) {
+        rwlock1->state |= RWWriter;
+        xExitCritical(xre);
+        return;
+    }
+    rwlock1->state |= RWWaiters;
+    RWLockBlock(&(rwlock1->WriteList), xre);
 }
 
 
 void write_release(rwlock_handle rwlock1)
 {
-    semaphore_release(rwlock1->W_guard);
-
-    semaphore_take(rwlock1->C_guard, 1);
-    rwlock1->writing_writer -= 1;
-    rwlock1->active_writer -= 1;
-    if(rwlock1->active_writer == 0){
-        while(rwlock1->reading_reader < rwlock1->active_reader){
-            rwlock1->reading_reader += 1;
-            semaphore_release(rwlock1->read);
-        }
+    if (atomic_cmpxchg(RWWriter, 0, &(rwlock1->state)) == RWWriter) {
+        return;
     }
-    semaphore_release(rwlock1->C_guard);
+
+    uint32_t xre = xEnterCritical();
+    RWLockHandOver(rwlock1);
+    xExitCritical(xre);
 }
 
 void rwlock_delete(rwlock_handle rwlock1)
@@ -37,6 +37,7 @@ Class(Queue_struct)
     uint8_t *readPoint;
     uint8_t *writePoint;
     uint8_t MessageNumber;
+    uint8_t Reserved;               //slots freed for woken senders that have not written yet
     TheList SendList;
     TheList ReceiveList;
     uint32_t NodeSize;
@@ -57,6 +58,7 @@ Queue_struct* queue_creat(uint32_t queue_length,uint32_t queue_size)
             .readPoint  = (uint8_t *)( message_start + ( queue_length - 1) * queue_size ),
             .writePoint = message_start,
             .MessageNumber = 0UL,
+            .Reserved = 0,
             .NodeNumber  = queue_length,
             .NodeSize   = queue_size,
     };
@@ -77,7 +79,16 @@ void queue_delete( Queue_struct *queue )
 #define  GetTopTCBIndex    FindHighestPriority
 extern uint8_t schedule_PendSV;
 
-void WriteToQueue( Queue_struct *queue , uint32_t *buf, uint8_t CurrentTcbPriority)
+//slots kept for woken senders count as used
+static inline uint8_t QueueFull(Queue_struct *queue)
+{
+    return (queue->MessageNumber + queue->Reserved) >= queue->NodeNumber;
+}
+
+/*
+ * woken is set when the woken receiver outranks the current task.
+ */
+void WriteToQueue( Queue_struct *queue , uint32_t *buf, uint8_t *woken)
 {
     memcpy((void *) queue->writePoint, buf, (size_t) queue->NodeSize);
     queue->writePoint += queue->NodeSize;
@@ -92,8 +103,8 @@ void WriteToQueue( Queue_struct *queue , uint32_t *buf, uint8_t CurrentTcbPriori
         DelayListRemove(ReceiveTask);
         Remove_IPC(ReceiveTask);
         TaskListAdd(ReceiveTask,Ready);
-        if(GetTaskPriority(ReceiveTask) > CurrentTcbPriority){
-            schedule();
+        if(GetTaskPriority(ReceiveTask) > GetTaskPriority(GetCurrentTCB())){
+            *woken = true;
         }
     }
     (queue->MessageNumber)++;
@@ -113,6 +124,7 @@ void ExtractFromQueue( Queue_struct *queue, uint32_t *buf, uint8_t CurrentTcbPri
         DelayListRemove(SendTask);
         Remove_IPC(SendTask);
         TaskListAdd(SendTask,Ready);
+        (queue->Reserved)++;//the freed slot is kept for the woken sender
         if(GetTaskPriority(SendTask) > CurrentTcbPriority ){
             schedule();
         }
@@ -127,21 +139,20 @@ uint8_t queue_send(Queue_struct *queue, uint32_t *buf, uint32_t Ticks)
 {
     uint32_t xre = xEnterCritical();
     TaskHandle_t CurrentTCB = GetCurrentTCB();
-    uint8_t CurrentTcbPriority = GetTaskPriority(CurrentTCB);
+    uint8_t woken = false;
 
-    if (queue->MessageNumber < queue->NodeNumber) {
+    if (!QueueFull(queue)) {
         //normally write
-        WriteToQueue(queue, buf, CurrentTcbPriority);
+        WriteToQueue(queue, buf, &woken);
+        if (woken) {
+            schedule();
+        }
         xExitCritical(xre);
         return true;
     } //Block!
 
-    if (queue->MessageNumber == queue->NodeNumber) {
-        if (Ticks == 0) {
-            xExitCritical(xre);
-            return false;
-        }
-    }else{
+    if (Ticks == 0) {
+        xExitCritical(xre);
         return false;
     }
 
@@ -161,7 +172,12 @@ uint8_t queue_send(Queue_struct *queue, uint32_t *buf, uint32_t Ticks)
         xExitCritical(xReturn);
         return false;
     }else{
-        WriteToQueue(queue, buf, CurrentTcbPriority);
+        //ExtractFromQueue kept a slot for this task, interrupts could not take it
+        (queue->Reserved)--;
+        WriteToQueue(queue, buf, &woken);
+        if (woken) {
+            schedule();
+        }
         xExitCritical(xReturn);
         return true;
     }
@@ -209,4 +225,21 @@ uint8_t queue_receive( Queue_struct *queue, uint32_t *buf, uint32_t Ticks )
 }
 
 
+/*
+ * For interrupts: never blocks and never schedules, false means the queue is full.
+ * woken collects whether a higher priority task was made ready,
+ * pass it to schedule_from_isr at the end of the handler.
+ */
+uint8_t queue_send_from_isr(Queue_struct *queue, uint32_t *buf, uint8_t *woken)
+{
+    uint32_t xre = xEnterCritical();
+    if (QueueFull(queue)) {
+        xExitCritical(xre);
+        return false;
+    }
+
+    WriteToQueue(queue, buf, woken);
+    xExitCritical(xre);
+    return true;
+}
 
@@ -26,13 +26,22 @@
 #include "mutex.h"
 #include "heap.h"
 #include "port.h"
+#include "atomic.h"
+
+/*
+ * lock holds the owner TCB, 0 when the mutex is free.
+ * MutexContended means the owner may have inherited a priority and unlock must go
+ * through the critical section; it is set by the slow paths and only cleared by unlock.
+ * An uncontended lock/unlock is a single ldrex/strex each.
+ */
+#define MutexContended    1UL //TCBs are word aligned, bit 0 of the owner is free
+#define MutexOwner(lock)  ((TaskHandle_t)((lock) & ~MutexContended))
 
 Class(Mutex_struct)
 {
-    uint8_t        value;
+    uint32_t       lock;
     uint32_t       original_priority;
     TheList        WaitList;
-    TaskHandle_t   owner;
 };
 
 
@@ -41,9 +50,8 @@ Mutex_Handle mutex_creat(void)
 {
     Mutex_struct *mutex = heap_malloc(sizeof (Mutex_struct) );
     *mutex = (Mutex_struct){
-            .value = 1,
-            .original_priority = 0UL,
-            .owner = NULL
+            .lock = 0,
+            .original_priority = 0UL
     };
     ListInit(&(mutex->WaitList));
     return mutex;
@@ -63,30 +71,36 @@ extern uint8_t schedule_PendSV;
 
 uint8_t mutex_lock(Mutex_Handle mutex,uint32_t Ticks)
 {
-    uint32_t xre = xEnterCritical();
     TaskHandle_t CurrentTCB = GetCurrentTCB();
+    if (atomic_cmpxchg(0, (uint32_t)CurrentTCB, &(mutex->lock)) == 0) {
+        return true;
+    }
+
+    uint32_t xre = xEnterCritical();
     uint8_t CurrentTcbPriority = GetTaskPriority(CurrentTCB);
-    if( mutex->value > 0) {
-        mutex->original_priority = CurrentTcbPriority;
-        mutex->owner = CurrentTCB;
-        (mutex->value)--;
+    if( mutex->lock == 0) {
+        mutex->lock = (uint32_t)CurrentTCB;
         xExitCritical(xre);
         return true;
     }
 
     if(Ticks == 0 ){
+        xExitCritical(xre);
         return false;
     }
 
     uint8_t volatile temp = schedule_PendSV;
 
-    if(Ticks > 0){
-        Insert_IPC(CurrentTCB, &(mutex->WaitList));
-        TaskDelay(Ticks);
-        uint8_t MutexOwnerPriority = GetTaskPriority(mutex->owner);
-        if( MutexOwnerPriority < CurrentTcbPriority) {
-            TaskPrioritySet(mutex->owner, CurrentTcbPriority);
-        }
+    TaskHandle_t owner = MutexOwner(mutex->lock);
+    if (!(mutex->lock & MutexContended)) {
+        mutex->original_priority = GetTaskPriority(owner);
+        mutex->lock |= MutexContended;
+    }
+    Insert_IPC(CurrentTCB, &(mutex->WaitList));
+    TaskDelay(Ticks);
+    uint8_t MutexOwnerPriority = GetTaskPriority(owner);
+    if( MutexOwnerPriority < CurrentTcbPriority) {
+        TaskPrioritySet(owner, CurrentTcbPriority);
     }
     xExitCritical(xre);
 
@@ -99,9 +113,7 @@ uint8_t mutex_lock(Mutex_Handle mutex,uint32_t Ticks)
         xExitCritical(xReturn);
         return false;
     }else{
-        mutex->original_priority = CurrentTcbPriority;
-        mutex->owner = CurrentTCB;
-        (mutex->value)--;
+        //mutex_unlock has handed the mutex over to this task.
         xExitCritical(xReturn);
         return true;
     }
@@ -110,27 +122,36 @@ uint8_t mutex_lock(Mutex_Handle mutex,uint32_t Ticks)
 
 uint8_t mutex_unlock( Mutex_Handle mutex)
 {
-    uint32_t xre = xEnterCritical();
     TaskHandle_t CurrentTCB = GetCurrentTCB();
-    uint8_t owner_priority = GetTaskPriority(mutex->owner);
-    uint8_t CurrentTcbPriority = GetTaskPriority(CurrentTCB);
+    if (atomic_cmpxchg((uint32_t)CurrentTCB, 0, &(mutex->lock)) == (uint32_t)CurrentTCB) {
+        return true;
+    }
+
+    uint32_t xre = xEnterCritical();
+    TaskHandle_t owner = MutexOwner(mutex->lock);
+    uint8_t OwnerNewPriority = mutex->original_priority;
+
+    if(GetTaskPriority(owner) != OwnerNewPriority) {
+        TaskPrioritySet(owner, OwnerNewPriority);
+    }
+    mutex->lock = 0;
 
     if (mutex->WaitList.count != 0) {
         TaskHandle_t WaitTask = IPCHighestPriorityTask(&(mutex->WaitList));
         DelayListRemove(WaitTask);
         Remove_IPC(WaitTask);
         TaskListAdd(WaitTask,Ready);
-        if(GetTaskPriority(WaitTask) > CurrentTcbPriority ){
+        //hand over, the mutex is never free in between
+        mutex->lock = (uint32_t)WaitTask;
+        if (mutex->WaitList.count != 0) {
+            mutex->original_priority = GetTaskPriority(WaitTask);
+            mutex->lock |= MutexContended;
+        }
+        if(GetTaskPriority(WaitTask) > OwnerNewPriority ){
             schedule();
         }
     }
 
-    if(owner_priority != mutex->original_priority) {
-        TaskPrioritySet(mutex->owner, mutex->original_priority);
-    }
-
-    (mutex->value)++;
-
     xExitCritical(xre);
     return true;
 }
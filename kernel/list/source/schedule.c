@@ -28,6 +28,7 @@
 #include "schedule.h"
 #include "heap.h"
 #include "port.h"
+#include "trace.h"
 
 
 Class(TCB_t)
@@ -39,6 +40,12 @@ Class(TCB_t)
     uint8_t uxPriority;
     uint32_t * pxStack;
     uint8_t TimeSlice;
+    uint8_t Origin;
+#if configRunTimeStats
+    uint64_t RunTime;
+    uint64_t LastRunTime;
+    struct TCB_t *StatsNext;
+#endif
 };
 
 __attribute__( ( used ) )  TaskHandle_t volatile schedule_currentTCB = NULL;
@@ -72,7 +79,7 @@ TheList TwoDelayList;
 TheList *WakeTicksList;
 TheList *OverWakeTicksList;
 
-static volatile uint32_t NowTickCount = ( uint32_t ) 0;
+volatile uint32_t NowTickCount = ( uint32_t ) 0;
 
 TheList SuspendList;
 TheList BlockList;
@@ -124,6 +131,7 @@ void TaskListAdd(TaskHandle_t self, uint8_t State)
             SuspendListAdd
     };
     ListAdd[State](node);
+    trace_state(self, (State == Ready) ? TraceReady : TraceSuspend, self->uxPriority);
     xExitCritical(xReturn);
 }
 
@@ -145,14 +153,46 @@ void Insert_IPC(TaskHandle_t self,TheList *IPC_list)
 {
     self->IPC_node.value = self->uxPriority;
     ListAdd( IPC_list , &(self->IPC_node));
+    trace_ipc_wait(self, IPC_list);
 }
 
 
 void Remove_IPC(TaskHandle_t self)
 {
+    trace_ipc_wake(self, self->IPC_node.TheList);
     ListRemove( self->IPC_node.TheList , &(self->IPC_node));
 }
 
+/*
+ * Used by the mutex priority inheritance, a ready task moves to the list of its new priority
+ * and a waiting task is re-sorted in the IPC list it waits on.
+ */
+uint8_t TaskPrioritySet(TaskHandle_t taskHandle,uint8_t priority)
+{
+    uint32_t xReturn = xEnterCritical();
+    uint8_t OldPriority = taskHandle->uxPriority;
+    TheList *IPC_list = taskHandle->IPC_node.TheList;
+
+    if (OldPriority != priority) {
+        if (taskHandle->task_node.TheList == &(ReadyListArray[OldPriority])) {
+            ReadyListRemove(&(taskHandle->task_node));
+            taskHandle->uxPriority = priority;
+            ReadyListAdd(&(taskHandle->task_node));
+            schedule();
+        } else {
+            taskHandle->uxPriority = priority;
+        }
+
+        if (IPC_list != NULL) {//re-sort only, not a wake and wait
+            ListRemove(IPC_list, &(taskHandle->IPC_node));
+            taskHandle->IPC_node.value = priority;
+            ListAdd(IPC_list, &(taskHandle->IPC_node));
+        }
+    }
+    xExitCritical(xReturn);
+    return OldPriority;
+}
+
 static uint8_t ListHighestPriorityTask(void)
 {
     uint8_t i = configMaxPriority - 1;
@@ -186,9 +226,41 @@ __attribute__((always_inline)) inline uint8_t CheckTaskState( TaskHandle_t taskH
 }
 
 
+#if configRunTimeStats
+static TCB_t *StatsList = NULL;
+static uint32_t SwitchStamp = 0;
+static uint64_t TotalTime = 0;
+static uint64_t SnapshotTime = 0;
+#endif
+
+/*
+ * Charge the cycles since the last switch to the task leaving the CPU.
+ * The 32-bit difference is right as long as a task keeps the CPU for less than 2^32 cycles.
+ */
+static inline void RunTimeAccount(void)
+{
+#if configRunTimeStats
+    uint32_t now = CycleCounterGet();
+    uint32_t elapsed = now - SwitchStamp;
+    SwitchStamp = now;
+    TotalTime += elapsed;
+    if (schedule_currentTCB != NULL) {
+        schedule_currentTCB->RunTime += elapsed;
+    }
+#endif
+}
+
+#define FromHeap    0   //where the TCB and the stack come from, TaskRelease gives them back there
+#define FromPool    1
+#define FromCaller  2
+
+static TCB_t *PendingRelease = NULL;    //a pooled or static task that deleted itself, released once it is switched out
+static void TaskRelease(TCB_t *self);
+
 uint8_t volatile schedule_PendSV = 0;
 void TaskSwitchContext(void)
 {
+    RunTimeAccount();
     uint8_t Index= ListHighestPriorityTask();
     TheList *TopPrioritiesList = &(ReadyListArray[Index]);
     if( TopPrioritiesList->SwitchFlag > 0) {
@@ -200,6 +272,11 @@ void TaskSwitchContext(void)
 
     schedule_PendSV++;
     schedule_currentTCB = container_of(TopPrioritiesList->SaveNode,TCB_t ,task_node);
+    if (PendingRelease != NULL) {
+        TaskRelease(PendingRelease);
+        PendingRelease = NULL;
+    }
+    trace_switch(schedule_currentTCB, schedule_currentTCB->uxPriority);
 }
 
 
@@ -221,39 +298,160 @@ void RecordWakeTime(uint16_t ticks)
 void TaskDelay( uint16_t ticks )
 {
     TaskListRemove(schedule_currentTCB,Ready);
+    trace_state(schedule_currentTCB, TraceDelay, schedule_currentTCB->uxPriority);
     RecordWakeTime(ticks);
     schedule();
 }
 
 
-void TaskCreate( TaskFunction_t pxTaskCode,
-                  const uint16_t usStackDepth,
-                  void * const pvParameters,//You can use it for debugging
-                  uint32_t uxPriority,
-                  TaskHandle_t * const self,
-                  uint8_t TimeSlice)
+#if configTaskPool
+/*
+ * Static task pool: TCBs and stacks in three size classes, handed out and given back
+ * in O(1) through stacks of free slots, so a pooled task never touches the heap.
+ */
+static const uint16_t PoolDepth[3] = {configTaskPoolStack0, configTaskPoolStack1, configTaskPoolStack2};
+static TCB_t PoolTcb[configTaskPoolSize];
+static uint32_t PoolStack0[configTaskPoolSize * configTaskPoolStack0] __attribute__((aligned(8)));
+static uint32_t PoolStack1[configTaskPoolSize * configTaskPoolStack1] __attribute__((aligned(8)));
+static uint32_t PoolStack2[configTaskPoolSize * configTaskPoolStack2] __attribute__((aligned(8)));
+static uint32_t *const PoolStack[3] = {PoolStack0, PoolStack1, PoolStack2};
+static uint8_t PoolTcbFree[configTaskPoolSize];
+static uint8_t PoolStackFree[3][configTaskPoolSize];
+static uint8_t PoolTcbCount = 0;
+static uint8_t PoolStackCount[3] = {0, 0, 0};
+
+static void TaskPoolInit(void)
+{
+    for (uint8_t i = 0; i < configTaskPoolSize; i++) {
+        PoolTcbFree[i] = i;
+        for (uint8_t c = 0; c < 3; c++) {
+            PoolStackFree[c][i] = i;
+        }
+    }
+    PoolTcbCount = configTaskPoolSize;
+    for (uint8_t c = 0; c < 3; c++) {
+        PoolStackCount[c] = configTaskPoolSize;
+    }
+}
+
+//a TCB and the smallest free stack that fits, NULL when the pool can't serve the task
+static TCB_t *TaskPoolTake(uint16_t usStackDepth, uint32_t **pxStack)
+{
+    TCB_t *NewTcb = NULL;
+    uint32_t xre = xEnterCritical();
+    for (uint8_t c = 0; (c < 3) && (PoolTcbCount != 0); c++) {
+        if ((usStackDepth <= PoolDepth[c]) && (PoolStackCount[c] != 0)) {
+            *pxStack = PoolStack[c] + PoolStackFree[c][--PoolStackCount[c]] * PoolDepth[c];
+            NewTcb = &PoolTcb[PoolTcbFree[--PoolTcbCount]];
+            break;
+        }
+    }
+    xExitCritical(xre);
+    return NewTcb;
+}
+
+static void TaskPoolGive(TCB_t *self)
+{
+    uint32_t xre = xEnterCritical();
+    for (uint8_t c = 0; c < 3; c++) {
+        if ((self->pxStack >= PoolStack[c]) &&
+            (self->pxStack < PoolStack[c] + configTaskPoolSize * PoolDepth[c])) {
+            PoolStackFree[c][PoolStackCount[c]++] = (uint8_t)((self->pxStack - PoolStack[c]) / PoolDepth[c]);
+            break;
+        }
+    }
+    PoolTcbFree[PoolTcbCount++] = (uint8_t)(self - PoolTcb);
+    xExitCritical(xre);
+}
+#endif
+
+static void TaskInit( TCB_t *NewTcb,
+                      uint32_t *pxStack,
+                      uint8_t Origin,
+                      TaskFunction_t pxTaskCode,
+                      const uint16_t usStackDepth,
+                      void * const pvParameters,
+                      uint32_t uxPriority,
+                      TaskHandle_t * const self,
+                      uint8_t TimeSlice)
 {
     uint32_t *topStack = NULL;
-    uint32_t *pxStack = ( uint32_t *) heap_malloc( ( ( ( size_t ) usStackDepth ) * sizeof( uint32_t * ) ) );
-    TCB_t *NewTcb = (TCB_t *)heap_malloc(sizeof(TCB_t));
     memset( ( void * ) NewTcb, 0x00, sizeof( TCB_t ) );
     *self = ( TCB_t *) NewTcb;
     *NewTcb = (TCB_t){
         .state = Ready,
         .uxPriority = uxPriority,
         .TimeSlice = TimeSlice,
+        .Origin = Origin,
         .pxStack = pxStack
     };
     topStack =  NewTcb->pxStack + (usStackDepth - (uint32_t)1) ;
     topStack = ( uint32_t *) (((uint32_t)topStack) & (~((uint32_t) alignment_byte)));
     NewTcb->pxTopOfStack = pxPortInitialiseStack(topStack,pxTaskCode,pvParameters);
     TaskListAdd(NewTcb, Ready);
+#if configRunTimeStats
+    uint32_t xre = xEnterCritical();
+    NewTcb->StatsNext = StatsList;
+    StatsList = NewTcb;
+    xExitCritical(xre);
+#endif
 }
 
+void TaskCreate( TaskFunction_t pxTaskCode,
+                  const uint16_t usStackDepth,
+                  void * const pvParameters,//You can use it for debugging
+                  uint32_t uxPriority,
+                  TaskHandle_t * const self,
+                  uint8_t TimeSlice)
+{
+    uint32_t *pxStack = NULL;
+    TCB_t *NewTcb = NULL;
+#if configTaskPool
+    NewTcb = TaskPoolTake(usStackDepth, &pxStack);
+    if (NewTcb != NULL) {
+        TaskInit(NewTcb, pxStack, FromPool, pxTaskCode, usStackDepth, pvParameters, uxPriority, self, TimeSlice);
+        return;
+    }
+#endif
+    pxStack = ( uint32_t *) heap_malloc( ( ( ( size_t ) usStackDepth ) * sizeof( uint32_t * ) ) );
+    NewTcb = (TCB_t *)heap_malloc(sizeof(TCB_t));
+    TaskInit(NewTcb, pxStack, FromHeap, pxTaskCode, usStackDepth, pvParameters, uxPriority, self, TimeSlice);
+}
+
+_Static_assert(sizeof(TaskStatic_t) >= sizeof(TCB_t), "TaskStatic_t must hold a TCB_t");
+
+/*
+ * TaskCreate on memory the caller owns: the TCB goes in tcb, the stack is usStackDepth words at stack.
+ * Nothing is allocated or freed, the memory can be reused once the task is deleted.
+ */
+void TaskCreateStatic( TaskFunction_t pxTaskCode,
+                       const uint16_t usStackDepth,
+                       void * const pvParameters,
+                       uint32_t uxPriority,
+                       TaskHandle_t * const self,
+                       uint8_t TimeSlice,
+                       TaskStatic_t *tcb,
+                       uint32_t *stack)
+{
+    TaskInit((TCB_t *)tcb, stack, FromCaller, pxTaskCode, usStackDepth, pvParameters, uxPriority, self, TimeSlice);
+}
+
+/*
+ * Heap tasks are freed by the leisureTask, pooled and static ones are given back at once,
+ * or at the next switch when a task deletes itself.
+ */
 void TaskDelete(TaskHandle_t self)
 {
+    uint32_t xre = xEnterCritical();
     TaskListRemove(self, Ready);
-    ListAdd(&DeleteList, &self->task_node);
+    if (self->Origin == FromHeap) {
+        ListAdd(&DeleteList, &self->task_node);
+    } else if (self == schedule_currentTCB) {
+        PendingRelease = self;
+    } else {
+        TaskRelease(self);
+    }
+    xExitCritical(xre);
     schedule();
 }
 
@@ -267,13 +465,35 @@ void ListDelayInit(void)
 }
 
 
+static void TaskRelease(TCB_t *self)
+{
+#if configRunTimeStats
+    uint32_t xre = xEnterCritical();
+    TCB_t **link = &StatsList;
+    while (*link != self) {
+        link = &((*link)->StatsNext);
+    }
+    *link = self->StatsNext;
+    xExitCritical(xre);
+#endif
+    PortTaskFree((uint32_t *)self->pxTopOfStack);
+    if (self->Origin == FromHeap) {
+        heap_free((void *)self->pxStack);
+        heap_free((void *)self);
+    }
+#if configTaskPool
+    else if (self->Origin == FromPool) {
+        TaskPoolGive(self);
+    }
+#endif
+}
+
 void TaskFree(void)
 {
     if (DeleteList.count != 0) {
         TaskHandle_t self = container_of(DeleteList.head, TCB_t, task_node);
         ListRemove(&DeleteList, &self->task_node);
-        heap_free((void *)self->pxStack);
-        heap_free((void *)self);
+        TaskRelease(self);
     }
 }
 
@@ -284,6 +504,8 @@ void leisureTask( void )
 {//leisureTask content can be manually modified as needed
     while (1) {
         TaskFree();
+        //DeleteList.count changes under this loop
+        __asm volatile("" ::: "memory");
     }
 }
 
@@ -301,8 +523,17 @@ void LeisureTaskCreat(void)
 
 void SchedulerInit(void)
 {
+#if configRunTimeStats
+    CycleCounterInit();
+#endif
+#if configTraceEnable
+    TraceInit();
+#endif
     ADTListInit();
     ListDelayInit();
+#if configTaskPool
+    TaskPoolInit();
+#endif
     LeisureTaskCreat();
 }
 
@@ -339,3 +570,39 @@ void CheckTicks(void)
 
     schedule();
 }
+
+
+#if configRunTimeStats
+/*
+ * top-style snapshot: fills at most max entries, usage is the share of the CPU
+ * each task had since the previous snapshot, idle is the share of the leisureTask.
+ */
+uint8_t TaskStatsSnapshot(TaskStats *stats, uint8_t max, uint16_t *idle)
+{
+    uint8_t n = 0;
+    uint32_t xre = xEnterCritical();
+    RunTimeAccount();
+    uint64_t window = TotalTime - SnapshotTime;
+    SnapshotTime = TotalTime;
+
+    for (TCB_t *task = StatsList; task != NULL; task = task->StatsNext) {
+        uint64_t ran = task->RunTime - task->LastRunTime;
+        uint16_t usage = window ? (uint16_t)((ran * 10000) / window) : 0;
+        task->LastRunTime = task->RunTime;
+        if ((task == leisureTcb) && (idle != NULL)) {
+            *idle = usage;
+        }
+        if (n < max) {
+            stats[n++] = (TaskStats){
+                    .task = task,
+                    .priority = task->uxPriority,
+                    .RunTime = task->RunTime,
+                    .usage = usage
+            };
+        }
+    }
+    xExitCritical(xre);
+    return n;
+}
+#endif
+
@@ -41,7 +41,7 @@ Class(timer_struct)
 
 TheList ClockList;
 static uint16_t TimerCheckPeriod = 0;
-extern uint32_t NowTickCount;
+extern volatile uint32_t NowTickCount;
 
 void ClockListAdd(timer_struct *timer)
 {
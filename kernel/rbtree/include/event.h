@@ -0,0 +1,45 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 skaiui2
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *  https://github.com/skaiui2/SKRTOS_sparrow
+ */
+
+#ifndef EVENT_H
+#define EVENT_H
+#include "schedule.h"
+
+#define EventWaitAny      0
+#define EventWaitAll      (1 << 0)   //wake only when every requested bit is set
+#define EventClearOnExit  (1 << 1)   //clear the requested bits when the wait is satisfied
+
+typedef struct Event_struct *Event_Handle;
+
+Event_Handle event_creat(void);
+void event_delete(Event_Handle event);
+uint32_t event_set(Event_Handle event, uint32_t bits);
+uint32_t event_set_from_isr(Event_Handle event, uint32_t bits, uint8_t *woken);
+uint32_t event_clear(Event_Handle event, uint32_t bits);
+uint32_t event_get(Event_Handle event);
+uint32_t event_wait(Event_Handle event, uint32_t bits, uint8_t option, uint32_t Ticks);
+
+
+#endif
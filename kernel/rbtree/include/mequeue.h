@@ -26,13 +26,17 @@
 #ifndef MEQUEUE_H
 #define MEQUEUE_H
 #include "schedule.h"
+#include "event.h"
 
 typedef struct Queue_struct *Queue_Handle;
 
 Queue_Handle queue_creat(uint32_t queue_length,uint32_t queue_size);
 void queue_delete( Queue_Handle queue );
 uint8_t queue_send(Queue_Handle queue, uint32_t *buf, uint32_t Ticks);
+uint8_t queue_send_defer(Queue_Handle queue, uint32_t *buf);
+uint8_t queue_send_from_isr(Queue_Handle queue, uint32_t *buf, uint8_t *woken);
 uint8_t queue_receive( Queue_Handle queue, uint32_t *buf, uint32_t Ticks );
+void queue_bind(Queue_Handle queue, Event_Handle event, uint32_t bits);
 
 
 #endif
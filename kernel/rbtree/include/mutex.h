@@ -32,6 +32,7 @@
 typedef struct Mutex_struct *Mutex_Handle;
 
 Mutex_Handle mutex_creat(void);
+Mutex_Handle mutex_ceiling_creat(uint8_t ceiling);
 void mutex_delete(Mutex_Handle mutex);
 uint8_t mutex_lock(Mutex_Handle mutex,uint32_t Ticks);
 uint8_t mutex_unlock( Mutex_Handle mutex);
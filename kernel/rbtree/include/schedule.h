@@ -50,9 +50,22 @@
 #define configTickRateHz			( ( uint32_t ) 1000 )
 
 #define alignment_byte               0x07
+#ifndef config_heap    //the host build (bench/) sets a bigger one
 #define config_heap   (14*1024)
+#endif
 #define configMaxPriority 32
 #define configShieldInterPriority 191
+#define configMutexChainDepth 8     //the longest owner->mutex->owner chain priority inheritance walks
+#define configTimerWheel   1     //1: timers run on the timing wheel driven by CheckTicks, 0: the polling timer task
+#define configDeferRingSize 32     //deferred work slots, a power of 2
+#define configTraceEnable  0     //1: record scheduling events into the trace ring buffer, see kernel/trace
+#define configRunTimeStats  0    //1: charge the cycles between two switches to the task that ran, see TaskStatsSnapshot
+#define configTimeSlice    0     //ticks a new task runs before yielding to its equal priorities, 0: it runs until it blocks
+#define configTaskPool     0     //1: TaskCreate takes the TCB and stack from static pools before the heap
+#define configTaskPoolSize 8     //pooled TCBs, and pooled stacks of each size class
+#define configTaskPoolStack0 128 //stack size classes in words, smallest first
+#define configTaskPoolStack1 256
+#define configTaskPoolStack2 512
 
 
 
@@ -61,14 +74,28 @@ void TaskDelay( uint16_t ticks );
 typedef void (* TaskFunction_t)( void * );
 typedef  struct TCB_t         *TaskHandle_t;
 
+//memory for the TCB of TaskCreateStatic, the layout is private to schedule.c
+Class(TaskStatic_t)
+{
+    uint64_t space[26];
+};
+
 void TaskCreate( TaskFunction_t pxTaskCode,
                   uint16_t usStackDepth,
                   void *pvParameters,
                   uint32_t uxPriority,
                   TaskHandle_t *self );
+void TaskCreateStatic( TaskFunction_t pxTaskCode,
+                  uint16_t usStackDepth,
+                  void *pvParameters,
+                  uint32_t uxPriority,
+                  TaskHandle_t *self,
+                  TaskStatic_t *tcb,
+                  uint32_t *stack );
 void TaskDelete(TaskHandle_t self);
 
 uint8_t TaskPrioritySet(TaskHandle_t taskHandle,uint8_t priority);
+void TaskTimeSliceSet(TaskHandle_t taskHandle, uint8_t ticks);
 
 void TaskTreeAdd(TaskHandle_t self, uint8_t State);
 void TaskTreeRemove(TaskHandle_t self, uint8_t State);
@@ -87,8 +114,26 @@ uint8_t CheckTaskState( TaskHandle_t taskHandle, uint8_t State);
 TaskHandle_t GetCurrentTCB(void);
 TaskHandle_t TaskHighestPriority(rb_root_handle root);
 TaskHandle_t IPCHighestPriorityTask(rb_root_handle root);
+TaskHandle_t IPCNextTask(TaskHandle_t taskHandle);
 uint8_t GetTaskPriority(TaskHandle_t taskHandle);
+uint8_t GetTaskOriginalPriority(TaskHandle_t taskHandle);
+
+rb_root_handle TaskHoldTree(TaskHandle_t taskHandle);
+void TaskWaitMutexSet(TaskHandle_t taskHandle, void *mutex);
+void *TaskWaitMutexGet(TaskHandle_t taskHandle);
+void TaskIPCMessageSet(TaskHandle_t taskHandle, void *message);
+void *TaskIPCMessageGet(TaskHandle_t taskHandle);
+
+
+Class(TaskStats)
+{
+    TaskHandle_t task;
+    uint8_t priority;
+    uint64_t RunTime;       //cycles run since the scheduler started
+    uint16_t usage;         //share of the CPU since the previous snapshot, in 0.01%
+};
 
+uint8_t TaskStatsSnapshot(TaskStats *stats, uint8_t max, uint16_t *idle);
 
 
 
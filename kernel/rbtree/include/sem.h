@@ -27,6 +27,7 @@
 #define SEM_H
 
 #include <stdint.h>
+#include "event.h"
 
 
 typedef struct Semaphore_struct *Semaphore_Handle;
@@ -34,7 +35,10 @@ typedef struct Semaphore_struct *Semaphore_Handle;
 Semaphore_Handle semaphore_creat(uint8_t value);
 void semaphore_delete(Semaphore_Handle semaphore);
 uint8_t semaphore_release( Semaphore_Handle semaphore);
+uint8_t semaphore_release_defer( Semaphore_Handle semaphore);
+uint8_t semaphore_release_from_isr( Semaphore_Handle semaphore, uint8_t *woken);
 uint8_t semaphore_take(Semaphore_Handle semaphore,uint32_t Ticks);
+void semaphore_bind(Semaphore_Handle semaphore, Event_Handle event, uint32_t bits);
 
 
 
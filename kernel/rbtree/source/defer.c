@@ -0,0 +1,168 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 skaiui2
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *  https://github.com/skaiui2/SKRTOS_sparrow
+ */
+
+#include "defer.h"
+#include "atomic.h"
+#include "port.h"
+
+/*
+ * Deferred work, so interrupts only record what has to be done.
+ * Interrupts are the producers: they claim a slot of the ring with ldrex/strex
+ * and publish it by writing func last. The worker task is the only consumer,
+ * it sleeps while the ring is empty and is woken by the first post.
+ */
+Class(DeferEntry)
+{
+    DeferFunction_t volatile func;
+    void *arg;
+};
+
+static DeferEntry DeferRing[configDeferRingSize];
+static uint32_t DeferHead = 0;   //next slot to claim, moved by the producers
+static uint32_t volatile DeferTail = 0;   //next slot to run, moved by the worker only, read by the producers
+static uint8_t volatile DeferSleep = 0;
+static TaskHandle_t DeferTask = NULL;
+
+
+//orders the accesses to a slot between the producers and the worker
+static inline void DeferBarrier(void)
+{
+#if defined(__arm__) || defined(__thumb__)
+    __asm volatile ("dmb" ::: "memory");
+#else
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+#endif
+}
+
+
+/*
+ * Safe to call from interrupts, returns false if the ring is full.
+ */
+uint8_t defer_call(DeferFunction_t func, void *arg)
+{
+    uint32_t head = DeferHead;
+    while (1) {
+        if (head - DeferTail >= configDeferRingSize) {
+            return false;
+        }
+        uint32_t prev = atomic_cmpxchg(head, head + 1, &DeferHead);
+        if (prev == head) {
+            break;
+        }
+        head = prev;
+    }
+
+    DeferEntry *entry = &DeferRing[head & (configDeferRingSize - 1)];
+    entry->arg = arg;
+    DeferBarrier();
+    entry->func = func;
+
+    if (DeferSleep) {
+        uint32_t xre = xEnterCritical();
+        if (DeferSleep) {
+            DeferSleep = 0;
+            TaskTreeAdd(DeferTask, Ready);
+            schedule();
+        }
+        xExitCritical(xre);
+    }
+    return true;
+}
+
+
+static void DeferWorkRun(void *arg)
+{
+    DeferWork *work = arg;
+    work->pending = 0;//a post from now on queues the work again
+    work->func(work->arg);
+}
+
+void defer_work_init(DeferWork *work, DeferFunction_t func, void *arg)
+{
+    *work = (DeferWork){
+            .func = func,
+            .arg = arg,
+            .pending = 0
+    };
+}
+
+/*
+ * Safe to call from interrupts. A work already waiting in the ring is not queued twice.
+ */
+uint8_t defer_work_post(DeferWork *work)
+{
+    if (atomic_cmpxchg(0, 1, &(work->pending)) != 0) {
+        return true;
+    }
+    if (!defer_call(DeferWorkRun, work)) {
+        work->pending = 0;
+        return false;
+    }
+    return true;
+}
+
+
+static void DeferWorker(void)
+{
+    while (1) {
+        DeferEntry *entry = &DeferRing[DeferTail & (configDeferRingSize - 1)];
+
+        uint32_t xre = xEnterCritical();
+        if (entry->func == NULL) {
+            DeferSleep = 1;
+            TaskTreeRemove(DeferTask, Ready);
+            schedule();
+            xExitCritical(xre);
+            continue;
+        }
+        xExitCritical(xre);
+
+        DeferFunction_t func = entry->func;
+        DeferBarrier();//arg is read after the func that published it
+        void *arg = entry->arg;
+        entry->func = NULL;
+        DeferBarrier();//the slot is empty before producers may claim it again
+        DeferTail++;
+        func(arg);
+    }
+}
+
+
+/*
+ * The worker should have the highest priority of the tasks it serves,
+ * so the deferred part runs right after the interrupt returns.
+ */
+TaskHandle_t DeferInit(uint8_t defer_priority, uint16_t stack)
+{
+    for (uint32_t i = 0; i < configDeferRingSize; i++) {
+        DeferRing[i].func = NULL;
+    }
+    TaskCreate((TaskFunction_t)DeferWorker,
+               stack,
+               NULL,
+               defer_priority,
+               &DeferTask);
+    return DeferTask;
+}
@@ -0,0 +1,191 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 skaiui2
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *  https://github.com/skaiui2/SKRTOS_sparrow
+ */
+
+#include "event.h"
+#include "heap.h"
+#include "port.h"
+
+Class(Event_struct)
+{
+    uint32_t bits;
+    rb_root WaitTree;
+};
+
+/*
+ * Lives on the stack of the waiting task while it is blocked,
+ * event_set fills result with the bits that woke the task.
+ */
+Class(EventWait_struct)
+{
+    uint32_t bits;
+    uint32_t result;
+    uint8_t option;
+};
+
+
+Event_Handle event_creat(void)
+{
+    Event_struct *event = heap_malloc(sizeof (Event_struct) );
+    event->bits = 0;
+    rb_root_init(&(event->WaitTree));
+    return event;
+}
+
+void event_delete(Event_Handle event)
+{
+    heap_free(event);
+}
+
+
+static uint32_t EventMatch(uint32_t bits, EventWait_struct *wait)
+{
+    uint32_t match = bits & wait->bits;
+    if (wait->option & EventWaitAll) {
+        return (match == wait->bits) ? match : 0;
+    }
+    return match;
+}
+
+
+extern uint8_t schedule_PendSV;
+
+/*
+ * Every waiter is checked, from the highest priority down.
+ * Bits cleared on exit are only dropped after the whole tree is walked,
+ * so all tasks waiting for the same bit are released by one event_set.
+ * The _from_isr form only reports through woken that a higher priority task is ready.
+ */
+uint32_t event_set_from_isr(Event_Handle event, uint32_t bits, uint8_t *woken)
+{
+    uint32_t xre = xEnterCritical();
+    uint8_t CurrentTcbPriority = GetTaskPriority(GetCurrentTCB());
+    uint32_t ClearBits = 0;
+
+    event->bits |= bits;
+
+    TaskHandle_t WaitTask = (event->WaitTree.count != 0) ? IPCHighestPriorityTask(&(event->WaitTree)) : NULL;
+    while (WaitTask != NULL) {
+        TaskHandle_t NextTask = IPCNextTask(WaitTask);
+        EventWait_struct *wait = TaskIPCMessageGet(WaitTask);
+        uint32_t match = EventMatch(event->bits, wait);
+
+        if (match) {
+            wait->result = match;
+            if (wait->option & EventClearOnExit) {
+                ClearBits |= wait->bits;
+            }
+            DelayTreeRemove(WaitTask);
+            Remove_IPC(WaitTask);
+            TaskTreeAdd(WaitTask, Ready);
+            if (GetTaskPriority(WaitTask) > CurrentTcbPriority) {
+                *woken = true;
+            }
+        }
+        WaitTask = NextTask;
+    }
+
+    event->bits &= ~ClearBits;
+    uint32_t result = event->bits;
+    xExitCritical(xre);
+    return result;
+}
+
+
+uint32_t event_set(Event_Handle event, uint32_t bits)
+{
+    uint8_t woken = false;
+    uint32_t result = event_set_from_isr(event, bits, &woken);
+    if (woken) {
+        schedule();
+    }
+    return result;
+}
+
+
+uint32_t event_clear(Event_Handle event, uint32_t bits)
+{
+    uint32_t xre = xEnterCritical();
+    uint32_t old = event->bits;
+    event->bits &= ~bits;
+    xExitCritical(xre);
+    return old;
+}
+
+
+uint32_t event_get(Event_Handle event)
+{
+    return event->bits;
+}
+
+
+/*
+ * Returns the bits that satisfied the wait, 0 on timeout.
+ */
+uint32_t event_wait(Event_Handle event, uint32_t bits, uint8_t option, uint32_t Ticks)
+{
+    EventWait_struct wait = {
+            .bits = bits,
+            .result = 0,
+            .option = option
+    };
+
+    uint32_t xre = xEnterCritical();
+    TaskHandle_t CurrentTCB = GetCurrentTCB();
+
+    uint32_t match = EventMatch(event->bits, &wait);
+    if (match) {
+        if (option & EventClearOnExit) {
+            event->bits &= ~bits;
+        }
+        xExitCritical(xre);
+        return match;
+    }
+
+    if (Ticks == 0) {
+        xExitCritical(xre);
+        return 0;
+    }
+
+    uint8_t volatile temp = schedule_PendSV;
+
+    TaskIPCMessageSet(CurrentTCB, &wait);
+    Insert_IPC(CurrentTCB, &(event->WaitTree));
+    TaskDelay(Ticks);
+    xExitCritical(xre);
+
+    while(temp == schedule_PendSV){ }//It loops until the schedule is start.
+
+    uint32_t xReturn = xEnterCritical();
+    TaskIPCMessageSet(CurrentTCB, NULL);
+    //Check whether the wake is due to delay or due to the event
+    if(!CheckIPCState(CurrentTCB)){//if true ,the task is Block!
+        Remove_IPC(CurrentTCB);
+        xExitCritical(xReturn);
+        return 0;
+    }
+    xExitCritical(xReturn);
+    return wait.result;
+}
+
@@ -28,6 +28,7 @@
 #include "heap.h"
 #include "port.h"
 #include "rbtree.h"
+#include "defer.h"
 
 
 Class(Queue_struct)
@@ -37,12 +38,18 @@ Class(Queue_struct)
     uint8_t *readPoint;
     uint8_t *writePoint;
     uint8_t MessageNumber;
+    uint8_t Reserved;               //slots freed for woken senders that have not written yet
     rb_root SendTree;
     rb_root ReceiveTree;
     uint32_t NodeSize;
     uint32_t NodeNumber;
+    Event_Handle event;
+    uint32_t EventBits;
+    DeferWork ReceiveWork;
 };
 
+static void QueueDeferWake(void *arg);
+
 
 
 Queue_struct* queue_creat(uint32_t queue_length,uint32_t queue_size)
@@ -57,12 +64,16 @@ Queue_struct* queue_creat(uint32_t queue_length,uint32_t queue_size)
             .readPoint  = (uint8_t *)( message_start + ( queue_length - 1) * queue_size ),
             .writePoint = message_start,
             .MessageNumber = 0UL,
+            .Reserved = 0,
             .NodeNumber  = queue_length,
             .NodeSize   = queue_size,
+            .event      = NULL,
+            .EventBits  = 0,
     };
 
     rb_root_init(&( queue->SendTree));
     rb_root_init(&(queue->ReceiveTree));
+    defer_work_init(&(queue->ReceiveWork), QueueDeferWake, queue);
     return queue;
 }
 
@@ -74,10 +85,41 @@ void queue_delete( Queue_struct *queue )
 }
 
 
+/*
+ * The event bits are set while the queue holds messages, so a task can
+ * event_wait on several queues and semaphores at once and then receive from the ready one.
+ */
+void queue_bind(Queue_struct *queue, Event_Handle event, uint32_t bits)
+{
+    uint32_t xre = xEnterCritical();
+    queue->event = event;
+    queue->EventBits = bits;
+    if (queue->MessageNumber > 0) {
+        event_set(event, bits);
+    }
+    xExitCritical(xre);
+}
+
+
 #define  GetTopTCBIndex    FindHighestPriority
 extern uint8_t schedule_PendSV;
 
-void WriteToQueue( Queue_struct *queue , uint32_t *buf, uint8_t CurrentTcbPriority)
+/*
+ * The message is already in the buffer of the blocked receiver, wake it up.
+ * woken is set when the receiver outranks the current task.
+ */
+static void HandToReceiver( TaskHandle_t ReceiveTask, uint8_t *woken)
+{
+    DelayTreeRemove(ReceiveTask);
+    Remove_IPC(ReceiveTask);
+    TaskIPCMessageSet(ReceiveTask, NULL);
+    TaskTreeAdd(ReceiveTask,Ready);
+    if(GetTaskPriority(ReceiveTask) > GetTaskPriority(GetCurrentTCB())){
+        *woken = true;
+    }
+}
+
+static void RingWrite( Queue_struct *queue , uint32_t *buf)
 {
     memcpy((void *) queue->writePoint, buf, (size_t) queue->NodeSize);
     queue->writePoint += queue->NodeSize;
@@ -85,40 +127,69 @@ void WriteToQueue( Queue_struct *queue , uint32_t *buf, uint8_t CurrentTcbPriori
     if (queue->writePoint >= queue->endPoint) {
         queue->writePoint = queue->startPoint;
     }
+}
+
+static void RingRead( Queue_struct *queue, uint32_t *buf)
+{
+    queue->readPoint += queue->NodeSize;
 
+    if( queue->readPoint >= queue->endPoint ){
+        queue->readPoint = queue->startPoint;
+    }
+    memcpy( ( void * ) buf, ( void * ) queue->readPoint, ( size_t ) queue->NodeSize );
+}
+
+//slots kept for woken senders count as used
+static inline uint8_t QueueFull(Queue_struct *queue)
+{
+    return (queue->MessageNumber + queue->Reserved) >= queue->NodeNumber;
+}
+
+/*
+ * The caller has checked that the ring has room.
+ */
+void WriteToQueue( Queue_struct *queue , uint32_t *buf, uint8_t *woken)
+{
     if (queue->ReceiveTree.count != 0) {
-        //Wake up the highest priority task in the receiving list
+        //Hand a message to the highest priority task in the receiving list
         TaskHandle_t ReceiveTask = IPCHighestPriorityTask(&(queue->ReceiveTree));
-        DelayTreeRemove(ReceiveTask);
-        Remove_IPC(ReceiveTask);
-        TaskTreeAdd(ReceiveTask,Ready);
-        if(GetTaskPriority(ReceiveTask) > CurrentTcbPriority){
-            schedule();
+        if (queue->MessageNumber == 0) {
+            memcpy(TaskIPCMessageGet(ReceiveTask), buf, (size_t) queue->NodeSize);
+        } else {
+            //messages from queue_send_defer are still in the ring, the receiver takes the oldest
+            RingWrite(queue, buf);
+            RingRead(queue, TaskIPCMessageGet(ReceiveTask));
         }
+        HandToReceiver(ReceiveTask, woken);
+        return;
     }
+
+    RingWrite(queue, buf);
     (queue->MessageNumber)++;
+    if (queue->event != NULL) {
+        event_set_from_isr(queue->event, queue->EventBits, woken);
+    }
 }
 
 void ExtractFromQueue( Queue_struct *queue, uint32_t *buf, uint8_t CurrentTcbPriority)
 {
-    queue->readPoint += queue->NodeSize;
-
-    if( queue->readPoint >= queue->endPoint ){
-        queue->readPoint = queue->startPoint;
-    }
-    memcpy( ( void * ) buf, ( void * ) queue->readPoint, ( size_t ) queue->NodeSize );
+    RingRead(queue, buf);
 
     if (queue->SendTree.count != 0) {
         TaskHandle_t SendTask = IPCHighestPriorityTask(&(queue->SendTree));
         DelayTreeRemove(SendTask);
         Remove_IPC(SendTask);
         TaskTreeAdd(SendTask,Ready);
+        (queue->Reserved)++;//the freed slot is kept for the woken sender
         if(GetTaskPriority(SendTask) > CurrentTcbPriority ){
             schedule();
         }
     }
 
     (queue->MessageNumber)--;
+    if ((queue->event != NULL) && (queue->MessageNumber == 0)) {
+        event_clear(queue->event, queue->EventBits);
+    }
 }
 
 
@@ -127,21 +198,20 @@ uint8_t queue_send(Queue_struct *queue, uint32_t *buf, uint32_t Ticks)
 {
     uint32_t xre = xEnterCritical();
     TaskHandle_t CurrentTCB = GetCurrentTCB();
-    uint8_t CurrentTcbPriority = GetTaskPriority(CurrentTCB);
+    uint8_t woken = false;
 
-    if (queue->MessageNumber < queue->NodeNumber) {
+    if (!QueueFull(queue)) {
         //normally write
-        WriteToQueue(queue, buf, CurrentTcbPriority);
+        WriteToQueue(queue, buf, &woken);
+        if (woken) {
+            schedule();
+        }
         xExitCritical(xre);
         return true;
     } //Block!
 
-    if (queue->MessageNumber == queue->NodeNumber) {
-        if (Ticks == 0) {
-            xExitCritical(xre);
-            return false;
-        }
-    }else{
+    if (Ticks == 0) {
+        xExitCritical(xre);
         return false;
     }
 
@@ -158,10 +228,16 @@ uint8_t queue_send(Queue_struct *queue, uint32_t *buf, uint32_t Ticks)
     uint32_t xReturn  = xEnterCritical();
     //Check whether the wake is due to delay or due to semaphore availability
     if(!CheckIPCState(CurrentTCB)){//if true ,the task is Block!
+        Remove_IPC(CurrentTCB);
         xExitCritical(xReturn);
         return false;
     }else{
-        WriteToQueue(queue, buf, CurrentTcbPriority);
+        //ExtractFromQueue kept a slot for this task, interrupts could not take it
+        (queue->Reserved)--;
+        WriteToQueue(queue, buf, &woken);
+        if (woken) {
+            schedule();
+        }
         xExitCritical(xReturn);
         return true;
     }
@@ -188,6 +264,7 @@ uint8_t queue_receive( Queue_struct *queue, uint32_t *buf, uint32_t Ticks )
 
     uint8_t volatile temp = schedule_PendSV;
     if(Ticks > 0){
+        TaskIPCMessageSet(CurrentTCB, buf);
         Insert_IPC(CurrentTCB,&(queue->ReceiveTree));
         TaskDelay(Ticks);
     }
@@ -199,14 +276,81 @@ uint8_t queue_receive( Queue_struct *queue, uint32_t *buf, uint32_t Ticks )
     //Check whether the wake is due to delay or due to semaphore availability
     if(!CheckIPCState(CurrentTCB)){//if true ,the task is Block!
         Remove_IPC(CurrentTCB);
+        TaskIPCMessageSet(CurrentTCB, NULL);
         xExitCritical(xReturn);
         return false;
     }else{
-        ExtractFromQueue(queue, buf, CurrentTcbPriority);
+        //The sender has copied the message into buf.
         xExitCritical(xReturn);
         return true;
     }
 }
 
 
+/*
+ * Runs in the deferred worker, hands the messages sent from interrupts to the blocked receivers.
+ */
+static void QueueDeferWake(void *arg)
+{
+    Queue_struct *queue = arg;
+    uint32_t xre = xEnterCritical();
+    uint8_t CurrentTcbPriority = GetTaskPriority(GetCurrentTCB());
+    uint8_t woken = false;
+
+    while ((queue->MessageNumber > 0) && (queue->ReceiveTree.count != 0)) {
+        TaskHandle_t ReceiveTask = IPCHighestPriorityTask(&(queue->ReceiveTree));
+        ExtractFromQueue(queue, TaskIPCMessageGet(ReceiveTask), CurrentTcbPriority);
+        HandToReceiver(ReceiveTask, &woken);
+    }
+
+    if ((queue->event != NULL) && (queue->MessageNumber > 0)) {
+        event_set_from_isr(queue->event, queue->EventBits, &woken);
+    }
+    if (woken) {
+        schedule();
+    }
+    xExitCritical(xre);
+}
+
+
+/*
+ * For interrupts: the message is copied in place, waking receivers and setting the
+ * bound event bits is left to the deferred worker. It never blocks, false means the queue is full.
+ */
+uint8_t queue_send_defer(Queue_struct *queue, uint32_t *buf)
+{
+    uint32_t xre = xEnterCritical();
+    if (QueueFull(queue)) {
+        xExitCritical(xre);
+        return false;
+    }
+
+    RingWrite(queue, buf);
+    (queue->MessageNumber)++;
+    uint8_t wake = (queue->ReceiveTree.count != 0) || (queue->event != NULL);
+    xExitCritical(xre);
+
+    if (wake) {
+        defer_work_post(&(queue->ReceiveWork));
+    }
+    return true;
+}
+
+
+/*
+ * For interrupts: never blocks and never schedules, false means the queue is full.
+ * woken collects whether a higher priority task was made ready,
+ * pass it to schedule_from_isr at the end of the handler.
+ */
+uint8_t queue_send_from_isr(Queue_struct *queue, uint32_t *buf, uint8_t *woken)
+{
+    uint32_t xre = xEnterCritical();
+    if (QueueFull(queue)) {
+        xExitCritical(xre);
+        return false;
+    }
 
+    WriteToQueue(queue, buf, woken);
+    xExitCritical(xre);
+    return true;
+}
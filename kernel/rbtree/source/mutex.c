@@ -26,26 +26,46 @@
 #include "mutex.h"
 #include "heap.h"
 #include "port.h"
+#include "atomic.h"
+
+/*
+ * lock holds the owner TCB, 0 when the mutex is free.
+ * MutexContended means the mutex sits in the owner's HoldTree and unlock must go
+ * through the critical section; it is set by the slow paths and only cleared by unlock.
+ * An uncontended lock/unlock of a mutex without ceiling is a single ldrex/strex each.
+ */
+#define MutexContended    1UL //TCBs are word aligned, bit 0 of the owner is free
+#define MutexOwner(lock)  ((TaskHandle_t)((lock) & ~MutexContended))
 
 Class(Mutex_struct)
 {
-    uint8_t        value;
-    uint32_t       original_priority;
-    rb_root       WaitTree;
-    TaskHandle_t   owner;
+    uint32_t       lock;
+    uint8_t        ceiling;
+    rb_root        WaitTree;
+    rb_node        HoldNode;
 };
 
 
 
 Mutex_Handle mutex_creat(void)
+{
+    return mutex_ceiling_creat(0);
+}
+
+
+/*
+ * The owner runs at least at the ceiling priority while it holds the mutex,
+ * a ceiling of 0 means plain priority inheritance.
+ */
+Mutex_Handle mutex_ceiling_creat(uint8_t ceiling)
 {
     Mutex_struct *mutex = heap_malloc(sizeof (Mutex_struct) );
     *mutex = (Mutex_struct){
-            .value = 1,
-            .original_priority = 0UL,
-            .owner = NULL
+            .lock = 0,
+            .ceiling = ceiling
     };
     rb_root_init(&(mutex->WaitTree));
+    rb_node_init(&(mutex->HoldNode));
     return mutex;
 }
 
@@ -61,33 +81,105 @@ void mutex_delete(Mutex_Handle mutex)
 extern uint8_t schedule_PendSV;
 
 
+/*
+ * The priority the owner of the mutex must run at.
+ */
+static uint8_t MutexTopPriority(Mutex_struct *mutex)
+{
+    uint8_t priority = mutex->ceiling;
+    if (mutex->WaitTree.count != 0) {
+        uint8_t WaitPriority = GetTaskPriority(IPCHighestPriorityTask(&(mutex->WaitTree)));
+        if (WaitPriority > priority) {
+            priority = WaitPriority;
+        }
+    }
+    return priority;
+}
+
+
+/*
+ * A task runs at the highest of its own priority and the priorities of the mutexes it holds.
+ */
+static uint8_t OwnerPriority(TaskHandle_t owner)
+{
+    uint8_t priority = GetTaskOriginalPriority(owner);
+    rb_root_handle HoldTree = TaskHoldTree(owner);
+    if ((HoldTree->count != 0) && (HoldTree->last_node->value > priority)) {
+        priority = HoldTree->last_node->value;
+    }
+    return priority;
+}
+
+
+static void MutexOwnerSet(Mutex_struct *mutex, TaskHandle_t owner)
+{
+    mutex->lock = (uint32_t)owner | MutexContended;
+    mutex->HoldNode.value = MutexTopPriority(mutex);
+    rb_Insert_node(TaskHoldTree(owner), &(mutex->HoldNode));
+    if (mutex->HoldNode.value > GetTaskPriority(owner)) {
+        TaskPrioritySet(owner, mutex->HoldNode.value);
+    }
+}
+
+
+/*
+ * Walk the chain owner -> mutex the owner waits for -> its owner ...,
+ * every owner on the way gets the priority of the tasks blocked behind it.
+ * Raising and lowering go through the same path, the walk stops once a priority
+ * does not change or the chain is deeper than configMutexChainDepth.
+ * A mutex taken by the fast path enters its owner's HoldTree here.
+ */
+static void MutexPropagate(Mutex_struct *mutex)
+{
+    uint8_t depth = configMutexChainDepth;
+
+    while ((mutex != NULL) && (mutex->lock != 0) && (depth-- > 0)) {
+        TaskHandle_t owner = MutexOwner(mutex->lock);
+        rb_root_handle HoldTree = TaskHoldTree(owner);
+
+        if (mutex->lock & MutexContended) {
+            rb_remove_node(HoldTree, &(mutex->HoldNode));
+        }
+        mutex->HoldNode.value = MutexTopPriority(mutex);
+        rb_Insert_node(HoldTree, &(mutex->HoldNode));
+        mutex->lock |= MutexContended;
+
+        uint8_t priority = OwnerPriority(owner);
+        if (priority == GetTaskPriority(owner)) {
+            break;
+        }
+        TaskPrioritySet(owner, priority);
+        mutex = TaskWaitMutexGet(owner);
+    }
+}
+
+
 uint8_t mutex_lock(Mutex_Handle mutex,uint32_t Ticks)
 {
-    uint32_t xre = xEnterCritical();
     TaskHandle_t CurrentTCB = GetCurrentTCB();
-    uint8_t CurrentTcbPriority = GetTaskPriority(CurrentTCB);
-    if( mutex->value > 0) {
-        mutex->original_priority = CurrentTcbPriority;
-        mutex->owner = CurrentTCB;
-        (mutex->value)--;
+    if ((mutex->ceiling == 0) &&
+        (atomic_cmpxchg(0, (uint32_t)CurrentTCB, &(mutex->lock)) == 0)) {
+        return true;
+    }
+
+    uint32_t xre = xEnterCritical();
+    if( mutex->lock == 0) {
+        MutexOwnerSet(mutex, CurrentTCB);
         xExitCritical(xre);
         return true;
     }
 
     if(Ticks == 0 ){
+        xExitCritical(xre);
         return false;
     }
 
     uint8_t volatile temp = schedule_PendSV;
 
-    if(Ticks > 0){
-        Insert_IPC(CurrentTCB, &(mutex->WaitTree));
-        TaskDelay(Ticks);
-        uint8_t MutexOwnerPriority = GetTaskPriority(mutex->owner);
-        if( MutexOwnerPriority < CurrentTcbPriority) {
-            TaskPrioritySet(mutex->owner, CurrentTcbPriority);
-        }
-    }
+    Insert_IPC(CurrentTCB, &(mutex->WaitTree));
+    TaskWaitMutexSet(CurrentTCB, mutex);
+    TaskDelay(Ticks);
+    MutexPropagate(mutex);
     xExitCritical(xre);
 
     while(temp == schedule_PendSV){ }//It loops until the schedule is start.
@@ -96,12 +188,12 @@ uint8_t mutex_lock(Mutex_Handle mutex,uint32_t Ticks)
     //Check whether the wake is due to delay or due to mutex availability
     if(!CheckIPCState(CurrentTCB)){//if true ,the task is Block!
         Remove_IPC(CurrentTCB);
+        TaskWaitMutexSet(CurrentTCB, NULL);
+        MutexPropagate(mutex);//the owner no longer inherits from this task
         xExitCritical(xReturn);
         return false;
     }else{
-        mutex->original_priority = CurrentTcbPriority;
-        mutex->owner = CurrentTCB;
-        (mutex->value)--;
+        //mutex_unlock has handed the mutex over to this task.
         xExitCritical(xReturn);
         return true;
     }
@@ -110,27 +202,33 @@ uint8_t mutex_lock(Mutex_Handle mutex,uint32_t Ticks)
 
 uint8_t mutex_unlock( Mutex_Handle mutex)
 {
-    uint32_t xre = xEnterCritical();
     TaskHandle_t CurrentTCB = GetCurrentTCB();
-    uint8_t owner_priority = GetTaskPriority(mutex->owner);
-    uint8_t CurrentTcbPriority = GetTaskPriority(CurrentTCB);
+    if (atomic_cmpxchg((uint32_t)CurrentTCB, 0, &(mutex->lock)) == (uint32_t)CurrentTCB) {
+        return true;
+    }
+
+    uint32_t xre = xEnterCritical();
+    TaskHandle_t owner = MutexOwner(mutex->lock);
+
+    rb_remove_node(TaskHoldTree(owner), &(mutex->HoldNode));
+    mutex->lock = 0;
+    uint8_t OwnerNewPriority = OwnerPriority(owner);
+    if (OwnerNewPriority != GetTaskPriority(owner)) {
+        TaskPrioritySet(owner, OwnerNewPriority);
+    }
 
     if (mutex->WaitTree.count != 0) {
         TaskHandle_t WaitTask = IPCHighestPriorityTask(&(mutex->WaitTree));
         DelayTreeRemove(WaitTask);
         Remove_IPC(WaitTask);
+        TaskWaitMutexSet(WaitTask, NULL);
         TaskTreeAdd(WaitTask,Ready);
-        if(GetTaskPriority(WaitTask) > CurrentTcbPriority ){
+        MutexOwnerSet(mutex, WaitTask);//hand over, the mutex is never free in between
+        if(GetTaskPriority(WaitTask) > OwnerNewPriority ){
             schedule();
         }
     }
 
-    if(owner_priority != mutex->original_priority) {
-        TaskPrioritySet(mutex->owner, mutex->original_priority);
-    }
-
-    (mutex->value)++;
-
     xExitCritical(xre);
     return true;
 }
@@ -28,6 +28,8 @@
 #include "schedule.h"
 #include "heap.h"
 #include "port.h"
+#include "trace.h"
+#include "timer.h"
 #include "rbtree.h"
 
 
@@ -38,7 +40,19 @@ Class(TCB_t)
     rb_node IPC_node;
     uint8_t state;
     uint8_t uxPriority;
+    uint8_t OriginalPriority;
+    uint8_t TimeSlice;
+    uint8_t SliceLeft;
+    uint8_t Origin;
+    rb_root HoldTree;
+    void *WaitMutex;
+    void *IPCMessage;
     uint32_t * pxStack;
+#if configRunTimeStats
+    uint64_t RunTime;
+    uint64_t LastRunTime;
+    struct TCB_t *StatsNext;
+#endif
 };
 
 __attribute__( ( used ) )  TaskHandle_t volatile schedule_currentTCB = NULL;
@@ -61,11 +75,61 @@ __attribute__( ( always_inline ) ) inline TaskHandle_t IPCHighestPriorityTask(rb
     return container_of(rb_highest_node, TCB_t, IPC_node);
 }
 
+/*
+ * The next waiter after taskHandle in the same IPC tree, from high to low priority.
+ */
+TaskHandle_t IPCNextTask(TaskHandle_t taskHandle)
+{
+    rb_node *node = rb_prev(&(taskHandle->IPC_node));
+    if (node == NULL) {
+        return NULL;
+    }
+    return container_of(node, TCB_t, IPC_node);
+}
+
 uint8_t GetTaskPriority(TaskHandle_t taskHandle)
 {
     return taskHandle->uxPriority;
 }
 
+uint8_t GetTaskOriginalPriority(TaskHandle_t taskHandle)
+{
+    return taskHandle->OriginalPriority;
+}
+
+/*
+ * The mutexes held by the task, sorted by the highest priority they require,
+ * and the mutex the task is blocked on. Both belong to the IPC layer.
+ */
+rb_root_handle TaskHoldTree(TaskHandle_t taskHandle)
+{
+    return &(taskHandle->HoldTree);
+}
+
+void TaskWaitMutexSet(TaskHandle_t taskHandle, void *mutex)
+{
+    taskHandle->WaitMutex = mutex;
+}
+
+void *TaskWaitMutexGet(TaskHandle_t taskHandle)
+{
+    return taskHandle->WaitMutex;
+}
+
+/*
+ * What the blocked task is waiting for, IPC objects that need more than the
+ * priority to decide whom to wake (event groups) keep it here.
+ */
+void TaskIPCMessageSet(TaskHandle_t taskHandle, void *message)
+{
+    taskHandle->IPCMessage = message;
+}
+
+void *TaskIPCMessageGet(TaskHandle_t taskHandle)
+{
+    return taskHandle->IPCMessage;
+}
+
 
 
 rb_root ReadyTree;
@@ -77,14 +141,21 @@ rb_root SuspendTree;
 rb_root DeleteTree;
 
 
-static volatile uint32_t NowTickCount = ( uint32_t ) 0;
-
+volatile uint32_t NowTickCount = ( uint32_t ) 0;
 
+/*
+ * The ready value is the priority in the high word and a falling sequence in the low word,
+ * so equal priorities are served first in, first out and re-adding a task sends it behind them.
+ * The sequence wraps after 2^32 adds, which only reorders equal priorities once.
+ */
+static uint32_t ReadySequence = 0;
 
 void ReadyTreeAdd(rb_node *node)
 {
     TaskHandle_t self = container_of(node, TCB_t, task_node);
-    node->value = self->uxPriority;
+    node->value = ((uint64_t)self->uxPriority << 32) | (uint32_t)~(ReadySequence++);
+    node->root = &ReadyTree;
+    self->SliceLeft = self->TimeSlice;
     rb_Insert_node( &ReadyTree, node);
 }
 
@@ -92,16 +163,19 @@ void ReadyTreeAdd(rb_node *node)
 void ReadyTreeRemove(rb_node *node)
 {
     rb_remove_node(&ReadyTree, node);
+    node->root = NULL;
 }
 
 void SuspendTreeAdd(rb_node *node)
 {
+    node->root = &SuspendTree;
     rb_Insert_node( &SuspendTree, node);
 }
 
 void SuspendTreeRemove(rb_node *node)
 {
     rb_remove_node( &SuspendTree, node);
+    node->root = NULL;
 }
 
 
@@ -115,6 +189,7 @@ void TaskTreeAdd(TaskHandle_t self, uint8_t State)
             SuspendTreeAdd
     };
     TreeAdd[State](node);
+    trace_state(self, (State == Ready) ? TraceReady : TraceSuspend, self->uxPriority);
     xExitCritical(xReturn);
 }
 
@@ -137,12 +212,73 @@ void Insert_IPC(TaskHandle_t self, rb_root *root)
     self->IPC_node.root = root;
     self->IPC_node.value = self->uxPriority;
     rb_Insert_node(root, &(self->IPC_node));
+    trace_ipc_wait(self, root);
 }
 
 
 void Remove_IPC(TaskHandle_t self)
 {
+    trace_ipc_wake(self, self->IPC_node.root);
     rb_remove_node( self->IPC_node.root , &(self->IPC_node));
+    self->IPC_node.root = NULL;
+}
+
+
+/*
+ * Change the running priority of a task.
+ * A ready task is re-sorted in the ReadyTree, a blocked task in the IPC tree it waits on,
+ * so priority inheritance is seen by the scheduler and by every wait tree at once.
+ */
+uint8_t TaskPrioritySet(TaskHandle_t taskHandle,uint8_t priority)
+{
+    uint32_t xReturn = xEnterCritical();
+    uint8_t OldPriority = taskHandle->uxPriority;
+    rb_root *IPC_root = taskHandle->IPC_node.root;
+
+    if (OldPriority != priority) {
+        if (taskHandle->task_node.root == &ReadyTree) {
+            ReadyTreeRemove(&(taskHandle->task_node));
+            taskHandle->uxPriority = priority;
+            ReadyTreeAdd(&(taskHandle->task_node));
+            schedule();
+        } else {
+            taskHandle->uxPriority = priority;
+        }
+
+        if (IPC_root != NULL) {//re-sort only, not a wake and wait
+            rb_remove_node(IPC_root, &(taskHandle->IPC_node));
+            taskHandle->IPC_node.value = priority;
+            rb_Insert_node(IPC_root, &(taskHandle->IPC_node));
+        }
+    }
+    xExitCritical(xReturn);
+    return OldPriority;
+}
+
+/*
+ * Round robin among equal priorities: the task yields to them after ticks ticks of running,
+ * 0 keeps it first in, first out, running until it blocks.
+ */
+void TaskTimeSliceSet(TaskHandle_t taskHandle, uint8_t ticks)
+{
+    uint32_t xReturn = xEnterCritical();
+    taskHandle->TimeSlice = ticks;
+    taskHandle->SliceLeft = ticks;
+    xExitCritical(xReturn);
+}
+
+//the running task used up its slice, send it behind its equal priorities
+static void TimeSliceTick(TaskHandle_t self)
+{
+    if ((self->TimeSlice == 0) || (self->task_node.root != &ReadyTree)) {
+        return;
+    }
+    if (--self->SliceLeft == 0) {
+        uint32_t xReturn = xEnterCritical();
+        ReadyTreeRemove(&(self->task_node));
+        ReadyTreeAdd(&(self->task_node));
+        xExitCritical(xReturn);
+    }
 }
 
 
@@ -169,11 +305,48 @@ __attribute__((always_inline)) inline uint8_t CheckTaskState( TaskHandle_t taskH
     return taskHandle->state == State;
 }
 
+#if configRunTimeStats
+static TCB_t *StatsList = NULL;
+static uint32_t SwitchStamp = 0;
+static uint64_t TotalTime = 0;
+static uint64_t SnapshotTime = 0;
+#endif
+
+/*
+ * Charge the cycles since the last switch to the task leaving the CPU.
+ * The 32-bit difference is right as long as a task keeps the CPU for less than 2^32 cycles.
+ */
+static inline void RunTimeAccount(void)
+{
+#if configRunTimeStats
+    uint32_t now = CycleCounterGet();
+    uint32_t elapsed = now - SwitchStamp;
+    SwitchStamp = now;
+    TotalTime += elapsed;
+    if (schedule_currentTCB != NULL) {
+        schedule_currentTCB->RunTime += elapsed;
+    }
+#endif
+}
+
+#define FromHeap    0   //where the TCB and the stack come from, TaskRelease gives them back there
+#define FromPool    1
+#define FromCaller  2
+
+static TCB_t *PendingRelease = NULL;    //a pooled or static task that deleted itself, released once it is switched out
+static void TaskRelease(TCB_t *self);
+
 uint8_t volatile schedule_PendSV = 0;
 void TaskSwitchContext( void )
 {
+    RunTimeAccount();
     schedule_PendSV++;
     schedule_currentTCB = TaskHighestPriority(&ReadyTree);
+    if (PendingRelease != NULL) {
+        TaskRelease(PendingRelease);
+        PendingRelease = NULL;
+    }
+    trace_switch(schedule_currentTCB, schedule_currentTCB->uxPriority);
 }
 
 
@@ -195,25 +368,93 @@ void RecordWakeTime(uint16_t ticks)
 void TaskDelay( uint16_t ticks )
 {
     TaskTreeRemove(schedule_currentTCB,Ready);
+    trace_state(schedule_currentTCB, TraceDelay, schedule_currentTCB->uxPriority);
     RecordWakeTime(ticks);
     schedule();
 }
 
-void  TaskCreate( TaskFunction_t pxTaskCode,
-                  const uint16_t usStackDepth,
-                  void * const pvParameters,
-                  uint32_t uxPriority,
-                  TaskHandle_t * const self
-                  )
+#if configTaskPool
+/*
+ * Static task pool: TCBs and stacks in three size classes, handed out and given back
+ * in O(1) through stacks of free slots, so a pooled task never touches the heap.
+ */
+static const uint16_t PoolDepth[3] = {configTaskPoolStack0, configTaskPoolStack1, configTaskPoolStack2};
+static TCB_t PoolTcb[configTaskPoolSize];
+static uint32_t PoolStack0[configTaskPoolSize * configTaskPoolStack0] __attribute__((aligned(8)));
+static uint32_t PoolStack1[configTaskPoolSize * configTaskPoolStack1] __attribute__((aligned(8)));
+static uint32_t PoolStack2[configTaskPoolSize * configTaskPoolStack2] __attribute__((aligned(8)));
+static uint32_t *const PoolStack[3] = {PoolStack0, PoolStack1, PoolStack2};
+static uint8_t PoolTcbFree[configTaskPoolSize];
+static uint8_t PoolStackFree[3][configTaskPoolSize];
+static uint8_t PoolTcbCount = 0;
+static uint8_t PoolStackCount[3] = {0, 0, 0};
+
+static void TaskPoolInit(void)
+{
+    for (uint8_t i = 0; i < configTaskPoolSize; i++) {
+        PoolTcbFree[i] = i;
+        for (uint8_t c = 0; c < 3; c++) {
+            PoolStackFree[c][i] = i;
+        }
+    }
+    PoolTcbCount = configTaskPoolSize;
+    for (uint8_t c = 0; c < 3; c++) {
+        PoolStackCount[c] = configTaskPoolSize;
+    }
+}
+
+//a TCB and the smallest free stack that fits, NULL when the pool can't serve the task
+static TCB_t *TaskPoolTake(uint16_t usStackDepth, uint32_t **pxStack)
+{
+    TCB_t *NewTcb = NULL;
+    uint32_t xre = xEnterCritical();
+    for (uint8_t c = 0; (c < 3) && (PoolTcbCount != 0); c++) {
+        if ((usStackDepth <= PoolDepth[c]) && (PoolStackCount[c] != 0)) {
+            *pxStack = PoolStack[c] + PoolStackFree[c][--PoolStackCount[c]] * PoolDepth[c];
+            NewTcb = &PoolTcb[PoolTcbFree[--PoolTcbCount]];
+            break;
+        }
+    }
+    xExitCritical(xre);
+    return NewTcb;
+}
+
+static void TaskPoolGive(TCB_t *self)
+{
+    uint32_t xre = xEnterCritical();
+    for (uint8_t c = 0; c < 3; c++) {
+        if ((self->pxStack >= PoolStack[c]) &&
+            (self->pxStack < PoolStack[c] + configTaskPoolSize * PoolDepth[c])) {
+            PoolStackFree[c][PoolStackCount[c]++] = (uint8_t)((self->pxStack - PoolStack[c]) / PoolDepth[c]);
+            break;
+        }
+    }
+    PoolTcbFree[PoolTcbCount++] = (uint8_t)(self - PoolTcb);
+    xExitCritical(xre);
+}
+#endif
+
+static void TaskInit( TCB_t *NewTcb,
+                      uint32_t *pxStack,
+                      uint8_t Origin,
+                      TaskFunction_t pxTaskCode,
+                      const uint16_t usStackDepth,
+                      void * const pvParameters,
+                      uint32_t uxPriority,
+                      TaskHandle_t * const self
+                      )
 {
     uint32_t *topStack = NULL;
-    uint32_t *pxStack = ( uint32_t *) heap_malloc( ( ( ( size_t ) usStackDepth ) * sizeof( uint32_t * ) ) );
-    TCB_t *NewTcb = (TCB_t *)heap_malloc(sizeof(TCB_t));
     memset( ( void * ) NewTcb, 0x00, sizeof( TCB_t ) );
     *self = ( TCB_t *) NewTcb;
     *NewTcb = (TCB_t){
         .state = Ready,
         .uxPriority = uxPriority,
+        .OriginalPriority = uxPriority,
+        .TimeSlice = configTimeSlice,
+        .Origin = Origin,
+        .WaitMutex = NULL,
+        .IPCMessage = NULL,
         .pxStack = pxStack
     };
     topStack =  NewTcb->pxStack + (usStackDepth - (uint32_t)1) ;
@@ -221,13 +462,71 @@ void  TaskCreate( TaskFunction_t pxTaskCode,
     NewTcb->pxTopOfStack = pxPortInitialiseStack(topStack,pxTaskCode,pvParameters);
     rb_node_init(&NewTcb->task_node);
     rb_node_init(&NewTcb->IPC_node);
+    rb_root_init(&NewTcb->HoldTree);
     TaskTreeAdd(NewTcb, Ready);
+#if configRunTimeStats
+    uint32_t xre = xEnterCritical();
+    NewTcb->StatsNext = StatsList;
+    StatsList = NewTcb;
+    xExitCritical(xre);
+#endif
 }
 
+void  TaskCreate( TaskFunction_t pxTaskCode,
+                  const uint16_t usStackDepth,
+                  void * const pvParameters,
+                  uint32_t uxPriority,
+                  TaskHandle_t * const self
+                  )
+{
+    uint32_t *pxStack = NULL;
+    TCB_t *NewTcb = NULL;
+#if configTaskPool
+    NewTcb = TaskPoolTake(usStackDepth, &pxStack);
+    if (NewTcb != NULL) {
+        TaskInit(NewTcb, pxStack, FromPool, pxTaskCode, usStackDepth, pvParameters, uxPriority, self);
+        return;
+    }
+#endif
+    pxStack = ( uint32_t *) heap_malloc( ( ( ( size_t ) usStackDepth ) * sizeof( uint32_t * ) ) );
+    NewTcb = (TCB_t *)heap_malloc(sizeof(TCB_t));
+    TaskInit(NewTcb, pxStack, FromHeap, pxTaskCode, usStackDepth, pvParameters, uxPriority, self);
+}
+
+_Static_assert(sizeof(TaskStatic_t) >= sizeof(TCB_t), "TaskStatic_t must hold a TCB_t");
+
+/*
+ * TaskCreate on memory the caller owns: the TCB goes in tcb, the stack is usStackDepth words at stack.
+ * Nothing is allocated or freed, the memory can be reused once the task is deleted.
+ */
+void TaskCreateStatic( TaskFunction_t pxTaskCode,
+                       const uint16_t usStackDepth,
+                       void * const pvParameters,
+                       uint32_t uxPriority,
+                       TaskHandle_t * const self,
+                       TaskStatic_t *tcb,
+                       uint32_t *stack
+                       )
+{
+    TaskInit((TCB_t *)tcb, stack, FromCaller, pxTaskCode, usStackDepth, pvParameters, uxPriority, self);
+}
+
+/*
+ * Heap tasks are freed by the leisureTask, pooled and static ones are given back at once,
+ * or at the next switch when a task deletes itself.
+ */
 void TaskDelete(TaskHandle_t self)
 {
+    uint32_t xre = xEnterCritical();
     TaskTreeRemove(self, Ready);
-    rb_Insert_node(&DeleteTree, &self->task_node);
+    if (self->Origin == FromHeap) {
+        rb_Insert_node(&DeleteTree, &self->task_node);
+    } else if (self == schedule_currentTCB) {
+        PendingRelease = self;
+    } else {
+        TaskRelease(self);
+    }
+    xExitCritical(xre);
     schedule();
 }
 
@@ -243,14 +542,36 @@ void TreeDelayInit(void)
 }
 
 
+static void TaskRelease(TCB_t *self)
+{
+#if configRunTimeStats
+    uint32_t xre = xEnterCritical();
+    TCB_t **link = &StatsList;
+    while (*link != self) {
+        link = &((*link)->StatsNext);
+    }
+    *link = self->StatsNext;
+    xExitCritical(xre);
+#endif
+    PortTaskFree((uint32_t *)self->pxTopOfStack);
+    if (self->Origin == FromHeap) {
+        heap_free((void *)self->pxStack);
+        heap_free((void *)self);
+    }
+#if configTaskPool
+    else if (self->Origin == FromPool) {
+        TaskPoolGive(self);
+    }
+#endif
+}
+
 void TaskFree(void)
 {
     if (DeleteTree.count != 0) {
         rb_node *first_node = rb_last(&DeleteTree);
         TaskHandle_t self = container_of(first_node, TCB_t, task_node);
         rb_remove_node(&DeleteTree, &self->task_node);
-        heap_free((void *)self->pxStack);
-        heap_free((void *)self);
+        TaskRelease(self);
     }
 }
 
@@ -261,6 +582,8 @@ void leisureTask( void )
 {//leisureTask content can be manually modified as needed
     while (1) {
         TaskFree();
+        //DeleteTree.count changes under this loop
+        __asm volatile("" ::: "memory");
     }
 }
 
@@ -276,8 +599,20 @@ void LeisureTaskCreat(void)
 
 void SchedulerInit(void)
 {
+#if configRunTimeStats
+    CycleCounterInit();
+#endif
+#if configTraceEnable
+    TraceInit();
+#endif
     ADTTreeInit();
     TreeDelayInit();
+#if configTimerWheel
+    TimerWheelInit();
+#endif
+#if configTaskPool
+    TaskPoolInit();
+#endif
     LeisureTaskCreat();
 }
 
@@ -314,5 +649,47 @@ void CheckTicks(void)
         TaskTreeAdd(self, Ready);
     }
 
+    TimeSliceTick(schedule_currentTCB);
+
+#if configTimerWheel
+    TimerWheelTick();
+#endif
+
     schedule();
-}
\ No newline at end of file
+}
+
+
+#if configRunTimeStats
+/*
+ * top-style snapshot: fills at most max entries, usage is the share of the CPU
+ * each task had since the previous snapshot, idle is the share of the leisureTask.
+ */
+uint8_t TaskStatsSnapshot(TaskStats *stats, uint8_t max, uint16_t *idle)
+{
+    uint8_t n = 0;
+    uint32_t xre = xEnterCritical();
+    RunTimeAccount();
+    uint64_t window = TotalTime - SnapshotTime;
+    SnapshotTime = TotalTime;
+
+    for (TCB_t *task = StatsList; task != NULL; task = task->StatsNext) {
+        uint64_t ran = task->RunTime - task->LastRunTime;
+        uint16_t usage = window ? (uint16_t)((ran * 10000) / window) : 0;
+        task->LastRunTime = task->RunTime;
+        if ((task == leisureTcb) && (idle != NULL)) {
+            *idle = usage;
+        }
+        if (n < max) {
+            stats[n++] = (TaskStats){
+                    .task = task,
+                    .priority = task->uxPriority,
+                    .RunTime = task->RunTime,
+                    .usage = usage
+            };
+        }
+    }
+    xExitCritical(xre);
+    return n;
+}
+#endif
+
@@ -26,11 +26,30 @@
 #include "sem.h"
 #include "heap.h"
 #include "port.h"
+#include "atomic.h"
+#include "event.h"
+#include "defer.h"
+
+/*
+ * value holds the count, SemWaiters is set while tasks are blocked on the semaphore.
+ * take and release only enter the critical section when the ldrex/strex fast path fails,
+ * that is when the count is 0 (take) or a task is waiting (release).
+ * A task preempted between ldrex and strex fails its strex, so the plain stores
+ * made inside the critical section are safe against the fast path.
+ * SemBound keeps a semaphore bound to an event group on the slow path,
+ * where the event bit follows the count.
+ */
+#define SemWaiters    (1UL << 31)
+#define SemBound      (1UL << 30)
+#define SemSlowPath   (SemWaiters | SemBound)
+#define SemCount(value)   ((value) & ~SemSlowPath)
 
 Class(Semaphore_struct)
 {
-    uint8_t value;
+    uint32_t value;
     rb_root WaitTree;
+    Event_Handle event;
+    uint32_t EventBits;
 };
 
 
@@ -38,10 +57,29 @@ Semaphore_Handle semaphore_creat(uint8_t value)
 {
     Semaphore_struct *xSemaphore = heap_malloc(sizeof (Semaphore_struct) );
     xSemaphore->value = value;
+    xSemaphore->event = NULL;
+    xSemaphore->EventBits = 0;
     rb_root_init(&(xSemaphore->WaitTree));
     return xSemaphore;
 }
 
+
+/*
+ * The event bits are set while the semaphore can be taken, so a task can
+ * event_wait on several semaphores and queues at once and then take the ready one.
+ */
+void semaphore_bind(Semaphore_Handle semaphore, Event_Handle event, uint32_t bits)
+{
+    uint32_t xre = xEnterCritical();
+    semaphore->event = event;
+    semaphore->EventBits = bits;
+    semaphore->value |= SemBound;
+    if (SemCount(semaphore->value) > 0) {
+        event_set(event, bits);
+    }
+    xExitCritical(xre);
+}
+
 void semaphore_delete(Semaphore_Handle semaphore)
 {
     heap_free(semaphore);
@@ -49,48 +87,137 @@ void semaphore_delete(Semaphore_Handle semaphore)
 
 
 extern uint8_t schedule_PendSV;
-uint8_t semaphore_release( Semaphore_Handle semaphore)
-{
-    uint32_t xre = xEnterCritical();
-    TaskHandle_t CurrentTCB = GetCurrentTCB();
-    uint8_t CurrentTcbPriority = GetTaskPriority(CurrentTCB);
 
+/*
+ * Slow path of the release, called inside the critical section.
+ * woken is set when the task given the count outranks the current one.
+ */
+static void SemRelease( Semaphore_Handle semaphore, uint8_t *woken)
+{
     if (semaphore->WaitTree.count != 0) {
         TaskHandle_t SendTask = IPCHighestPriorityTask(&(semaphore->WaitTree));
         DelayTreeRemove(SendTask);
         Remove_IPC(SendTask);
         TaskTreeAdd(SendTask,Ready);
-        if(GetTaskPriority(SendTask) > CurrentTcbPriority ){
-            schedule();
+        if (semaphore->WaitTree.count == 0) {
+            semaphore->value &= ~SemWaiters;
+        }
+        //The count is handed over to SendTask, it does not go through value.
+        if(GetTaskPriority(SendTask) > GetTaskPriority(GetCurrentTCB()) ){
+            *woken = true;
+        }
+    } else {
+        semaphore->value = (semaphore->value & ~SemWaiters) + 1;
+        if (semaphore->event != NULL) {
+            event_set_from_isr(semaphore->event, semaphore->EventBits, woken);
+        }
+    }
+}
+
+uint8_t semaphore_release( Semaphore_Handle semaphore)
+{
+    uint32_t value = semaphore->value;
+    while (!(value & SemSlowPath)) {
+        uint32_t prev = atomic_cmpxchg(value, value + 1, &(semaphore->value));
+        if (prev == value) {
+            return true;
         }
+        value = prev;
     }
-    (semaphore->value)++;
 
+    uint8_t woken = false;
+    uint32_t xre = xEnterCritical();
+    SemRelease(semaphore, &woken);
+    if (woken) {
+        schedule();
+    }
     xExitCritical(xre);
     return true;
 }
 
 
+/*
+ * For interrupts: never blocks and never schedules, woken collects whether a
+ * higher priority task was made ready, pass it to schedule_from_isr at the end of the handler.
+ */
+uint8_t semaphore_release_from_isr( Semaphore_Handle semaphore, uint8_t *woken)
+{
+    uint32_t value = semaphore->value;
+    while (!(value & SemSlowPath)) {
+        uint32_t prev = atomic_cmpxchg(value, value + 1, &(semaphore->value));
+        if (prev == value) {
+            return true;
+        }
+        value = prev;
+    }
+
+    uint32_t xre = xEnterCritical();
+    SemRelease(semaphore, woken);
+    xExitCritical(xre);
+    return true;
+}
+
+
+static void SemReleaseDefer(void *semaphore)
+{
+    semaphore_release(semaphore);
+}
+
+/*
+ * For interrupts: the count is raised in place when nobody waits,
+ * waking a waiter is left to the deferred worker.
+ */
+uint8_t semaphore_release_defer( Semaphore_Handle semaphore)
+{
+    uint32_t value = semaphore->value;
+    while (!(value & SemSlowPath)) {
+        uint32_t prev = atomic_cmpxchg(value, value + 1, &(semaphore->value));
+        if (prev == value) {
+            return true;
+        }
+        value = prev;
+    }
+    return defer_call(SemReleaseDefer, semaphore);
+}
+
+
 uint8_t semaphore_take(Semaphore_Handle semaphore,uint32_t Ticks)
 {
+    uint32_t value = semaphore->value;
+    while ((value != 0) && !(value & SemSlowPath)) {
+        uint32_t prev = atomic_cmpxchg(value, value - 1, &(semaphore->value));
+        if (prev == value) {
+            return true;
+        }
+        value = prev;
+    }
+
+    if((Ticks == 0) && (SemCount(value) == 0)){
+        return false;
+    }
+
     uint32_t xre = xEnterCritical();
     TaskHandle_t CurrentTCB = GetCurrentTCB();
 
-    if( semaphore->value > 0) {
+    if( SemCount(semaphore->value) > 0) {
         (semaphore->value)--;
+        if ((semaphore->event != NULL) && (SemCount(semaphore->value) == 0)) {
+            event_clear(semaphore->event, semaphore->EventBits);
+        }
         xExitCritical(xre);
         return true;
     }
+
     if(Ticks == 0 ){
+        xExitCritical(xre);
         return false;
     }
 
     uint8_t volatile temp = schedule_PendSV;
 
-    if(Ticks > 0){
-        Insert_IPC(CurrentTCB, &(semaphore->WaitTree));
-        TaskDelay(Ticks);
-    }
+    semaphore->value |= SemWaiters;
+    Insert_IPC(CurrentTCB, &(semaphore->WaitTree));
+    TaskDelay(Ticks);
     xExitCritical(xre);
 
     while(temp == schedule_PendSV){ }//It loops until the schedule is start.
@@ -99,12 +226,16 @@ uint8_t semaphore_take(Semaphore_Handle semaphore,uint32_t Ticks)
     //Check whether the wake is due to delay or due to semaphore availability
     if(!CheckIPCState(CurrentTCB)){//if true ,the task is Block!
         Remove_IPC(CurrentTCB);
+        if (semaphore->WaitTree.count == 0) {
+            semaphore->value &= ~SemWaiters;
+        }
         xExitCritical(xReturn);
         return false;
     }else{
-        (semaphore->value)--;
+        //semaphore_release has handed the count over to this task.
         xExitCritical(xReturn);
         return true;
     }
 }
 
+
@@ -29,6 +29,8 @@
 #include "port.h"
 #include "compare.h"
 
+#if (configTimerWheel == 0)
+
 Class(timer_struct)
 {
     rb_node             TimerNode;
@@ -39,7 +41,7 @@ Class(timer_struct)
 
 rb_root ClockTree;
 static uint16_t TimerCheckPeriod = 0;
-extern uint32_t NowTickCount;
+extern volatile uint32_t NowTickCount;
 
 void ClockTreeAdd(timer_struct *timer)
 {
@@ -137,3 +139,54 @@ uint8_t TimerStopImmediate(timer_struct *timer)
     ClockListRemove(timer);
     return atomic_set_return(stop, (uint32_t *)&(timer->TimerStopFlag));
 }
+
+#else
+
+#include "timewheel.h"
+
+/*
+ * configTimerWheel: the timers live in the shared wheel, kernel/timewheel, this kernel only runs its timer task.
+ */
+static TaskHandle_t TimerTask = NULL;
+static uint8_t TimerTaskSleep = 0;
+
+
+void TimerTaskWake(void)
+{
+    if (TimerTaskSleep) {
+        TimerTaskSleep = 0;
+        TaskTreeAdd(TimerTask, Ready);
+    }
+}
+
+
+void TimerTaskWait(void)
+{
+    TimerTaskSleep = 1;
+    TaskTreeRemove(TimerTask, Ready);
+    schedule();
+}
+
+
+/*
+ * check_period is kept for the API, the wheel wakes the timer task only when a timer is due.
+ * The wheel itself is set up by SchedulerInit, it is ticked from the first tick on.
+ */
+TaskHandle_t TimerInit(uint8_t timer_priority, uint16_t stack, uint8_t check_period)
+{
+    (void)check_period;
+    TaskCreate((TaskFunction_t)TimerWheelTask,
+               stack,
+               NULL,
+               timer_priority,
+               &TimerTask);
+    return TimerTask;
+}
+
+
+TimerHandle TimerCreat(TimerFunction_t CallBackFun, uint32_t period, uint8_t timer_flag)
+{
+    return TimerWheelCreate(CallBackFun, period, timer_flag);
+}
+
+#endif
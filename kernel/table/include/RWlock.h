@@ -26,8 +26,12 @@
 #define RWLOCK_H
 #include "schedule.h"
 
+#define RWLockPreferWriter  0
+#define RWLockPreferReader  1
+
 typedef struct rwlock *rwlock_handle;
 rwlock_handle rwlock_creat(void);
+rwlock_handle rwlock_policy_creat(uint8_t policy);
 void read_acquire(rwlock_handle rwlock_handle1);
 void read_release(rwlock_handle rwlock_handle1);
 void write_acquire(rwlock_handle rwlock_handle1);
@@ -33,6 +33,11 @@
 typedef struct  class  class;\
 struct class
 
+//get father struct address
+//how to use it:struct parent *parent_ptr = container_of(child_ptr, struct parent, child)
+#define container_of(ptr, type, member) \
+    ((type *)((char *)(ptr) - offsetof(type, member)))
+
 
 
 #endif
@@ -40,19 +40,36 @@
 
 //config
 #define alignment_byte               0x07
+#ifndef config_heap    //the host build (bench/) sets a bigger one
 #define config_heap   (10240)
+#endif
 #define configMaxPriority 32
 #define configTimerNumber  32
+#define configTimerWheel   1     //1: timers run on the timing wheel driven by CheckTicks, 0: the polling timer task
+#define configTraceEnable  0     //1: record scheduling events into the trace ring buffer, see kernel/trace
+#define configRunTimeStats  0    //1: charge the cycles between two switches to the task that ran, see TaskStatsSnapshot
+#define configTaskPool     0     //1: TaskCreate takes the TCB and stack from static pools before the heap
+#define configTaskPoolSize 8     //pooled TCBs, and pooled stacks of each size class
+#define configTaskPoolStack0 128 //stack size classes in words, smallest first
+#define configTaskPoolStack1 256
+#define configTaskPoolStack2 512
 
 
 
 typedef void (* TaskFunction_t)( void * );
 typedef  struct TCB_t         *TaskHandle_t;
 
+//memory for the TCB of TaskCreateStatic, the layout is private to schedule.c
+Class(TaskStatic_t)
+{
+    uint64_t space[6];
+};
+
 uint8_t FindHighestPriority(uint32_t Table);
 
 uint32_t TableAdd( TaskHandle_t taskHandle,uint8_t State);
 uint32_t TableRemove( TaskHandle_t taskHandle, uint8_t State);
+void TableAddFromISR( TaskHandle_t taskHandle);
 
 void TaskDelay( uint16_t ticks );
 void TaskCreate(  TaskFunction_t pxTaskCode,
@@ -60,6 +77,13 @@ void TaskCreate(  TaskFunction_t pxTaskCode,
                   void *pvParameters,
                   uint32_t uxPriority,
                   TaskHandle_t *self );
+void TaskCreateStatic( TaskFunction_t pxTaskCode,
+                  uint16_t usStackDepth,
+                  void *pvParameters,
+                  uint32_t uxPriority,
+                  TaskHandle_t *self,
+                  TaskStatic_t *tcb,
+                  uint32_t *stack );
 void TaskDelete(TaskHandle_t self);
 void TaskSusPend(TaskHandle_t self);
 void TaskResume(TaskHandle_t self);
@@ -79,5 +103,16 @@ TaskHandle_t GetCurrentTCB(void);
 void PreemptiveCPU(uint8_t priority);
 
 
+Class(TaskStats)
+{
+    TaskHandle_t task;
+    uint8_t priority;
+    uint64_t RunTime;       //cycles run since the scheduler started
+    uint16_t usage;         //share of the CPU since the previous snapshot, in 0.01%
+};
+
+uint8_t TaskStatsSnapshot(TaskStats *stats, uint8_t max, uint16_t *idle);
+
+
 
 #endif
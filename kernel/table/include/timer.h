@@ -35,6 +35,7 @@
 
 typedef void (* TimerFunction_t)( void * );
 typedef struct timer_struct * TimerHandle;
+//with configTimerWheel, check_period and index are accepted and ignored, the signatures stay the same for both backends
 TaskHandle_t TimerInit(uint8_t timer_priority, uint16_t stack, uint8_t check_period);
 TimerHandle TimerCreat(TimerFunction_t CallBackFun, uint32_t period, uint8_t index, uint8_t timer_flag);
 uint8_t TimerRerun(TimerHandle timer, uint8_t timer_flag);
@@ -42,6 +43,12 @@ uint8_t TimerStop(TimerHandle timer);
 uint8_t TimerStopImmediate(TimerHandle timer);
 void TimerDelete(TimerHandle timer);
 
+void TimerWheelInit(void);
+void TimerWheelTick(void);
+//kernel/timewheel masks interrupts with these
+#define TimerEnterCritical()        EnterCritical()
+#define TimerExitCritical(lock)     ExitCritical(lock)
+
 
 
 
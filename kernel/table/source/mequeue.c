@@ -36,6 +36,7 @@ Class(Queue_struct)
     uint8_t *readPoint;
     uint8_t *writePoint;
     uint8_t MessageNumber;
+    uint8_t Reserved;               //slots freed for woken senders that have not written yet
     uint32_t SendTable;
     uint32_t ReceiveTable;
     uint32_t NodeSize;
@@ -56,6 +57,7 @@ Queue_struct* queue_creat(uint32_t queue_length,uint32_t queue_size)
             .readPoint  = (uint8_t *)( message_start + ( queue_length - 1) * queue_size ),
             .writePoint = message_start,
             .MessageNumber = 0UL,
+            .Reserved = 0,
             .SendTable    = 0UL,
             .ReceiveTable = 0UL,
             .NodeNumber  = queue_length,
@@ -75,7 +77,16 @@ void queue_delete( Queue_struct *queue )
 #define  GetTopTCBIndex    FindHighestPriority
 extern uint8_t schedule_count;
 
-void WriteToQueue( Queue_struct *queue , uint32_t *buf, uint8_t CurrentTcbPriority)
+//slots kept for woken senders count as used
+static inline uint8_t QueueFull(Queue_struct *queue)
+{
+    return (queue->MessageNumber + queue->Reserved) >= queue->NodeNumber;
+}
+
+/*
+ * woken is set when the woken receiver outranks the current task.
+ */
+void WriteToQueue( Queue_struct *queue , uint32_t *buf, uint8_t *woken)
 {
     memcpy((void *) queue->writePoint, buf, (size_t) queue->NodeSize);
     queue->writePoint += queue->NodeSize;
@@ -91,9 +102,9 @@ void WriteToQueue( Queue_struct *queue , uint32_t *buf, uint8_t CurrentTcbPriori
         queue->ReceiveTable &= ~(1 << uxPriority );//it belongs to the IPC layer,can't use State port!
         TableRemove(taskHandle,Block);// Also synchronize with the total blocking state
         TableRemove(taskHandle,Delay);
-        TableAdd(taskHandle, Ready);
-        if(uxPriority > CurrentTcbPriority){
-            schedule();
+        TableAddFromISR(taskHandle);
+        if(uxPriority > GetTaskPriority(GetCurrentTCB())){
+            *woken = true;
         }
     }
 
@@ -117,6 +128,7 @@ void ExtractFromQueue( Queue_struct *queue, uint32_t *buf, uint8_t CurrentTcbPri
         TableRemove(taskHandle,Block);// Also synchronize with the total blocking state
         TableRemove(taskHandle,Delay);
         TableAdd(taskHandle, Ready);
+        (queue->Reserved)++;//the freed slot is kept for the woken sender
         if(uxPriority > CurrentTcbPriority ){
             schedule();
         }
@@ -132,21 +144,20 @@ uint8_t queue_send(Queue_struct *queue, uint32_t *buf, uint32_t Ticks)
     uint32_t xre = EnterCritical();
     TaskHandle_t CurrentTCB = GetCurrentTCB();
     uint8_t CurrentTcbPriority = GetTaskPriority(CurrentTCB);
+    uint8_t woken = false;
 
-    if (queue->MessageNumber < queue->NodeNumber) {
+    if (!QueueFull(queue)) {
         //normally write
-        WriteToQueue(queue, buf, CurrentTcbPriority);
-
+        WriteToQueue(queue, buf, &woken);
+        if (woken) {
+            schedule();
+        }
         ExitCritical(xre);
         return true;
     } //Block!
 
-    if (queue->MessageNumber == queue->NodeNumber) {
-        if (Ticks == 0) {
-            ExitCritical(xre);
-            return false;
-        }
-    }else{
+    if (Ticks == 0) {
+        ExitCritical(xre);
         return false;
     }
 
@@ -169,7 +180,12 @@ uint8_t queue_send(Queue_struct *queue, uint32_t *buf, uint32_t Ticks)
         ExitCritical(xReturn);
         return false;
     }else{
-        WriteToQueue(queue, buf, CurrentTcbPriority);
+        //ExtractFromQueue kept a slot for this task, interrupts could not take it
+        (queue->Reserved)--;
+        WriteToQueue(queue, buf, &woken);
+        if (woken) {
+            schedule();
+        }
         ExitCritical(xReturn);
         return true;
     }
@@ -223,4 +239,21 @@ uint8_t queue_receive( Queue_struct *queue, uint32_t *buf, uint32_t Ticks )
 }
 
 
+/*
+ * For interrupts: never blocks and never schedules, false means the queue is full.
+ * woken collects whether a higher priority task was made ready,
+ * pass it to schedule_from_isr at the end of the handler.
+ */
+uint8_t queue_send_from_isr(Queue_struct *queue, uint32_t *buf, uint8_t *woken)
+{
+    uint32_t xre = EnterCritical();
+    if (QueueFull(queue)) {
+        ExitCritical(xre);
+        return false;
+    }
+
+    WriteToQueue(queue, buf, woken);
+    ExitCritical(xre);
+    return true;
+}
 
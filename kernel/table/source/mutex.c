@@ -26,12 +26,21 @@
 #include "mutex.h"
 #include "heap.h"
 #include "port.h"
+#include "atomic.h"
+
+/*
+ * lock holds the owner TCB, 0 when the mutex is free.
+ * MutexContended means tasks have blocked on the mutex and unlock must go
+ * through the critical section; it is set by the slow paths and only cleared by unlock.
+ * An uncontended lock/unlock is a single ldrex/strex each.
+ */
+#define MutexContended    1UL //TCBs are word aligned, bit 0 of the owner is free
+#define MutexOwner(lock)  ((TaskHandle_t)((lock) & ~MutexContended))
 
 Class(Mutex_struct)
 {
-    uint8_t        value;
+    uint32_t       lock;
     uint32_t       WaitTable;
-    TaskHandle_t   owner;
 };
 
 
@@ -40,9 +49,8 @@ Mutex_Handle mutex_creat(void)
 {
     Mutex_struct *mutex = heap_malloc(sizeof (Mutex_struct) );
     *mutex = (Mutex_struct){
-            .value = 1,
-            .WaitTable = 0UL,
-            .owner = NULL
+            .lock = 0,
+            .WaitTable = 0UL
     };
     return mutex;
 }
@@ -66,31 +74,35 @@ extern uint8_t schedule_count;
 
 uint8_t mutex_lock(Mutex_Handle mutex,uint32_t Ticks)
 {
-    uint32_t xre = EnterCritical();
     TaskHandle_t CurrentTCB = GetCurrentTCB();
+    if (atomic_cmpxchg(0, (uint32_t)CurrentTCB, &(mutex->lock)) == 0) {
+        return true;
+    }
+
+    uint32_t xre = EnterCritical();
     uint8_t CurrentTcbPriority = GetTaskPriority(CurrentTCB);
-    if( mutex->value > 0) {
-        mutex->owner = CurrentTCB;
-        (mutex->value)--;
+    if( mutex->lock == 0) {
+        mutex->lock = (uint32_t)CurrentTCB;
         ExitCritical(xre);
         return true;
     }
 
     if(Ticks == 0 ){
+        ExitCritical(xre);
         return false;
     }
 
     uint8_t volatile temp = schedule_count;
 
-    if(Ticks > 0){
-        TableAdd(CurrentTCB,Block);
-        mutex->WaitTable |= (1 << CurrentTcbPriority);//it belongs to the IPC layer,can't use State port!
-        TaskDelay(Ticks);
-        uint8_t MutexOwnerPriority = GetTaskPriority(mutex->owner);
-        if( MutexOwnerPriority < CurrentTcbPriority) {
-            TableRemove(mutex->owner, Ready);
-            PreemptiveCPU(MutexOwnerPriority);
-        }
+    TaskHandle_t owner = MutexOwner(mutex->lock);
+    mutex->lock |= MutexContended;
+    TableAdd(CurrentTCB,Block);
+    mutex->WaitTable |= (1 << CurrentTcbPriority);//it belongs to the IPC layer,can't use State port!
+    TaskDelay(Ticks);
+    uint8_t MutexOwnerPriority = GetTaskPriority(owner);
+    if( MutexOwnerPriority < CurrentTcbPriority) {
+        TableRemove(owner, Ready);
+        PreemptiveCPU(MutexOwnerPriority);
     }
     ExitCritical(xre);
 
@@ -104,7 +116,7 @@ uint8_t mutex_lock(Mutex_Handle mutex,uint32_t Ticks)
         ExitCritical(xReturn);
         return false;
     }else{
-        (mutex->value)--;
+        //mutex_unlock has handed the mutex over to this task.
         ExitCritical(xReturn);
         return true;
     }
@@ -113,17 +125,28 @@ uint8_t mutex_lock(Mutex_Handle mutex,uint32_t Ticks)
 
 uint8_t mutex_unlock( Mutex_Handle mutex)
 {
+    TaskHandle_t CurrentTCB = GetCurrentTCB();
+    if (atomic_cmpxchg((uint32_t)CurrentTCB, 0, &(mutex->lock)) == (uint32_t)CurrentTCB) {
+        return true;
+    }
+
     uint32_t xre = EnterCritical();
+    mutex->lock = 0;
+    //mutex_lock took the owner off the ready table to lend it the waiter's priority, give it back
+    if (!CheckState(CurrentTCB, Ready)) {
+        TableAdd(CurrentTCB, Ready);
+    }
 
     if (mutex->WaitTable) {
         uint8_t uxPriority =  GetTopTCBIndex(mutex->WaitTable);
         TaskHandle_t taskHandle = GetTaskHandle(uxPriority);
         mutex->WaitTable &= ~(1 << uxPriority );
+        //hand over, the mutex is never free in between
+        mutex->lock = (uint32_t)taskHandle | (mutex->WaitTable ? MutexContended : 0);
         TableRemove(taskHandle,Block);
         TableRemove(taskHandle,Delay);
         TableAdd(taskHandle, Ready);
     }
-    (mutex->value)++;
 
     ExitCritical(xre);
     return true;
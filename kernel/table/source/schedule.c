@@ -26,13 +26,20 @@
 #include "schedule.h"
 #include "heap.h"
 #include "port.h"
+#include "timer.h"
+#include "trace.h"
 
 
 Class(TCB_t)
 {
     volatile uint32_t * pxTopOfStack;
     uint8_t uxPriority;
+    uint8_t Origin;
     uint32_t * pxStack;
+#if configRunTimeStats
+    uint64_t RunTime;
+    uint64_t LastRunTime;
+#endif
 };
 
 
@@ -72,12 +79,48 @@ void TcbTaskTableInit(void)
     }
 }
 
+#if configRunTimeStats
+static uint32_t SwitchStamp = 0;
+static uint64_t TotalTime = 0;
+static uint64_t SnapshotTime = 0;
+#endif
+
+/*
+ * Charge the cycles since the last switch to the task leaving the CPU.
+ * The 32-bit difference is right as long as a task keeps the CPU for less than 2^32 cycles.
+ */
+static inline void RunTimeAccount(void)
+{
+#if configRunTimeStats
+    uint32_t now = CycleCounterGet();
+    uint32_t elapsed = now - SwitchStamp;
+    SwitchStamp = now;
+    TotalTime += elapsed;
+    if (schedule_currentTCB != NULL) {
+        schedule_currentTCB->RunTime += elapsed;
+    }
+#endif
+}
+
 uint8_t volatile schedule_count = 0;
 
+#define FromHeap    0   //where the TCB and the stack come from, TaskRelease gives them back there
+#define FromPool    1
+#define FromCaller  2
+
+static TCB_t *PendingRelease = NULL;    //a pooled or static task that deleted itself, released once it is switched out
+static void TaskRelease(TCB_t *self);
+
 void TaskSwitchContext( void )
 {
+    RunTimeAccount();
     schedule_count++;
     schedule_currentTCB = TcbTaskTable[HighestReadyPriority];
+    trace_switch(schedule_currentTCB, HighestReadyPriority);
+    if (PendingRelease != NULL) {
+        TaskRelease(PendingRelease);
+        PendingRelease = NULL;
+    }
 }
 
 /*
@@ -86,6 +129,9 @@ void TaskSwitchContext( void )
 __attribute__((always_inline)) inline uint32_t TableAdd( TaskHandle_t taskHandle,uint8_t State) {
     uint32_t cpu_lock = EnterCritical();
     StateTable[State] |= (1 << taskHandle->uxPriority);
+    if (State != Dead) {
+        trace_state(taskHandle, State, taskHandle->uxPriority);
+    }
     if ((State == Ready) &&
         (taskHandle->uxPriority > HighestReadyPriority)) {
         HighestReadyPriority = taskHandle->uxPriority;
@@ -95,10 +141,27 @@ __attribute__((always_inline)) inline uint32_t TableAdd( TaskHandle_t taskHandle
     return StateTable[State];
 }
 
+/*
+ * TableAdd(taskHandle, Ready) without the schedule, the caller decides when to switch.
+ */
+void TableAddFromISR( TaskHandle_t taskHandle)
+{
+    uint32_t cpu_lock = EnterCritical();
+    StateTable[Ready] |= (1 << taskHandle->uxPriority);
+    trace_state(taskHandle, TraceReady, taskHandle->uxPriority);
+    if (taskHandle->uxPriority > HighestReadyPriority) {
+        HighestReadyPriority = taskHandle->uxPriority;
+    }
+    ExitCritical(cpu_lock);
+}
+
 __attribute__((always_inline)) inline uint32_t TableRemove( TaskHandle_t taskHandle, uint8_t State)
 {
     uint32_t cpu_lock = EnterCritical();
     StateTable[State] &= ~(1 << taskHandle->uxPriority);
+    if (State == Block) {
+        trace_ipc_wake(taskHandle, NULL);
+    }
     if ((State == Ready) &&
         (taskHandle->uxPriority == HighestReadyPriority)) {
         HighestReadyPriority = FindHighestPriority(StateTable[Ready]);
@@ -166,6 +229,9 @@ void CheckTicks(void)
             }
         }
 
+#if configTimerWheel
+        TimerWheelTick();
+#endif
     }
 }
 
@@ -198,40 +264,175 @@ void SchedulerResume(void)
 
 
 
-void TaskCreate( TaskFunction_t pxTaskCode,
-                  const uint16_t usStackDepth,
-                  void * const pvParameters,
-                  uint32_t uxPriority,
-                  TaskHandle_t * const self )
+#if configTaskPool
+/*
+ * Static task pool: TCBs and stacks in three size classes, handed out and given back
+ * in O(1) through stacks of free slots, so a pooled task never touches the heap.
+ */
+static const uint16_t PoolDepth[3] = {configTaskPoolStack0, configTaskPoolStack1, configTaskPoolStack2};
+static TCB_t PoolTcb[configTaskPoolSize];
+static uint32_t PoolStack0[configTaskPoolSize * configTaskPoolStack0] __attribute__((aligned(8)));
+static uint32_t PoolStack1[configTaskPoolSize * configTaskPoolStack1] __attribute__((aligned(8)));
+static uint32_t PoolStack2[configTaskPoolSize * configTaskPoolStack2] __attribute__((aligned(8)));
+static uint32_t *const PoolStack[3] = {PoolStack0, PoolStack1, PoolStack2};
+static uint8_t PoolTcbFree[configTaskPoolSize];
+static uint8_t PoolStackFree[3][configTaskPoolSize];
+static uint8_t PoolTcbCount = 0;
+static uint8_t PoolStackCount[3] = {0, 0, 0};
+
+static void TaskPoolInit(void)
+{
+    for (uint8_t i = 0; i < configTaskPoolSize; i++) {
+        PoolTcbFree[i] = i;
+        for (uint8_t c = 0; c < 3; c++) {
+            PoolStackFree[c][i] = i;
+        }
+    }
+    PoolTcbCount = configTaskPoolSize;
+    for (uint8_t c = 0; c < 3; c++) {
+        PoolStackCount[c] = configTaskPoolSize;
+    }
+}
+
+//a TCB and the smallest free stack that fits, NULL when the pool can't serve the task
+static TCB_t *TaskPoolTake(uint16_t usStackDepth, uint32_t **pxStack)
+{
+    TCB_t *NewTcb = NULL;
+    uint32_t xre = EnterCritical();
+    for (uint8_t c = 0; (c < 3) && (PoolTcbCount != 0); c++) {
+        if ((usStackDepth <= PoolDepth[c]) && (PoolStackCount[c] != 0)) {
+            *pxStack = PoolStack[c] + PoolStackFree[c][--PoolStackCount[c]] * PoolDepth[c];
+            NewTcb = &PoolTcb[PoolTcbFree[--PoolTcbCount]];
+            break;
+        }
+    }
+    ExitCritical(xre);
+    return NewTcb;
+}
+
+static void TaskPoolGive(TCB_t *self)
+{
+    uint32_t xre = EnterCritical();
+    for (uint8_t c = 0; c < 3; c++) {
+        if ((self->pxStack >= PoolStack[c]) &&
+            (self->pxStack < PoolStack[c] + configTaskPoolSize * PoolDepth[c])) {
+            PoolStackFree[c][PoolStackCount[c]++] = (uint8_t)((self->pxStack - PoolStack[c]) / PoolDepth[c]);
+            break;
+        }
+    }
+    PoolTcbFree[PoolTcbCount++] = (uint8_t)(self - PoolTcb);
+    ExitCritical(xre);
+}
+#endif
+
+static void TaskInit( TCB_t *NewTcb,
+                      uint32_t *pxStack,
+                      uint8_t Origin,
+                      TaskFunction_t pxTaskCode,
+                      const uint16_t usStackDepth,
+                      void * const pvParameters,
+                      uint32_t uxPriority,
+                      TaskHandle_t * const self )
 {
     uint32_t *topStack = NULL;
-    TCB_t *NewTcb = (TCB_t *)heap_malloc(sizeof(TCB_t));
     *self = ( TCB_t *) NewTcb;
     TcbTaskTable[uxPriority] = NewTcb;
     NewTcb->uxPriority = uxPriority;
-    NewTcb->pxStack = ( uint32_t *) heap_malloc( ( ( ( size_t ) usStackDepth ) * sizeof( uint32_t * ) ) );
+    NewTcb->Origin = Origin;
+#if configRunTimeStats
+    NewTcb->RunTime = 0;
+    NewTcb->LastRunTime = 0;
+#endif
+    NewTcb->pxStack = pxStack;
     topStack =  NewTcb->pxStack + (usStackDepth - (uint32_t)1) ;
     topStack = ( uint32_t *) (((uint32_t)topStack) & (~((uint32_t) alignment_byte)));
     NewTcb->pxTopOfStack = StackInit(topStack,pxTaskCode,pvParameters);
     StateTable[Ready] |= (1 << uxPriority);
 }
 
-void TaskDelete(TaskHandle_t self)
+void TaskCreate( TaskFunction_t pxTaskCode,
+                  const uint16_t usStackDepth,
+                  void * const pvParameters,
+                  uint32_t uxPriority,
+                  TaskHandle_t * const self )
 {
-    TableRemove(self, Ready);
-    TableAdd(self, Dead);
+    uint32_t *pxStack = NULL;
+    TCB_t *NewTcb = NULL;
+#if configTaskPool
+    NewTcb = TaskPoolTake(usStackDepth, &pxStack);
+    if (NewTcb != NULL) {
+        TaskInit(NewTcb, pxStack, FromPool, pxTaskCode, usStackDepth, pvParameters, uxPriority, self);
+        return;
+    }
+#endif
+    NewTcb = (TCB_t *)heap_malloc(sizeof(TCB_t));
+    pxStack = ( uint32_t *) heap_malloc( ( ( ( size_t ) usStackDepth ) * sizeof( uint32_t * ) ) );
+    TaskInit(NewTcb, pxStack, FromHeap, pxTaskCode, usStackDepth, pvParameters, uxPriority, self);
 }
 
+_Static_assert(sizeof(TaskStatic_t) >= sizeof(TCB_t), "TaskStatic_t must hold a TCB_t");
 
-void TaskFree(void)
+/*
+ * TaskCreate on memory the caller owns: the TCB goes in tcb, the stack is usStackDepth words at stack.
+ * Nothing is allocated or freed, the memory can be reused once the task is deleted.
+ */
+void TaskCreateStatic( TaskFunction_t pxTaskCode,
+                        const uint16_t usStackDepth,
+                        void * const pvParameters,
+                        uint32_t uxPriority,
+                        TaskHandle_t * const self,
+                        TaskStatic_t *tcb,
+                        uint32_t *stack )
 {
-    if (StateTable[Dead]) {
-        TaskHandle_t self = TcbTaskTable[FindHighestPriority(StateTable[Dead])];
+    TaskInit((TCB_t *)tcb, stack, FromCaller, pxTaskCode, usStackDepth, pvParameters, uxPriority, self);
+}
+
+/*
+ * Heap tasks are marked Dead for the leisureTask, pooled and static ones leave the table at once,
+ * or at the next switch when a task deletes itself.
+ */
+void TaskDelete(TaskHandle_t self)
+{
+    uint32_t cpu_lock = EnterCritical();
+    if (self->Origin == FromHeap) {
         TableRemove(self, Ready);
-        TcbTaskTable[self->uxPriority] = NULL;
+        TableAdd(self, Dead);
+    } else if (self == schedule_currentTCB) {
+        PendingRelease = self;
+        TableRemove(self, Ready);
+    } else {
+        TableRemove(self, Ready);
+        TaskRelease(self);
+    }
+    ExitCritical(cpu_lock);
+}
+
+//clear every state bit of the priority and give the memory back where it came from
+static void TaskRelease(TCB_t *self)
+{
+    uint32_t cpu_lock = EnterCritical();
+    for (uint8_t State = Dead; State <= Block; State++) {
+        StateTable[State] &= ~(1 << self->uxPriority);
+    }
+    TcbTaskTable[self->uxPriority] = NULL;
+    ExitCritical(cpu_lock);
+    PortTaskFree((uint32_t *)self->pxTopOfStack);
+    if (self->Origin == FromHeap) {
         heap_free((void *)self->pxStack);
         heap_free((void *)self);
     }
+#if configTaskPool
+    else if (self->Origin == FromPool) {
+        TaskPoolGive(self);
+    }
+#endif
+}
+
+void TaskFree(void)
+{
+    if (StateTable[Dead]) {
+        TaskRelease(TcbTaskTable[FindHighestPriority(StateTable[Dead])]);
+    }
 }
 
 TaskHandle_t leisureTcb = NULL;
@@ -239,14 +440,28 @@ void leisureTask( void )
 {//leisureTask content can be manually modified as needed
     while (1) {
         TaskFree();
+        //StateTable[Dead] is set by other tasks, reload it every round
+        __asm volatile("" ::: "memory");
     }
 }
 
 void SchedulerInit( void )
 {
+#if configRunTimeStats
+    CycleCounterInit();
+#endif
+#if configTraceEnable
+    TraceInit();
+#endif
     TcbTaskTableInit();
+#if configTaskPool
+    TaskPoolInit();
+#endif
     WakeTicksTable = TicksTable;
     OverWakeTicksTable = TicksTableAssist;
+#if configTimerWheel
+    TimerWheelInit();
+#endif
     TaskCreate(    (TaskFunction_t)leisureTask,
                     128,
                     NULL,
@@ -259,6 +474,7 @@ void SchedulerInit( void )
 void SchedulerStart( void )
 {
     HighestReadyPriority = FindHighestPriority(StateTable[Ready]);
+    RunTimeAccount();
     schedule_currentTCB = TcbTaskTable[HighestReadyPriority];
     StartFirstTask();
 }
@@ -274,3 +490,42 @@ __attribute__((always_inline)) inline uint8_t GetTaskPriority( TaskHandle_t task
     return taskHandle->uxPriority;
 }
 
+
+#if configRunTimeStats
+/*
+ * top-style snapshot: fills at most max entries, usage is the share of the CPU
+ * each task had since the previous snapshot, idle is the share of the leisureTask.
+ */
+uint8_t TaskStatsSnapshot(TaskStats *stats, uint8_t max, uint16_t *idle)
+{
+    uint8_t n = 0;
+    uint32_t xre = EnterCritical();
+    RunTimeAccount();
+    uint64_t window = TotalTime - SnapshotTime;
+    SnapshotTime = TotalTime;
+
+    for (int8_t i = configMaxPriority - 1; i >= 0; i--) {
+        TaskHandle_t task = TcbTaskTable[i];
+        if (task == NULL) {
+            continue;
+        }
+        uint64_t ran = task->RunTime - task->LastRunTime;
+        uint16_t usage = window ? (uint16_t)((ran * 10000) / window) : 0;
+        task->LastRunTime = task->RunTime;
+        if ((task == leisureTcb) && (idle != NULL)) {
+            *idle = usage;
+        }
+        if (n < max) {
+            stats[n++] = (TaskStats){
+                    .task = task,
+                    .priority = task->uxPriority,
+                    .RunTime = task->RunTime,
+                    .usage = usage
+            };
+        }
+    }
+    ExitCritical(xre);
+    return n;
+}
+#endif
+
@@ -26,10 +26,20 @@
 #include "sem.h"
 #include "heap.h"
 #include "port.h"
+#include "atomic.h"
+
+/*
+ * value holds the count, SemWaiters is set while tasks are blocked on the semaphore.
+ * take and release only enter the critical section when the ldrex/strex fast path fails,
+ * that is when the count is 0 (take) or a task is waiting (release).
+ * A task preempted between ldrex and strex fails its strex, so the plain stores
+ * made inside the critical section are safe against the fast path.
+ */
+#define SemWaiters    (1UL << 31)
 
 Class(Semaphore_struct)
 {
-    uint8_t value;
+    uint32_t value;
     uint32_t xBlock;
 };
 
@@ -54,25 +64,70 @@ void semaphore_delete(Semaphore_Handle semaphore)
 #define  GetTopTCBIndex    FindHighestPriority
 
 extern uint8_t schedule_count;
-uint8_t semaphore_release( Semaphore_Handle semaphore)
+/*
+ * Slow path of the release, called inside the critical section.
+ * woken is set when the task given the count outranks the current one.
+ */
+static void SemRelease( Semaphore_Handle semaphore, uint8_t *woken)
 {
-    uint32_t xre = EnterCritical();
-    TaskHandle_t CurrentTCB = GetCurrentTCB();
-    uint8_t CurrentTcbPriority = GetTaskPriority(CurrentTCB);
-
     if (semaphore->xBlock) {
         uint8_t uxPriority =  GetTopTCBIndex(semaphore->xBlock);
         TaskHandle_t taskHandle = GetTaskHandle(uxPriority);
         semaphore->xBlock &= ~(1 << uxPriority );//it belongs to the IPC layer,can't use State port!
+        if (!semaphore->xBlock) {
+            semaphore->value = 0;
+        }
+        //The count is handed over to taskHandle, it does not go through value.
         TableRemove(taskHandle,Block);// Also synchronize with the total blocking state
         TableRemove(taskHandle,Delay);
-        TableAdd(taskHandle, Ready);
-        if(uxPriority > CurrentTcbPriority){
-            schedule();
+        TableAddFromISR(taskHandle);
+        if(uxPriority > GetTaskPriority(GetCurrentTCB())){
+            *woken = true;
+        }
+    } else {
+        semaphore->value = (semaphore->value & ~SemWaiters) + 1;
+    }
+}
+
+uint8_t semaphore_release( Semaphore_Handle semaphore)
+{
+    uint32_t value = semaphore->value;
+    while (!(value & SemWaiters)) {
+        uint32_t prev = atomic_cmpxchg(value, value + 1, &(semaphore->value));
+        if (prev == value) {
+            return true;
+        }
+        value = prev;
+    }
+
+    uint8_t woken = false;
+    uint32_t xre = EnterCritical();
+    SemRelease(semaphore, &woken);
+    if (woken) {
+        schedule();
+    }
+    ExitCritical(xre);
+    return true;
+}
+
+
+/*
+ * For interrupts: never blocks and never schedules, woken collects whether a
+ * higher priority task was made ready, pass it to schedule_from_isr at the end of the handler.
+ */
+uint8_t semaphore_release_from_isr( Semaphore_Handle semaphore, uint8_t *woken)
+{
+    uint32_t value = semaphore->value;
+    while (!(value & SemWaiters)) {
+        uint32_t prev = atomic_cmpxchg(value, value + 1, &(semaphore->value));
+        if (prev == value) {
+            return true;
         }
+        value = prev;
     }
-    (semaphore->value)++;
 
+    uint32_t xre = EnterCritical();
+    SemRelease(semaphore, woken);
     ExitCritical(xre);
     return true;
 }
@@ -80,27 +135,35 @@ uint8_t semaphore_release( Semaphore_Handle semaphore)
 
 uint8_t semaphore_take(Semaphore_Handle semaphore,uint32_t Ticks)
 {
+    uint32_t value = semaphore->value;
+    while ((value != 0) && !(value & SemWaiters)) {
+        uint32_t prev = atomic_cmpxchg(value, value - 1, &(semaphore->value));
+        if (prev == value) {
+            return true;
+        }
+        value = prev;
+    }
+
+    if(Ticks == 0 ){
+        return false;
+    }
+
     uint32_t xre = EnterCritical();
     TaskHandle_t CurrentTCB = GetCurrentTCB();
     uint8_t CurrentTcbPriority = GetTaskPriority(CurrentTCB);
 
-    if( semaphore->value > 0) {
+    if( (semaphore->value & ~SemWaiters) > 0) {
         (semaphore->value)--;
         ExitCritical(xre);
         return true;
     }
 
-    if(Ticks == 0 ){
-        return false;
-    }
-
     uint8_t volatile temp = schedule_count;
 
-    if(Ticks > 0){
-        TableAdd(CurrentTCB,Block);
-        semaphore->xBlock |= (1 << CurrentTcbPriority);//it belongs to the IPC layer,can't use State port!
-        TaskDelay(Ticks);
-    }
+    TableAdd(CurrentTCB,Block);
+    semaphore->value |= SemWaiters;
+    semaphore->xBlock |= (1 << CurrentTcbPriority);//it belongs to the IPC layer,can't use State port!
+    TaskDelay(Ticks);
     ExitCritical(xre);
 
     while(temp == schedule_count){ }//It loops until the schedule is start.
@@ -109,13 +172,17 @@ uint8_t semaphore_take(Semaphore_Handle semaphore,uint32_t Ticks)
     //Check whether the wake is due to delay or due to semaphore availability
     if( CheckState(CurrentTCB,Block) ){//if true ,the task is Block!
         semaphore->xBlock &= ~(1 << CurrentTcbPriority);//it belongs to the IPC layer,can't use State port!
+        if (!semaphore->xBlock) {
+            semaphore->value &= ~SemWaiters;
+        }
         TableRemove(CurrentTCB,Block);
         ExitCritical(xReturn);
         return false;
     }else{
-        (semaphore->value)--;
+        //semaphore_release has handed the count over to this task.
         ExitCritical(xReturn);
         return true;
     }
 }
 
+
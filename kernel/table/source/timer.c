@@ -29,6 +29,8 @@
 #include "port.h"
 #include "compare.h"
 
+#if (configTimerWheel == 0)
+
 
 
 Class(timer_struct)
@@ -149,5 +151,53 @@ uint8_t TimerStopImmediate(timer_struct *timer)
     return atomic_set_return(stop, (uint32_t *)&(timer->TimerStopFlag));
 }
 
+#else
+
+#include "timewheel.h"
+
+/*
+ * configTimerWheel: the timers live in the shared wheel, kernel/timewheel, this kernel only runs its timer task.
+ */
+static TaskHandle_t TimerTask = NULL;
+static uint8_t TimerTaskSleep = 0;
+
+
+void TimerTaskWake(void)
+{
+    if (TimerTaskSleep) {
+        TimerTaskSleep = 0;
+        TableAdd(TimerTask, Ready);
+    }
+}
+
+
+void TimerTaskWait(void)
+{
+    TimerTaskSleep = 1;
+    TableRemove(TimerTask, Ready);
+}
 
 
+/*
+ * check_period is kept for the API, the wheel wakes the timer task only when a timer is due.
+ * The wheel itself is set up by SchedulerInit, it is ticked from the first tick on.
+ */
+TaskHandle_t TimerInit(uint8_t timer_priority, uint16_t stack, uint8_t check_period)
+{
+    (void)check_period;
+    TaskCreate((TaskFunction_t)TimerWheelTask,
+               stack,
+               NULL,
+               timer_priority,
+               &TimerTask);
+    return TimerTask;
+}
+
+
+TimerHandle TimerCreat(TimerFunction_t CallBackFun, uint32_t period, uint8_t index, uint8_t timer_flag)
+{
+    (void)index;//the wheel has no timer table, index is kept for the API
+    return TimerWheelCreate(CallBackFun, period, timer_flag);
+}
+
+#endif
@@ -0,0 +1,45 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 skaiui2
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *  https://github.com/skaiui2/SKRTOS_sparrow
+ */
+
+#ifndef TIMEWHEEL_H
+#define TIMEWHEEL_H
+#include "timer.h"
+
+/*
+ * Hierarchical timing wheel, shared by the rbtree and table kernels and compiled in
+ * with configTimerWheel in schedule.h. It keeps the timers, ticks the wheel and runs
+ * the callbacks. SchedulerInit sets the wheel up with TimerWheelInit. Each kernel's
+ * timer.c creates the timer task in TimerInit and supplies the wakeup below, its
+ * timer.h maps TimerEnterCritical and TimerExitCritical to the kernel's critical section.
+ */
+
+void TimerWheelTask(void);
+TimerHandle TimerWheelCreate(TimerFunction_t CallBackFun, uint32_t period, uint8_t timer_flag);
+
+//from the kernel, called with interrupts masked
+void TimerTaskWake(void);       //make the timer task ready if it waits
+void TimerTaskWait(void);       //park the timer task until TimerTaskWake
+
+#endif
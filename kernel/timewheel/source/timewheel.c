@@ -0,0 +1,263 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 skaiui2
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *  https://github.com/skaiui2/SKRTOS_sparrow
+ */
+
+#include "timewheel.h"
+#include "heap.h"
+#include "atomic.h"
+#include "port.h"
+#include "link_list.h"
+
+#if configTimerWheel
+
+/*
+ * Hierarchical timing wheel.
+ * The root wheel holds the next 256 ticks one slot per tick, every upper level
+ * covers 64 slots of the level below, so four levels reach the whole 32-bit tick range.
+ * Start, stop and restart are a list insert or remove, there is no limit on the number of timers.
+ * Every tick CheckTicks moves the due slot to the expired list, upper slots are
+ * cascaded down only when the wheel below wraps, and the timer task is woken
+ * to run the callbacks outside the interrupt.
+ */
+#define WheelRootBits    8
+#define WheelLevelBits   6
+#define WheelRootSize    (1 << WheelRootBits)
+#define WheelLevelSize   (1 << WheelLevelBits)
+#define WheelRootMask    (WheelRootSize - 1)
+#define WheelLevelMask   (WheelLevelSize - 1)
+#define WheelLevels      4
+#define WheelIndex(tick, level)  (((tick) >> (WheelRootBits + (level) * WheelLevelBits)) & WheelLevelMask)
+
+Class(timer_struct)
+{
+    struct list_node    WheelNode;
+    uint32_t            expires;
+    uint32_t            TimerPeriod;
+    TimerFunction_t     CallBackFun;
+    uint8_t             TimerStopFlag;
+};
+
+Class(TimerWheel)
+{
+    uint32_t            NextTick;   //the tick the wheel handles next
+    struct list_node    root[WheelRootSize];
+    struct list_node    level[WheelLevels][WheelLevelSize];
+    struct list_node    expired;
+};
+
+static TimerWheel wheel;
+
+
+static void WheelInsert(timer_struct *timer)
+{
+    uint32_t expires = timer->expires;
+    uint32_t delta = expires - wheel.NextTick;
+    struct list_node *slot;
+
+    if ((int32_t)delta < 0) {
+        slot = &(wheel.root[wheel.NextTick & WheelRootMask]);
+    } else if (delta < WheelRootSize) {
+        slot = &(wheel.root[expires & WheelRootMask]);
+    } else {
+        uint8_t level = 0;
+        while ((level < WheelLevels - 1) &&
+               (delta >= (1UL << (WheelRootBits + (level + 1) * WheelLevelBits)))) {
+            level++;
+        }
+        slot = &(wheel.level[level][WheelIndex(expires, level)]);
+    }
+    list_add_prev(slot, &(timer->WheelNode));
+}
+
+static void WheelRemove(timer_struct *timer)
+{
+    if (!list_empty(&(timer->WheelNode))) {
+        list_remove(&(timer->WheelNode));
+        list_node_init(&(timer->WheelNode));
+    }
+}
+
+/*
+ * Move every node of from to the tail of to.
+ */
+static void WheelSplice(struct list_node *from, struct list_node *to)
+{
+    if (list_empty(from)) {
+        return;
+    }
+    struct list_node *first = from->next;
+    struct list_node *last = from->prev;
+    first->prev = to->prev;
+    to->prev->next = first;
+    last->next = to;
+    to->prev = last;
+    list_node_init(from);
+}
+
+/*
+ * Re-insert the timers of one upper slot, they fall into the lower levels.
+ */
+static uint32_t WheelCascade(uint8_t level)
+{
+    uint32_t index = WheelIndex(wheel.NextTick, level);
+    struct list_node pending;
+
+    list_node_init(&pending);
+    WheelSplice(&(wheel.level[level][index]), &pending);
+    while (!list_empty(&pending)) {
+        timer_struct *timer = container_of(pending.next, timer_struct, WheelNode);
+        list_remove(&(timer->WheelNode));
+        WheelInsert(timer);
+    }
+    return index;
+}
+
+
+/*
+ * Called from CheckTicks once per tick with interrupts masked.
+ */
+void TimerWheelTick(void)
+{
+    uint32_t index = wheel.NextTick & WheelRootMask;
+
+    if (index == 0) {
+        for (uint8_t level = 0; level < WheelLevels; level++) {
+            if (WheelCascade(level) != 0) {
+                break;
+            }
+        }
+    }
+    wheel.NextTick++;
+    WheelSplice(&(wheel.root[index]), &(wheel.expired));
+
+    if (!list_empty(&(wheel.expired))) {
+        TimerTaskWake();
+    }
+}
+
+
+/*
+ * The timer task, created by the kernel's TimerInit.
+ */
+void TimerWheelTask(void)
+{
+    while (1) {
+        uint32_t cpu_lock = TimerEnterCritical();
+        if (list_empty(&(wheel.expired))) {
+            TimerTaskWait();
+            TimerExitCritical(cpu_lock);
+            continue;
+        }
+        timer_struct *timer = container_of(wheel.expired.next, timer_struct, WheelNode);
+        list_remove(&(timer->WheelNode));
+        list_node_init(&(timer->WheelNode));
+        TimerExitCritical(cpu_lock);
+
+        timer->CallBackFun(timer);
+
+        cpu_lock = TimerEnterCritical();
+        if ((timer->TimerStopFlag == run) && list_empty(&(timer->WheelNode))) {
+            timer->expires += timer->TimerPeriod;
+            WheelInsert(timer);
+        }
+        TimerExitCritical(cpu_lock);
+    }
+}
+
+
+void TimerWheelInit(void)
+{
+    wheel.NextTick = 0;
+    for (uint32_t i = 0; i < WheelRootSize; i++) {
+        list_node_init(&(wheel.root[i]));
+    }
+    for (uint8_t level = 0; level < WheelLevels; level++) {
+        for (uint32_t i = 0; i < WheelLevelSize; i++) {
+            list_node_init(&(wheel.level[level][i]));
+        }
+    }
+    list_node_init(&(wheel.expired));
+}
+
+
+static void TimerStart(timer_struct *timer)
+{
+    uint32_t cpu_lock = TimerEnterCritical();
+    WheelRemove(timer);
+    timer->expires = wheel.NextTick + timer->TimerPeriod;
+    WheelInsert(timer);
+    TimerExitCritical(cpu_lock);
+}
+
+
+timer_struct *TimerWheelCreate(TimerFunction_t CallBackFun, uint32_t period, uint8_t timer_flag)
+{
+    timer_struct *timer = heap_malloc(sizeof(timer_struct));
+    *timer = (timer_struct){
+            .TimerPeriod = period,
+            .CallBackFun = CallBackFun,
+            .TimerStopFlag = timer_flag
+    };
+    list_node_init(&(timer->WheelNode));
+    TimerStart(timer);
+    return timer;
+}
+
+
+void TimerDelete(TimerHandle timer)
+{
+    uint32_t cpu_lock = TimerEnterCritical();
+    WheelRemove(timer);
+    TimerExitCritical(cpu_lock);
+    heap_free(timer);
+}
+
+
+uint8_t TimerRerun(timer_struct *timer, uint8_t timer_flag)
+{
+    TimerStart(timer);
+    return atomic_set_return(timer_flag, (uint32_t *)&(timer->TimerStopFlag));
+}
+
+
+/*
+ * timer callback function will Execute once, then removed.
+ */
+uint8_t TimerStop(timer_struct *timer)
+{
+    return atomic_set_return(stop, (uint32_t *)&(timer->TimerStopFlag));
+}
+
+/*
+ * timer callback function removed Immediately.
+ */
+uint8_t TimerStopImmediate(timer_struct *timer)
+{
+    uint32_t cpu_lock = TimerEnterCritical();
+    WheelRemove(timer);
+    TimerExitCritical(cpu_lock);
+    return atomic_set_return(stop, (uint32_t *)&(timer->TimerStopFlag));
+}
+
+#endif
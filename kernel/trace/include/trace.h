@@ -0,0 +1,111 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 skaiui2
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *  https://github.com/skaiui2/SKRTOS_sparrow
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+#include "schedule.h"
+
+/*
+ * Scheduling trace, shared by the four kernels and compiled in with
+ * configTraceEnable in schedule.h. Events go into a ring buffer in RAM with
+ * cycle counter timestamps, the newest configTraceSize events are kept.
+ * Dump trace_buffer with the debugger and convert it on the host
+ * with tools/trace2json, the result opens in chrome://tracing or Perfetto.
+ */
+
+#ifndef configTraceSize
+#define configTraceSize     256         //events, a power of two
+#endif
+
+#ifndef configTraceClockHz
+#ifdef configSysTickClockHz
+#define configTraceClockHz  configSysTickClockHz    //cycle counter frequency, read by the converter
+#else
+#define configTraceClockHz  72000000
+#endif
+#endif
+
+#define TraceMagic      0x45435254      //"TRCE"
+
+//table uses the same values for its states, TableAdd passes State as it is
+#define TraceSwitch     0
+#define TraceReady      1
+#define TraceDelay      2
+#define TraceSuspend    3
+#define TraceBlock      4
+#define TraceIPCWait    5
+#define TraceIPCWake    6
+#define TraceISREnter   7
+#define TraceISRExit    8
+
+#define TraceTickISR    0xffff          //irq number recorded by the port tick handlers
+
+Class(TraceEvent)
+{
+    uint32_t timestamp;
+    uint32_t task;
+    uint32_t object;
+    uint8_t type;
+    uint8_t priority;
+    uint16_t reserved;
+};
+
+Class(TraceBuffer)
+{
+    uint32_t magic;
+    uint32_t size;
+    uint32_t ClockHz;
+    uint32_t index;             //events recorded so far, the next slot is index & (size - 1)
+    TraceEvent event[configTraceSize];
+};
+
+extern TraceBuffer trace_buffer;
+
+void TraceInit(void);
+void TraceRecord(uint8_t type, void *task, void *object, uint8_t priority);
+
+
+#if configTraceEnable
+
+#define trace_switch(task, priority)        TraceRecord(TraceSwitch, (task), NULL, (priority))
+#define trace_state(task, type, priority)   TraceRecord((type), (task), NULL, (priority))
+#define trace_ipc_wait(task, object)        TraceRecord(TraceIPCWait, (task), (object), 0)
+#define trace_ipc_wake(task, object)        TraceRecord(TraceIPCWake, (task), (object), 0)
+#define trace_isr_enter(irq)                TraceRecord(TraceISREnter, NULL, (void *)(uint32_t)(irq), 0)
+#define trace_isr_exit(irq)                 TraceRecord(TraceISRExit, NULL, (void *)(uint32_t)(irq), 0)
+
+#else
+
+#define trace_switch(task, priority)
+#define trace_state(task, type, priority)
+#define trace_ipc_wait(task, object)
+#define trace_ipc_wake(task, object)
+#define trace_isr_enter(irq)
+#define trace_isr_exit(irq)
+
+#endif
+
+
+#endif
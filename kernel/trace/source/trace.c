@@ -0,0 +1,63 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 skaiui2
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *  https://github.com/skaiui2/SKRTOS_sparrow
+ */
+
+#include "trace.h"
+#include "port.h"
+#include "atomic.h"
+
+#if configTraceEnable
+
+TraceBuffer trace_buffer;
+
+
+void TraceInit(void)
+{
+    CycleCounterInit();
+    trace_buffer.magic = TraceMagic;
+    trace_buffer.size = configTraceSize;
+    trace_buffer.ClockHz = configTraceClockHz;
+    trace_buffer.index = 0;
+}
+
+
+/*
+ * Lock free, so it can be called with interrupts masked or unmasked and from interrupts.
+ * A slot is claimed with one atomic add, an interrupt recording in between takes the next one.
+ */
+void TraceRecord(uint8_t type, void *task, void *object, uint8_t priority)
+{
+    uint32_t slot = ((uint32_t)atomic_add_return(1, &(trace_buffer.index)) - 1) & (configTraceSize - 1);
+
+    trace_buffer.event[slot] = (TraceEvent){
+            .timestamp = CycleCounterGet(),
+            .task = (uint32_t)task,
+            .object = (uint32_t)object,
+            .type = type,
+            .priority = priority,
+            .reserved = 0
+    };
+}
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef ART_H
+#define ART_H
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Adaptive radix tree over size_t indexes, with the API of radix.h.
+ * Nodes branch on one byte of the index, most significant first, and come in four
+ * sizes (4, 16, 48 and 256 children) that grow and shrink with their fanout.
+ * Bytes that every index below a node shares are skipped: a node records the byte
+ * it branches on and one index of its subtree to check them against, so sparse
+ * indexes cost no chains of one-child nodes. Items hang off the nodes that branch
+ * on the last byte and must not be NULL.
+ * Nodes come from heap_malloc, like radix.c's.
+ */
+
+#define ART_KEY_BYTES   ((uint8_t)sizeof(size_t))
+
+#define ART_NODE4       0
+#define ART_NODE16      1
+#define ART_NODE48      2
+#define ART_NODE256     3
+
+struct art_node {
+    size_t key;                     //an index below this node, its bytes above depth are the prefix
+    uint16_t count;                 //children
+    uint8_t type;
+    uint8_t depth;                  //byte of the index this node branches on, 0 the most significant
+};
+
+//keys sorted, child[i] goes with keys[i]
+struct art_node4 {
+    struct art_node head;
+    uint8_t keys[4];
+    void *child[4];
+};
+
+struct art_node16 {
+    struct art_node head;
+    uint8_t keys[16];
+    void *child[16];
+};
+
+//index[b] is 1 + the slot of byte b, 0 for none
+struct art_node48 {
+    struct art_node head;
+    uint8_t index[256];
+    void *child[48];
+};
+
+struct art_node256 {
+    struct art_node head;
+    void *child[256];
+};
+
+struct art_root {
+    struct art_node *rnode;
+    unsigned int count;             //nodes
+    size_t items;
+};
+
+void art_init(struct art_root *root);
+int art_insert(struct art_root *root, size_t index, void *item);
+void *art_lookup(struct art_root *root, size_t index);
+void *art_root_left(struct art_root *root);
+void *art_lookup_upper_bound(struct art_root *root, size_t index);
+void *art_delete(struct art_root *root, size_t index);
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef BPTREE_H
+#define BPTREE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * In-memory B+tree from uint64_t keys to void * values, an ordered index for
+ * sets too big for a red-black tree to stay in cache. A node holds BPTREE_KEYS
+ * sorted keys in its first two cache lines and is searched by counting the keys
+ * below the one looked for, all lanes at once (AVX2, AArch64 NEON, or a plain
+ * loop elsewhere). Values live only in the leaves, which are chained in key order
+ * for range iteration. Keys are unique, putting an existing key replaces its value.
+ */
+
+#define BPTREE_KEYS         16
+#define BPTREE_MIN_KEYS     (BPTREE_KEYS / 2)
+#define BPTREE_MAX_DEPTH    16
+#define BPTREE_CACHE_LINE   64
+
+//unused keys hold UINT64_MAX, so a search may count over all BPTREE_KEYS lanes
+struct bptree_node {
+    uint64_t keys[BPTREE_KEYS];
+    uint16_t count;
+    uint16_t leaf;
+};
+
+//child[i] holds the keys in [keys[i - 1], keys[i])
+struct bptree_inner {
+    struct bptree_node head;
+    struct bptree_node *child[BPTREE_KEYS + 1];
+} __attribute__((aligned(BPTREE_CACHE_LINE)));
+
+struct bptree_leaf {
+    struct bptree_node head;
+    void *value[BPTREE_KEYS];
+    struct bptree_leaf *prev;
+    struct bptree_leaf *next;
+} __attribute__((aligned(BPTREE_CACHE_LINE)));
+
+struct bptree {
+    struct bptree_node *root;
+    struct bptree_leaf *first;      //smallest and largest keys, both O(1)
+    struct bptree_leaf *last;
+    size_t count;
+    uint8_t height;                 //inner levels above the leaves
+};
+
+//a position in the leaf chain, invalid after the tree changes
+struct bptree_iter {
+    struct bptree_leaf *leaf;
+    uint16_t index;
+};
+
+void bptree_init(struct bptree *tree);
+void bptree_destroy(struct bptree *tree);
+int bptree_put(struct bptree *tree, uint64_t key, void *value);
+void *bptree_get(struct bptree *tree, uint64_t key);
+int bptree_remove(struct bptree *tree, uint64_t key);
+int bptree_bulk_load(struct bptree *tree, const uint64_t *keys, void *const *values, size_t n);
+
+int bptree_first(struct bptree *tree, struct bptree_iter *iter);
+int bptree_last(struct bptree *tree, struct bptree_iter *iter);
+int bptree_lower_bound(struct bptree *tree, uint64_t key, struct bptree_iter *iter);
+int bptree_next(struct bptree_iter *iter);
+int bptree_prev(struct bptree_iter *iter);
+
+static inline uint64_t bptree_iter_key(const struct bptree_iter *iter)
+{
+    return iter->leaf->head.keys[iter->index];
+}
+
+static inline void *bptree_iter_value(const struct bptree_iter *iter)
+{
+    return iter->leaf->value[iter->index];
+}
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef CHASHMAP_H
+#define CHASHMAP_H
+
+#include "hashmap.h"
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Concurrent hashmap for tables that are read a lot and changed rarely.
+ * Readers take no lock: they announce the epoch they read in, and a removed entry
+ * is only freed once every reader has moved past the epoch it was removed in.
+ * Writers lock one stripe of buckets. The stripe locks spin, on a single core
+ * writers of the same map must not preempt each other, e.g. update it from one task.
+ * The bucket count is fixed at init.
+ */
+
+#define CHASHMAP_CACHE_LINE 64
+
+struct chashmap_entry {
+    _Atomic(struct chashmap_entry *) next;
+    void *key;
+    _Atomic(void *) value;
+    uint32_t hash;
+    uint32_t len;
+    uword_t retired_epoch;
+    struct chashmap_entry *retired_next;
+};
+
+//one per reading task or thread, on its own cache line so readers never share one
+struct chashmap_reader {
+    _Atomic uword_t state;              //0 outside a lookup, else epoch << 1 | 1
+    struct chashmap_reader *next;
+} __attribute__((aligned(CHASHMAP_CACHE_LINE)));
+
+struct chashmap_stripe {
+    atomic_flag lock;
+} __attribute__((aligned(CHASHMAP_CACHE_LINE)));
+
+struct chashmap {
+    _Atomic(struct chashmap_entry *) *buckets;
+    uword_t bucket_count;
+    struct chashmap_stripe *stripes;
+    uword_t stripe_count;
+    int key_type;
+    _Atomic uword_t count;
+    struct hashmap_allocator allocator;
+
+    //reclaim_lock guards everything below
+    atomic_flag reclaim_lock;
+    _Atomic uword_t epoch;
+    struct chashmap_reader *readers;
+    struct chashmap_entry *retired;     //newest first
+    uword_t retired_count;
+};
+
+int chashmap_init(struct chashmap *map, size_t bucket_count, size_t stripe_count, int key_type,
+                  const struct hashmap_allocator *allocator);
+void chashmap_destroy(struct chashmap *map);
+void chashmap_reader_register(struct chashmap *map, struct chashmap_reader *reader);
+void chashmap_reader_unregister(struct chashmap *map, struct chashmap_reader *reader);
+void *chashmap_get(struct chashmap *map, struct chashmap_reader *reader, void *key);
+int chashmap_put(struct chashmap *map, void *key, void *value);
+int chashmap_remove(struct chashmap *map, void *key);
+void chashmap_reclaim(struct chashmap *map);
+
+#endif
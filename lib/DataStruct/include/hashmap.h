@@ -30,17 +30,65 @@ struct hashmap_entry {
     struct list_node node;
     void *key;
     void *value;
+    uint32_t hash;      //low bits of the key's hash, checked before the key itself
+    uint32_t len;       //string keys only
 };
 
+/*
+ * Where the map gets its buckets and entries. ctx is passed back to both calls,
+ * e.g. a memPool handle, or NULL for wrappers around heap_malloc/heap_free.
+ */
+struct hashmap_allocator {
+    void *(*alloc)(void *ctx, size_t size);
+    void (*free)(void *ctx, void *ptr);
+    void *ctx;
+};
+
+struct hashmap_slab;
+
+#define HASHMAP_MAX_LOAD      1    //entries per bucket before the table doubles
+#define HASHMAP_MIGRATE_STEP  4    //old buckets moved to the new table by each operation
+
+/*
+ * While the table grows both bucket arrays are live: old buckets below
+ * migrate_index have been moved, every other key is still in old_buckets.
+ */
 struct hashmap {
     struct list_node *buckets;
     uword_t bucket_count;
     int key_type;
+    uword_t count;
+    struct list_node *old_buckets;      //NULL when no resize is running
+    uword_t old_bucket_count;
+    uword_t migrate_index;
+    struct hashmap_allocator allocator;
+    uword_t slab_entries;               //0: one alloc per entry, otherwise entries are cut from slabs of this many
+    struct hashmap_slab *slabs;
+    struct hashmap_entry *slab_next;    //the uncut part of the newest slab
+    uword_t slab_left;
+    struct list_node *free_entries;     //removed slab entries, linked through node.next
+};
+
+struct hashmap_stats {
+    uword_t count;
+    uword_t bucket_count;
+    uword_t load;           //entries per bucket x 100
+    uword_t used_buckets;
+    uword_t max_chain;
+    int resizing;
 };
 
-void hashmap_init(struct hashmap *map, size_t bucket_count, int key_type);
-void hashmap_put(struct hashmap *map, void *key, void *value);
+int hashmap_init(struct hashmap *map, size_t bucket_count, int key_type);
+int hashmap_init_alloc(struct hashmap *map, size_t bucket_count, int key_type,
+                       const struct hashmap_allocator *allocator, size_t slab_entries);
+void hashmap_destroy(struct hashmap *map);
+int hashmap_put(struct hashmap *map, void *key, void *value);
 void *hashmap_get(struct hashmap *map, void *key);
 int hashmap_remove(struct hashmap *map, void *key);
+int hashmap_put_len(struct hashmap *map, const void *key, size_t len, void *value);
+void *hashmap_get_len(struct hashmap *map, const void *key, size_t len);
+int hashmap_remove_len(struct hashmap *map, const void *key, size_t len);
+uword_t hashmap_hash_bytes(const void *data, size_t len);
+void hashmap_stats(struct hashmap *map, struct hashmap_stats *stats);
 
 #endif
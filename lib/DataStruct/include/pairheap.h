@@ -0,0 +1,38 @@
+#ifndef PAIRHEAP_H
+#define PAIRHEAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Intrusive pairing heap, smallest value first: embed a pairheap_node like an
+ * rb_node and get back with container_of. Insert and decrease are O(1), pop and
+ * remove O(log n) amortized, the minimum is always the root.
+ * Equal values come out in no particular order.
+ */
+
+struct pairheap_node {
+    struct pairheap_node *child;    //leftmost child
+    struct pairheap_node *next;     //next sibling
+    struct pairheap_node *prev;     //previous sibling, the parent for a leftmost child
+    uint64_t value;
+};
+
+struct pairheap {
+    struct pairheap_node *root;
+    uint32_t count;
+};
+
+void pairheap_init(struct pairheap *heap);
+void pairheap_node_init(struct pairheap_node *node);
+void pairheap_insert(struct pairheap *heap, struct pairheap_node *node);
+struct pairheap_node *pairheap_pop(struct pairheap *heap);
+void pairheap_remove(struct pairheap *heap, struct pairheap_node *node);
+void pairheap_decrease(struct pairheap *heap, struct pairheap_node *node, uint64_t value);
+
+static inline struct pairheap_node *pairheap_min(struct pairheap *heap)
+{
+    return heap->root;
+}
+
+#endif
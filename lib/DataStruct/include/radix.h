@@ -10,13 +10,33 @@
 #define BIT_LEVEL   4
 #define SIZE_LEVEL  (1 << BIT_LEVEL)
 
+//tags mark items, e.g. dirty buffers or free blocks, and are found without visiting untagged ones
+#define RADIX_TREE_MAX_TAGS 2
 
+//one bit per slot
+#if BIT_LEVEL <= 4
+typedef uint16_t radix_tree_bitmap;
+#elif BIT_LEVEL == 5
+typedef uint32_t radix_tree_bitmap;
+#elif BIT_LEVEL == 6
+typedef uint64_t radix_tree_bitmap;
+#else
+#error "radix tree bitmaps hold at most 64 slots"
+#endif
+
+/*
+ * occupied has a bit for every non-NULL slot. tags[t] has a bit for every leaf slot
+ * whose item carries tag t, and for every inner slot whose subtree has one, so a
+ * search for a tag only descends where it will find one.
+ */
 struct radix_tree_node {
     void *slots[SIZE_LEVEL];
     struct radix_tree_node *parent;
     uint8_t offset;
     unsigned int count;
     unsigned int height;
+    radix_tree_bitmap occupied;
+    radix_tree_bitmap tags[RADIX_TREE_MAX_TAGS];
 };
 
 struct radix_tree_root {
@@ -34,6 +54,16 @@ void *radix_tree_root_left(struct radix_tree_root *root);
 void *radix_tree_lookup_upper_bound(struct radix_tree_root *root, size_t index);
 void *radix_tree_delete(struct radix_tree_root *root, size_t index);
 
+void *radix_tree_tag_set(struct radix_tree_root *root, size_t index, unsigned int tag);
+void *radix_tree_tag_clear(struct radix_tree_root *root, size_t index, unsigned int tag);
+int radix_tree_tag_get(struct radix_tree_root *root, size_t index, unsigned int tag);
+int radix_tree_tagged(struct radix_tree_root *root, unsigned int tag);
+unsigned int radix_tree_gang_lookup(struct radix_tree_root *root, void **results,
+                                    size_t first_index, unsigned int max_items);
+unsigned int radix_tree_gang_lookup_tag(struct radix_tree_root *root, void **results,
+                                        size_t first_index, unsigned int max_items, unsigned int tag);
+void *radix_tree_next_tag(struct radix_tree_root *root, size_t *index, unsigned int tag);
+
 
 
 
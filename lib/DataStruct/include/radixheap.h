@@ -0,0 +1,39 @@
+#ifndef RADIXHEAP_H
+#define RADIXHEAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Intrusive monotone radix heap for wake ticks and deadlines: no value below the
+ * last minimum may go in. A node sits in the bucket of the highest bit where its
+ * value differs from that minimum, so insert and remove are O(1) list operations
+ * and a node moves to a lower bucket at most 64 times in its life.
+ * Keys are 64 bit, a wrapping 32 bit tick count has to be widened first.
+ * Equal values come out in no particular order.
+ */
+
+#define RADIXHEAP_BUCKETS 65
+
+struct radixheap_node {
+    struct radixheap_node *next;
+    struct radixheap_node *prev;
+    uint64_t value;
+    uint8_t bucket;
+};
+
+struct radixheap {
+    struct radixheap_node *bucket[RADIXHEAP_BUCKETS];   //bucket 0 holds values equal to last
+    uint64_t last;                  //the last minimum found
+    uint64_t occupied;              //bit b - 1 set: bucket b is not empty
+    uint32_t count;
+};
+
+void radixheap_init(struct radixheap *heap, uint64_t start);
+void radixheap_node_init(struct radixheap_node *node);
+int radixheap_insert(struct radixheap *heap, struct radixheap_node *node);
+struct radixheap_node *radixheap_min(struct radixheap *heap);
+struct radixheap_node *radixheap_pop(struct radixheap *heap);
+void radixheap_remove(struct radixheap *heap, struct radixheap_node *node);
+
+#endif
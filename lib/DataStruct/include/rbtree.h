@@ -43,16 +43,46 @@ Class(rb_node)
     uint64_t value;
 };
 
+/*
+ * An augmented tree keeps an aggregate of every subtree in the struct that embeds
+ * its rb_node. update recomputes it for one node from the node and its children,
+ * the tree calls it on every node whose subtree changed shape.
+ */
+Class(rb_augment)
+{
+    void (*update)(rb_node *node);
+};
+
 Class(rb_root)
 {
     rb_node *rb_node;
     rb_node *first_node;
     rb_node *last_node;
     uint32_t count;
+    const rb_augment *augment;      //NULL for a plain tree
+};
+
+//order statistics: subtree node count, every node of the tree must be one
+Class(rb_size_node)
+{
+    rb_node node;
+    uint32_t size;
+};
+
+//interval [node.value, end], max_end is the largest end in the subtree
+Class(rb_interval_node)
+{
+    rb_node node;
+    uint64_t end;
+    uint64_t max_end;
 };
 
+extern const rb_augment rb_size_augment;
+extern const rb_augment rb_interval_augment;
+
 
 void rb_root_init(rb_root_handle root);
+void rb_root_init_augmented(rb_root_handle root, const rb_augment *augment);
 void rb_node_init(rb_node_handle node);
 void rb_Insert_node(rb_root_handle root,  rb_node_handle new_node);
 void rb_remove_node(rb_root_handle root,  rb_node_handle node);
@@ -67,6 +97,14 @@ rb_node_handle rb_first_greater(rb_root_handle root, size_t key);
 void rb_replace_node(rb_node_handle victim,  rb_node_handle new,
                       rb_root_handle root);
 
+//trees set up with rb_size_augment, k counts from 0
+rb_node_handle rb_select(rb_root_handle root, uint32_t k);
+uint32_t rb_rank(rb_node_handle node);
+
+//trees set up with rb_interval_augment: intervals overlapping [lo, hi] by ascending start
+rb_node_handle rb_interval_first(rb_root_handle root, uint64_t lo, uint64_t hi);
+rb_node_handle rb_interval_next(rb_node_handle node, uint64_t lo, uint64_t hi);
+
 
 
 
@@ -0,0 +1,37 @@
+#ifndef SWISSMAP_H
+#define SWISSMAP_H
+
+#include "hashmap.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Open addressing hashmap in the Swiss table layout: one control byte per slot,
+ * probed 16 at a time (SSE2, NEON, or a plain loop elsewhere). Entries live in the
+ * slot array itself, so put never allocates unless the table grows.
+ * Keys are HASHMAP_KEY_STRING/INT/PTR, compared the same way as struct hashmap.
+ */
+
+#define SWISSMAP_GROUP 16
+
+struct swissmap_slot {
+    void *key;
+    void *value;
+};
+
+struct swissmap {
+    int8_t *ctrl;                   //capacity control bytes, then the first SWISSMAP_GROUP - 1 again
+    struct swissmap_slot *slots;
+    uword_t capacity;               //power of two, at least SWISSMAP_GROUP
+    uword_t count;
+    uword_t growth_left;            //empty slots that may still be filled before the table grows
+    int key_type;
+};
+
+int swissmap_init(struct swissmap *map, size_t count, int key_type);
+void swissmap_destroy(struct swissmap *map);
+int swissmap_put(struct swissmap *map, void *key, void *value);
+void *swissmap_get(struct swissmap *map, void *key);
+int swissmap_remove(struct swissmap *map, void *key);
+
+#endif
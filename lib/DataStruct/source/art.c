@@ -0,0 +1,545 @@
+#include "art.h"
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+void *heap_malloc(size_t WantSize);
+void heap_free(void *xReturn);
+
+#define ART_LAST (ART_KEY_BYTES - 1)
+
+//below these counts a node moves down a size, a little under the next size's capacity
+#define ART_SHRINK16    3
+#define ART_SHRINK48    12
+#define ART_SHRINK256   36
+
+static const size_t art_node_size[4] = {
+        [ART_NODE4]   = sizeof(struct art_node4),
+        [ART_NODE16]  = sizeof(struct art_node16),
+        [ART_NODE48]  = sizeof(struct art_node48),
+        [ART_NODE256] = sizeof(struct art_node256)
+};
+
+static const uint16_t art_node_capacity[4] = {
+        [ART_NODE4]   = 4,
+        [ART_NODE16]  = 16,
+        [ART_NODE48]  = 48,
+        [ART_NODE256] = 256
+};
+
+static inline uint8_t art_byte(size_t index, uint8_t depth)
+{
+    return (uint8_t)(index >> ((ART_LAST - depth) * 8));
+}
+
+//index has the bytes above the node's depth that every index below it has
+static inline int art_prefix_match(const struct art_node *node, size_t index)
+{
+    if (node->depth == 0)
+        return 1;
+    return ((index ^ node->key) >> ((ART_KEY_BYTES - node->depth) * 8)) == 0;
+}
+
+//first byte two different indexes differ in
+static inline uint8_t art_mismatch(size_t a, size_t b)
+{
+#if SIZE_MAX > 0xffffffffu
+    return (uint8_t)(__builtin_clzll(a ^ b) / 8);
+#else
+    return (uint8_t)(__builtin_clz(a ^ b) / 8);
+#endif
+}
+
+static struct art_node *art_node_alloc(struct art_root *root, uint8_t type, uint8_t depth, size_t key)
+{
+    struct art_node *node = heap_malloc(art_node_size[type]);
+    if (node == NULL) {
+        return NULL;
+    }
+    memset(node, 0, art_node_size[type]);
+    node->key = key;
+    node->type = type;
+    node->depth = depth;
+    root->count++;
+    return node;
+}
+
+static void art_node_free(struct art_root *root, struct art_node *node)
+{
+    heap_free(node);
+    root->count--;
+}
+
+void art_init(struct art_root *root)
+{
+    *root = (struct art_root) {
+            .rnode = NULL,
+            .count = 0,
+            .items = 0
+    };
+}
+
+static inline int art_node16_find(const struct art_node16 *node, uint8_t byte)
+{
+#if defined(__SSE2__)
+    __m128i match = _mm_cmpeq_epi8(_mm_set1_epi8((char)byte), _mm_loadu_si128((const __m128i *)node->keys));
+    unsigned mask = (unsigned)_mm_movemask_epi8(match) & ((1u << node->head.count) - 1);
+    return mask ? __builtin_ctz(mask) : -1;
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    //narrowing each 16 bit lane by 4 leaves 4 bits per key byte in one 64 bit word
+    uint8x16_t match = vceqq_u8(vld1q_u8(node->keys), vdupq_n_u8(byte));
+    uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(match), 4)), 0);
+    if (node->head.count < 16)
+        mask &= (1ULL << (node->head.count * 4)) - 1;
+    return mask ? __builtin_ctzll(mask) / 4 : -1;
+#else
+    for (int i = 0; i < node->head.count; i++) {
+        if (node->keys[i] == byte)
+            return i;
+    }
+    return -1;
+#endif
+}
+
+static void **art_find_child(struct art_node *node, uint8_t byte)
+{
+    switch (node->type) {
+        case ART_NODE4: {
+            struct art_node4 *n = (struct art_node4 *)node;
+            for (uint8_t i = 0; i < node->count; i++) {
+                if (n->keys[i] == byte)
+                    return &n->child[i];
+            }
+            return NULL;
+        }
+        case ART_NODE16: {
+            struct art_node16 *n = (struct art_node16 *)node;
+            int i = art_node16_find(n, byte);
+            return (i < 0) ? NULL : &n->child[i];
+        }
+        case ART_NODE48: {
+            struct art_node48 *n = (struct art_node48 *)node;
+            return n->index[byte] ? &n->child[n->index[byte] - 1] : NULL;
+        }
+        default: {
+            struct art_node256 *n = (struct art_node256 *)node;
+            return n->child[byte] ? &n->child[byte] : NULL;
+        }
+    }
+}
+
+//child with the smallest byte not below from, from may be 256
+static void *art_child_from(struct art_node *node, unsigned from)
+{
+    switch (node->type) {
+        case ART_NODE4: {
+            struct art_node4 *n = (struct art_node4 *)node;
+            for (uint8_t i = 0; i < node->count; i++) {
+                if (n->keys[i] >= from)
+                    return n->child[i];
+            }
+            return NULL;
+        }
+        case ART_NODE16: {
+            struct art_node16 *n = (struct art_node16 *)node;
+            for (uint8_t i = 0; i < node->count; i++) {
+                if (n->keys[i] >= from)
+                    return n->child[i];
+            }
+            return NULL;
+        }
+        case ART_NODE48: {
+            struct art_node48 *n = (struct art_node48 *)node;
+            for (unsigned b = from; b < 256; b++) {
+                if (n->index[b])
+                    return n->child[n->index[b] - 1];
+            }
+            return NULL;
+        }
+        default: {
+            struct art_node256 *n = (struct art_node256 *)node;
+            for (unsigned b = from; b < 256; b++) {
+                if (n->child[b])
+                    return n->child[b];
+            }
+            return NULL;
+        }
+    }
+}
+
+//moves the children of node into a fresh node of another type, NULL if there is no memory
+static struct art_node *art_node_resize(struct art_root *root, struct art_node *node, uint8_t type)
+{
+    struct art_node *new_node = art_node_alloc(root, type, node->depth, node->key);
+    if (new_node == NULL) {
+        return NULL;
+    }
+
+    uint8_t keys[48];
+    void *child[48];
+    uint16_t count = 0;
+
+    //gather the children in byte order, then lay them out for the new type
+    switch (node->type) {
+        case ART_NODE4:
+            count = node->count;
+            memcpy(keys, ((struct art_node4 *)node)->keys, count);
+            memcpy(child, ((struct art_node4 *)node)->child, count * sizeof(void *));
+            break;
+        case ART_NODE16:
+            count = node->count;
+            memcpy(keys, ((struct art_node16 *)node)->keys, count);
+            memcpy(child, ((struct art_node16 *)node)->child, count * sizeof(void *));
+            break;
+        case ART_NODE48: {
+            struct art_node48 *n = (struct art_node48 *)node;
+            if (type == ART_NODE256) {
+                struct art_node256 *big = (struct art_node256 *)new_node;
+                for (unsigned b = 0; b < 256; b++) {
+                    if (n->index[b])
+                        big->child[b] = n->child[n->index[b] - 1];
+                }
+                new_node->count = node->count;
+                art_node_free(root, node);
+                return new_node;
+            }
+            for (unsigned b = 0; b < 256; b++) {
+                if (n->index[b]) {
+                    keys[count] = (uint8_t)b;
+                    child[count++] = n->child[n->index[b] - 1];
+                }
+            }
+            break;
+        }
+        default: {
+            struct art_node256 *n = (struct art_node256 *)node;
+            for (unsigned b = 0; b < 256; b++) {
+                if (n->child[b]) {
+                    keys[count] = (uint8_t)b;
+                    child[count++] = n->child[b];
+                }
+            }
+            break;
+        }
+    }
+
+    switch (type) {
+        case ART_NODE4:
+            memcpy(((struct art_node4 *)new_node)->keys, keys, count);
+            memcpy(((struct art_node4 *)new_node)->child, child, count * sizeof(void *));
+            break;
+        case ART_NODE16:
+            memcpy(((struct art_node16 *)new_node)->keys, keys, count);
+            memcpy(((struct art_node16 *)new_node)->child, child, count * sizeof(void *));
+            break;
+        default: {
+            struct art_node48 *n = (struct art_node48 *)new_node;
+            for (uint16_t i = 0; i < count; i++) {
+                n->index[keys[i]] = (uint8_t)(i + 1);
+                n->child[i] = child[i];
+            }
+            break;
+        }
+    }
+    new_node->count = count;
+    art_node_free(root, node);
+    return new_node;
+}
+
+static inline void art_sorted_insert(uint8_t *keys, void **child, uint16_t count, uint8_t byte, void *item)
+{
+    uint16_t i = count;
+    while ((i > 0) && (keys[i - 1] > byte)) {
+        keys[i] = keys[i - 1];
+        child[i] = child[i - 1];
+        i--;
+    }
+    keys[i] = byte;
+    child[i] = item;
+}
+
+//*ref is replaced when the node has to grow, -1 if there was no memory for it
+static int art_add_child(struct art_root *root, struct art_node **ref, uint8_t byte, void *item)
+{
+    struct art_node *node = *ref;
+
+    if (node->count == art_node_capacity[node->type]) {
+        node = art_node_resize(root, node, node->type + 1);
+        if (node == NULL) {
+            return -1;
+        }
+        *ref = node;
+    }
+
+    switch (node->type) {
+        case ART_NODE4:
+            art_sorted_insert(((struct art_node4 *)node)->keys, ((struct art_node4 *)node)->child,
+                              node->count, byte, item);
+            break;
+        case ART_NODE16:
+            art_sorted_insert(((struct art_node16 *)node)->keys, ((struct art_node16 *)node)->child,
+                              node->count, byte, item);
+            break;
+        case ART_NODE48: {
+            struct art_node48 *n = (struct art_node48 *)node;
+            uint8_t slot = 0;
+            while (n->child[slot]) {
+                slot++;
+            }
+            n->child[slot] = item;
+            n->index[byte] = slot + 1;
+            break;
+        }
+        default:
+            ((struct art_node256 *)node)->child[byte] = item;
+            break;
+    }
+    node->count++;
+    return 0;
+}
+
+//a shrink that finds no memory keeps the bigger node
+static void art_remove_child(struct art_root *root, struct art_node **ref, uint8_t byte)
+{
+    struct art_node *node = *ref;
+    uint8_t shrink = 0;
+
+    switch (node->type) {
+        case ART_NODE4:
+        case ART_NODE16: {
+            uint8_t *keys = (node->type == ART_NODE4) ? ((struct art_node4 *)node)->keys
+                                                      : ((struct art_node16 *)node)->keys;
+            void **child = (node->type == ART_NODE4) ? ((struct art_node4 *)node)->child
+                                                     : ((struct art_node16 *)node)->child;
+            uint16_t i = 0;
+            while (keys[i] != byte) {
+                i++;
+            }
+            for (; i + 1 < node->count; i++) {
+                keys[i] = keys[i + 1];
+                child[i] = child[i + 1];
+            }
+            shrink = (node->type == ART_NODE16) && (node->count - 1 <= ART_SHRINK16);
+            break;
+        }
+        case ART_NODE48: {
+            struct art_node48 *n = (struct art_node48 *)node;
+            n->child[n->index[byte] - 1] = NULL;
+            n->index[byte] = 0;
+            shrink = node->count - 1 <= ART_SHRINK48;
+            break;
+        }
+        default:
+            ((struct art_node256 *)node)->child[byte] = NULL;
+            shrink = node->count - 1 <= ART_SHRINK256;
+            break;
+    }
+    node->count--;
+
+    if (shrink) {
+        node = art_node_resize(root, node, node->type - 1);
+        if (node != NULL) {
+            *ref = node;
+        }
+    }
+}
+
+void *art_lookup(struct art_root *root, size_t index)
+{
+    struct art_node *node = root->rnode;
+
+    while (node != NULL) {
+        if (!art_prefix_match(node, index)) {
+            return NULL;
+        }
+        void **slot = art_find_child(node, art_byte(index, node->depth));
+        if (slot == NULL) {
+            return NULL;
+        }
+        if (node->depth == ART_LAST) {
+            return *slot;
+        }
+        node = *slot;
+    }
+    return NULL;
+}
+
+//a node on the last byte holding only item
+static struct art_node *art_leaf_node(struct art_root *root, size_t index, void *item)
+{
+    struct art_node *leaf = art_node_alloc(root, ART_NODE4, ART_LAST, index);
+    if (leaf == NULL) {
+        return NULL;
+    }
+    struct art_node4 *n = (struct art_node4 *)leaf;
+    n->keys[0] = art_byte(index, ART_LAST);
+    n->child[0] = item;
+    leaf->count = 1;
+    return leaf;
+}
+
+//-1 if index is already in the tree or there is no memory
+int art_insert(struct art_root *root, size_t index, void *item)
+{
+    struct art_node **ref = &root->rnode;
+
+    if (item == NULL) {
+        return -1;
+    }
+
+    while (*ref != NULL) {
+        struct art_node *node = *ref;
+
+        //index leaves the shared prefix: a new node branches where they part
+        if (!art_prefix_match(node, index)) {
+            uint8_t depth = art_mismatch(index, node->key);
+            struct art_node *split = art_node_alloc(root, ART_NODE4, depth, index);
+            struct art_node *leaf = art_leaf_node(root, index, item);
+            if ((split == NULL) || (leaf == NULL)) {
+                if (split != NULL)
+                    art_node_free(root, split);
+                if (leaf != NULL)
+                    art_node_free(root, leaf);
+                return -1;
+            }
+            art_add_child(root, &split, art_byte(node->key, depth), node);
+            art_add_child(root, &split, art_byte(index, depth), leaf);
+            *ref = split;
+            root->items++;
+            return 0;
+        }
+
+        uint8_t byte = art_byte(index, node->depth);
+        void **slot = art_find_child(node, byte);
+        if (slot != NULL) {
+            if (node->depth == ART_LAST) {
+                return -1;
+            }
+            ref = (struct art_node **)slot;
+            continue;
+        }
+
+        if (node->depth == ART_LAST) {
+            if (art_add_child(root, ref, byte, item) != 0) {
+                return -1;
+            }
+        } else {
+            struct art_node *leaf = art_leaf_node(root, index, item);
+            if (leaf == NULL) {
+                return -1;
+            }
+            if (art_add_child(root, ref, byte, leaf) != 0) {
+                art_node_free(root, leaf);
+                return -1;
+            }
+        }
+        root->items++;
+        return 0;
+    }
+
+    *ref = art_leaf_node(root, index, item);
+    if (*ref == NULL) {
+        return -1;
+    }
+    root->items++;
+    return 0;
+}
+
+static void *art_minimum(struct art_node *node)
+{
+    while (node->depth != ART_LAST) {
+        node = art_child_from(node, 0);
+    }
+    return art_child_from(node, 0);
+}
+
+void *art_root_left(struct art_root *root)
+{
+    return root->rnode ? art_minimum(root->rnode) : NULL;
+}
+
+//item of the smallest index not below index in the subtree of node
+static void *art_upper_bound(struct art_node *node, size_t index)
+{
+    if (node->depth > 0) {
+        uint8_t shift = (ART_KEY_BYTES - node->depth) * 8;
+        if ((node->key >> shift) > (index >> shift))
+            return art_minimum(node);
+        if ((node->key >> shift) < (index >> shift))
+            return NULL;
+    }
+
+    uint8_t byte = art_byte(index, node->depth);
+    void **slot = art_find_child(node, byte);
+    if (slot != NULL) {
+        if (node->depth == ART_LAST)
+            return *slot;
+        void *item = art_upper_bound(*slot, index);
+        if (item != NULL)
+            return item;
+    }
+
+    void *next = art_child_from(node, (unsigned)byte + 1);
+    if ((next == NULL) || (node->depth == ART_LAST))
+        return next;
+    return art_minimum(next);
+}
+
+void *art_lookup_upper_bound(struct art_root *root, size_t index)
+{
+    return root->rnode ? art_upper_bound(root->rnode, index) : NULL;
+}
+
+/*
+ * Nodes above the last byte always keep two children or more: one that drops to
+ * a single child is replaced by it, the child carries its own depth and prefix.
+ */
+void *art_delete(struct art_root *root, size_t index)
+{
+    struct art_node **path[ART_KEY_BYTES];
+    struct art_node **ref = &root->rnode;
+    uint8_t level = 0;
+
+    while (*ref != NULL) {
+        struct art_node *node = *ref;
+        if (!art_prefix_match(node, index)) {
+            return NULL;
+        }
+        uint8_t byte = art_byte(index, node->depth);
+        void **slot = art_find_child(node, byte);
+        if (slot == NULL) {
+            return NULL;
+        }
+        if (node->depth != ART_LAST) {
+            path[level++] = ref;
+            ref = (struct art_node **)slot;
+            continue;
+        }
+
+        void *item = *slot;
+        art_remove_child(root, ref, byte);
+        root->items--;
+        if ((*ref)->count > 0) {
+            return item;
+        }
+
+        art_node_free(root, *ref);
+        if (level == 0) {
+            root->rnode = NULL;
+            return item;
+        }
+        ref = path[level - 1];
+        art_remove_child(root, ref, art_byte(index, (*ref)->depth));
+        node = *ref;
+        if (node->count == 1) {
+            *ref = art_child_from(node, 0);
+            art_node_free(root, node);
+        }
+        return item;
+    }
+    return NULL;
+}
@@ -0,0 +1,605 @@
+#include "bptree.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#define BPTREE_EMPTY UINT64_MAX
+
+//an inner node on the way down and the child that was taken
+struct bptree_path {
+    struct bptree_inner *node;
+    unsigned index;
+};
+
+/*
+ * Keys below key in a node. The keys are sorted, so this is also where key goes,
+ * and the unused lanes never count: no branch depends on the keys.
+ */
+#if defined(__AVX2__)
+
+static inline unsigned bptree_count_less(const uint64_t *keys, uint64_t key)
+{
+    //AVX2 only compares signed: flip the sign bits to compare unsigned
+    const __m256i sign = _mm256_set1_epi64x((long long)0x8000000000000000ULL);
+    __m256i k = _mm256_xor_si256(_mm256_set1_epi64x((long long)key), sign);
+    unsigned mask = 0;
+    for (unsigned i = 0; i < BPTREE_KEYS; i += 4) {
+        __m256i v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(keys + i)), sign);
+        __m256i less = _mm256_cmpgt_epi64(k, v);
+        mask |= (unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(less)) << i;
+    }
+    return (unsigned)__builtin_popcount(mask);
+}
+
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+
+static inline unsigned bptree_count_less(const uint64_t *keys, uint64_t key)
+{
+    uint64x2_t k = vdupq_n_u64(key);
+    uint64x2_t sum = vdupq_n_u64(0);
+    //a matching lane is all ones, subtracting it adds one
+    for (unsigned i = 0; i < BPTREE_KEYS; i += 2) {
+        sum = vsubq_u64(sum, vcltq_u64(vld1q_u64(keys + i), k));
+    }
+    return (unsigned)vaddvq_u64(sum);
+}
+
+#else
+
+static inline unsigned bptree_count_less(const uint64_t *keys, uint64_t key)
+{
+    unsigned n = 0;
+    for (unsigned i = 0; i < BPTREE_KEYS; i++) {
+        n += keys[i] < key;
+    }
+    return n;
+}
+
+#endif
+
+//child of an inner node that holds key: the number of keys not above it
+static inline unsigned bptree_child_index(const struct bptree_node *node, uint64_t key)
+{
+    if (key == BPTREE_EMPTY)
+        return node->count;
+    return bptree_count_less(node->keys, key + 1);
+}
+
+static inline struct bptree_inner *bptree_inner_of(struct bptree_node *node)
+{
+    return (struct bptree_inner *)node;
+}
+
+static inline struct bptree_leaf *bptree_leaf_of(struct bptree_node *node)
+{
+    return (struct bptree_leaf *)node;
+}
+
+static inline void bptree_pad(struct bptree_node *node)
+{
+    for (unsigned i = node->count; i < BPTREE_KEYS; i++) {
+        node->keys[i] = BPTREE_EMPTY;
+    }
+}
+
+static struct bptree_node *bptree_alloc(int leaf)
+{
+    size_t size = leaf ? sizeof(struct bptree_leaf) : sizeof(struct bptree_inner);
+    struct bptree_node *node = aligned_alloc(BPTREE_CACHE_LINE, size);
+    if (node == NULL)
+        return NULL;
+    node->count = 0;
+    node->leaf = (uint16_t)leaf;
+    bptree_pad(node);
+    return node;
+}
+
+static void bptree_free(struct bptree_node *node, unsigned height)
+{
+    if (height > 0) {
+        struct bptree_inner *inner = bptree_inner_of(node);
+        for (unsigned i = 0; i <= node->count; i++) {
+            bptree_free(inner->child[i], height - 1);
+        }
+    }
+    free(node);
+}
+
+void bptree_init(struct bptree *tree)
+{
+    *tree = (struct bptree) {
+            .root = NULL,
+            .first = NULL,
+            .last = NULL,
+            .count = 0,
+            .height = 0
+    };
+}
+
+void bptree_destroy(struct bptree *tree)
+{
+    if (tree->root != NULL)
+        bptree_free(tree->root, tree->height);
+    bptree_init(tree);
+}
+
+static struct bptree_leaf *bptree_descend(struct bptree *tree, uint64_t key, struct bptree_path *path)
+{
+    struct bptree_node *node = tree->root;
+    for (unsigned d = 0; d < tree->height; d++) {
+        struct bptree_inner *inner = bptree_inner_of(node);
+        unsigned i = bptree_child_index(node, key);
+        if (path != NULL) {
+            path[d].node = inner;
+            path[d].index = i;
+        }
+        node = inner->child[i];
+    }
+    return bptree_leaf_of(node);
+}
+
+void *bptree_get(struct bptree *tree, uint64_t key)
+{
+    if (tree->root == NULL)
+        return NULL;
+    struct bptree_leaf *leaf = bptree_descend(tree, key, NULL);
+    unsigned i = bptree_count_less(leaf->head.keys, key);
+    if ((i < leaf->head.count) && (leaf->head.keys[i] == key))
+        return leaf->value[i];
+    return NULL;
+}
+
+static void bptree_leaf_insert(struct bptree_leaf *leaf, unsigned pos, uint64_t key, void *value)
+{
+    for (unsigned i = leaf->head.count; i > pos; i--) {
+        leaf->head.keys[i] = leaf->head.keys[i - 1];
+        leaf->value[i] = leaf->value[i - 1];
+    }
+    leaf->head.keys[pos] = key;
+    leaf->value[pos] = value;
+    leaf->head.count++;
+}
+
+static void bptree_leaf_erase(struct bptree_leaf *leaf, unsigned pos)
+{
+    for (unsigned i = pos + 1; i < leaf->head.count; i++) {
+        leaf->head.keys[i - 1] = leaf->head.keys[i];
+        leaf->value[i - 1] = leaf->value[i];
+    }
+    leaf->head.count--;
+    leaf->head.keys[leaf->head.count] = BPTREE_EMPTY;
+}
+
+//the upper half of a full leaf moves to right, which goes after it in the chain
+static void bptree_leaf_split(struct bptree *tree, struct bptree_leaf *leaf, struct bptree_leaf *right)
+{
+    unsigned half = BPTREE_KEYS / 2;
+    memcpy(right->head.keys, leaf->head.keys + half, (BPTREE_KEYS - half) * sizeof(uint64_t));
+    memcpy(right->value, leaf->value + half, (BPTREE_KEYS - half) * sizeof(void *));
+    right->head.count = BPTREE_KEYS - half;
+    leaf->head.count = half;
+    bptree_pad(&leaf->head);
+
+    right->prev = leaf;
+    right->next = leaf->next;
+    if (leaf->next != NULL)
+        leaf->next->prev = right;
+    else
+        tree->last = right;
+    leaf->next = right;
+}
+
+//key and the child right of it go in at index i
+static void bptree_inner_insert(struct bptree_inner *node, unsigned i, uint64_t key, struct bptree_node *child)
+{
+    unsigned move = node->head.count - i;
+    memmove(node->head.keys + i + 1, node->head.keys + i, move * sizeof(uint64_t));
+    memmove(node->child + i + 2, node->child + i + 1, move * sizeof(node->child[0]));
+    node->head.keys[i] = key;
+    node->child[i + 1] = child;
+    node->head.count++;
+}
+
+//key i and the child right of it go
+static void bptree_inner_erase(struct bptree_inner *node, unsigned i)
+{
+    unsigned move = node->head.count - i - 1;
+    memmove(node->head.keys + i, node->head.keys + i + 1, move * sizeof(uint64_t));
+    memmove(node->child + i + 1, node->child + i + 2, move * sizeof(node->child[0]));
+    node->head.count--;
+    node->head.keys[node->head.count] = BPTREE_EMPTY;
+}
+
+//inserts into a full node by splitting it with sibling, returns the key that moves up
+static uint64_t bptree_inner_split(struct bptree_inner *node, struct bptree_inner *sibling,
+                                   unsigned i, uint64_t key, struct bptree_node *child)
+{
+    uint64_t keys[BPTREE_KEYS + 1];
+    struct bptree_node *children[BPTREE_KEYS + 2];
+    unsigned mid = (BPTREE_KEYS + 1) / 2;
+
+    memcpy(keys, node->head.keys, i * sizeof(uint64_t));
+    keys[i] = key;
+    memcpy(keys + i + 1, node->head.keys + i, (BPTREE_KEYS - i) * sizeof(uint64_t));
+    memcpy(children, node->child, (i + 1) * sizeof(children[0]));
+    children[i + 1] = child;
+    memcpy(children + i + 2, node->child + i + 1, (BPTREE_KEYS - i) * sizeof(children[0]));
+
+    memcpy(node->head.keys, keys, mid * sizeof(uint64_t));
+    memcpy(node->child, children, (mid + 1) * sizeof(children[0]));
+    node->head.count = mid;
+    bptree_pad(&node->head);
+
+    memcpy(sibling->head.keys, keys + mid + 1, (BPTREE_KEYS - mid) * sizeof(uint64_t));
+    memcpy(sibling->child, children + mid + 1, (BPTREE_KEYS - mid + 1) * sizeof(children[0]));
+    sibling->head.count = BPTREE_KEYS - mid;
+    return keys[mid];
+}
+
+//-1 when no memory for a new node was left, the tree is unchanged then
+int bptree_put(struct bptree *tree, uint64_t key, void *value)
+{
+    struct bptree_path path[BPTREE_MAX_DEPTH];
+
+    if (tree->root == NULL) {
+        struct bptree_leaf *leaf = bptree_leaf_of(bptree_alloc(1));
+        if (leaf == NULL)
+            return -1;
+        leaf->prev = NULL;
+        leaf->next = NULL;
+        tree->root = &leaf->head;
+        tree->first = leaf;
+        tree->last = leaf;
+        tree->height = 0;
+    }
+
+    struct bptree_leaf *leaf = bptree_descend(tree, key, path);
+    unsigned pos = bptree_count_less(leaf->head.keys, key);
+    if ((pos < leaf->head.count) && (leaf->head.keys[pos] == key)) {
+        leaf->value[pos] = value;
+        return 0;
+    }
+    if (leaf->head.count < BPTREE_KEYS) {
+        bptree_leaf_insert(leaf, pos, key, value);
+        tree->count++;
+        return 0;
+    }
+
+    //every node the splits will use is taken up front, so a failed allocation changes nothing
+    struct bptree_node *spare[BPTREE_MAX_DEPTH + 2];
+    unsigned need = 1;
+    int d = (int)tree->height - 1;
+    while ((d >= 0) && (path[d].node->head.count == BPTREE_KEYS)) {
+        need++;
+        d--;
+    }
+    if (d < 0) {
+        if (tree->height == BPTREE_MAX_DEPTH)
+            return -1;
+        need++;
+    }
+    for (unsigned s = 0; s < need; s++) {
+        spare[s] = bptree_alloc(s == 0);
+        if (spare[s] == NULL) {
+            while (s > 0)
+                free(spare[--s]);
+            return -1;
+        }
+    }
+
+    struct bptree_leaf *right = bptree_leaf_of(spare[0]);
+    bptree_leaf_split(tree, leaf, right);
+    if (pos <= BPTREE_KEYS / 2)
+        bptree_leaf_insert(leaf, pos, key, value);
+    else
+        bptree_leaf_insert(right, pos - BPTREE_KEYS / 2, key, value);
+    tree->count++;
+
+    uint64_t up = right->head.keys[0];
+    struct bptree_node *child = &right->head;
+    unsigned s = 1;
+    for (d = (int)tree->height - 1; d >= 0; d--) {
+        struct bptree_inner *parent = path[d].node;
+        if (parent->head.count < BPTREE_KEYS) {
+            bptree_inner_insert(parent, path[d].index, up, child);
+            return 0;
+        }
+        struct bptree_inner *sibling = bptree_inner_of(spare[s++]);
+        up = bptree_inner_split(parent, sibling, path[d].index, up, child);
+        child = &sibling->head;
+    }
+
+    //the root split too: the tree grows a level
+    struct bptree_inner *root = bptree_inner_of(spare[s]);
+    root->head.keys[0] = up;
+    root->head.count = 1;
+    root->child[0] = tree->root;
+    root->child[1] = child;
+    tree->root = &root->head;
+    tree->height++;
+    return 0;
+}
+
+static void bptree_leaf_merge(struct bptree *tree, struct bptree_leaf *left, struct bptree_leaf *right)
+{
+    memcpy(left->head.keys + left->head.count, right->head.keys, right->head.count * sizeof(uint64_t));
+    memcpy(left->value + left->head.count, right->value, right->head.count * sizeof(void *));
+    left->head.count += right->head.count;
+
+    left->next = right->next;
+    if (right->next != NULL)
+        right->next->prev = left;
+    else
+        tree->last = left;
+    free(right);
+}
+
+//a leaf fell below BPTREE_MIN_KEYS: borrow from a sibling, or merge with one
+static void bptree_leaf_rebalance(struct bptree *tree, struct bptree_leaf *leaf, struct bptree_path *up)
+{
+    struct bptree_inner *parent = up->node;
+    unsigned i = up->index;
+    struct bptree_leaf *left = (i > 0) ? bptree_leaf_of(parent->child[i - 1]) : NULL;
+    struct bptree_leaf *right = (i < parent->head.count) ? bptree_leaf_of(parent->child[i + 1]) : NULL;
+
+    if ((left != NULL) && (left->head.count > BPTREE_MIN_KEYS)) {
+        unsigned last = left->head.count - 1;
+        bptree_leaf_insert(leaf, 0, left->head.keys[last], left->value[last]);
+        bptree_leaf_erase(left, last);
+        parent->head.keys[i - 1] = leaf->head.keys[0];
+    } else if ((right != NULL) && (right->head.count > BPTREE_MIN_KEYS)) {
+        bptree_leaf_insert(leaf, leaf->head.count, right->head.keys[0], right->value[0]);
+        bptree_leaf_erase(right, 0);
+        parent->head.keys[i] = right->head.keys[0];
+    } else if (left != NULL) {
+        bptree_leaf_merge(tree, left, leaf);
+        bptree_inner_erase(parent, i - 1);
+    } else {
+        bptree_leaf_merge(tree, leaf, right);
+        bptree_inner_erase(parent, i);
+    }
+}
+
+static void bptree_inner_merge(struct bptree_inner *left, uint64_t key, struct bptree_inner *right)
+{
+    unsigned count = left->head.count;
+    left->head.keys[count] = key;
+    memcpy(left->head.keys + count + 1, right->head.keys, right->head.count * sizeof(uint64_t));
+    memcpy(left->child + count + 1, right->child, (right->head.count + 1) * sizeof(left->child[0]));
+    left->head.count += right->head.count + 1;
+    free(right);
+}
+
+//same for an inner node, keys rotate through the parent
+static void bptree_inner_rebalance(struct bptree_inner *node, struct bptree_path *up)
+{
+    struct bptree_inner *parent = up->node;
+    unsigned i = up->index;
+    struct bptree_inner *left = (i > 0) ? bptree_inner_of(parent->child[i - 1]) : NULL;
+    struct bptree_inner *right = (i < parent->head.count) ? bptree_inner_of(parent->child[i + 1]) : NULL;
+    unsigned count = node->head.count;
+
+    if ((left != NULL) && (left->head.count > BPTREE_MIN_KEYS)) {
+        unsigned last = left->head.count;
+        memmove(node->head.keys + 1, node->head.keys, count * sizeof(uint64_t));
+        memmove(node->child + 1, node->child, (count + 1) * sizeof(node->child[0]));
+        node->head.keys[0] = parent->head.keys[i - 1];
+        node->child[0] = left->child[last];
+        node->head.count++;
+        parent->head.keys[i - 1] = left->head.keys[last - 1];
+        left->head.count--;
+        left->head.keys[last - 1] = BPTREE_EMPTY;
+    } else if ((right != NULL) && (right->head.count > BPTREE_MIN_KEYS)) {
+        unsigned rest = right->head.count - 1;
+        node->head.keys[count] = parent->head.keys[i];
+        node->child[count + 1] = right->child[0];
+        node->head.count++;
+        parent->head.keys[i] = right->head.keys[0];
+        memmove(right->head.keys, right->head.keys + 1, rest * sizeof(uint64_t));
+        memmove(right->child, right->child + 1, (rest + 1) * sizeof(right->child[0]));
+        right->head.count--;
+        right->head.keys[rest] = BPTREE_EMPTY;
+    } else if (left != NULL) {
+        bptree_inner_merge(left, parent->head.keys[i - 1], node);
+        bptree_inner_erase(parent, i - 1);
+    } else {
+        bptree_inner_merge(node, parent->head.keys[i], right);
+        bptree_inner_erase(parent, i);
+    }
+}
+
+/*
+ * The separators above a leaf may go stale: they still split the keys correctly,
+ * so only nodes that fall below half full are touched on the way back up.
+ */
+int bptree_remove(struct bptree *tree, uint64_t key)
+{
+    struct bptree_path path[BPTREE_MAX_DEPTH];
+
+    if (tree->root == NULL)
+        return 0;
+    struct bptree_leaf *leaf = bptree_descend(tree, key, path);
+    unsigned pos = bptree_count_less(leaf->head.keys, key);
+    if ((pos == leaf->head.count) || (leaf->head.keys[pos] != key))
+        return 0;
+
+    bptree_leaf_erase(leaf, pos);
+    tree->count--;
+
+    if (tree->height == 0) {
+        if (leaf->head.count == 0) {
+            free(leaf);
+            bptree_init(tree);
+        }
+        return 1;
+    }
+    if (leaf->head.count >= BPTREE_MIN_KEYS)
+        return 1;
+
+    bptree_leaf_rebalance(tree, leaf, &path[tree->height - 1]);
+    for (int d = (int)tree->height - 1; d > 0; d--) {
+        if (path[d].node->head.count >= BPTREE_MIN_KEYS)
+            return 1;
+        bptree_inner_rebalance(path[d].node, &path[d - 1]);
+    }
+
+    struct bptree_inner *root = bptree_inner_of(tree->root);
+    if (root->head.count == 0) {
+        tree->root = root->child[0];
+        tree->height--;
+        free(root);
+    }
+    return 1;
+}
+
+/*
+ * Builds the tree bottom up from strictly ascending keys, -1 if they are not,
+ * if the tree isn't empty or if memory runs out. Each level is spread evenly
+ * over as few nodes as hold it, so all nodes are at least half full.
+ */
+int bptree_bulk_load(struct bptree *tree, const uint64_t *keys, void *const *values, size_t n)
+{
+    if (tree->root != NULL)
+        return -1;
+    if (n == 0)
+        return 0;
+    for (size_t i = 1; i < n; i++) {
+        if (keys[i] <= keys[i - 1])
+            return -1;
+    }
+
+    size_t leaves = (n + BPTREE_KEYS - 1) / BPTREE_KEYS;
+    size_t total = leaves;
+    uint8_t height = 0;
+    for (size_t nodes = leaves; nodes > 1; height++) {
+        if (height == BPTREE_MAX_DEPTH)
+            return -1;
+        nodes = (nodes + BPTREE_KEYS) / (BPTREE_KEYS + 1);
+        total += nodes;
+    }
+
+    struct bptree_node **pool = malloc(total * sizeof(*pool));
+    struct bptree_node **level = malloc(leaves * sizeof(*level));
+    uint64_t *low = malloc(leaves * sizeof(*low));     //smallest key under each node of level
+    size_t got = 0;
+    if ((pool != NULL) && (level != NULL) && (low != NULL)) {
+        while ((got < total) && ((pool[got] = bptree_alloc(got < leaves)) != NULL))
+            got++;
+    }
+    if (got < total) {
+        while (got > 0)
+            free(pool[--got]);
+        free(pool);
+        free(level);
+        free(low);
+        return -1;
+    }
+
+    struct bptree_leaf *prev = NULL;
+    size_t at = 0;
+    for (size_t j = 0; j < leaves; j++) {
+        struct bptree_leaf *leaf = bptree_leaf_of(pool[j]);
+        unsigned take = (unsigned)(n / leaves + (j < n % leaves));
+        memcpy(leaf->head.keys, keys + at, take * sizeof(uint64_t));
+        memcpy(leaf->value, values + at, take * sizeof(void *));
+        leaf->head.count = (uint16_t)take;
+        leaf->prev = prev;
+        leaf->next = NULL;
+        if (prev != NULL)
+            prev->next = leaf;
+        else
+            tree->first = leaf;
+        prev = leaf;
+        level[j] = &leaf->head;
+        low[j] = keys[at];
+        at += take;
+    }
+    tree->last = prev;
+
+    //each level is written over the one below, node j only reads entries at or after j
+    size_t used = leaves;
+    for (size_t nodes = leaves; nodes > 1;) {
+        size_t parents = (nodes + BPTREE_KEYS) / (BPTREE_KEYS + 1);
+        at = 0;
+        for (size_t j = 0; j < parents; j++) {
+            struct bptree_inner *inner = bptree_inner_of(pool[used++]);
+            unsigned take = (unsigned)(nodes / parents + (j < nodes % parents));
+            for (unsigned c = 0; c < take; c++) {
+                inner->child[c] = level[at + c];
+                if (c > 0)
+                    inner->head.keys[c - 1] = low[at + c];
+            }
+            inner->head.count = (uint16_t)(take - 1);
+            level[j] = &inner->head;
+            low[j] = low[at];
+            at += take;
+        }
+        nodes = parents;
+    }
+
+    tree->root = level[0];
+    tree->count = n;
+    tree->height = height;
+    free(pool);
+    free(level);
+    free(low);
+    return 0;
+}
+
+int bptree_first(struct bptree *tree, struct bptree_iter *iter)
+{
+    iter->leaf = tree->first;
+    iter->index = 0;
+    return iter->leaf != NULL;
+}
+
+int bptree_last(struct bptree *tree, struct bptree_iter *iter)
+{
+    iter->leaf = tree->last;
+    iter->index = (iter->leaf != NULL) ? iter->leaf->head.count - 1 : 0;
+    return iter->leaf != NULL;
+}
+
+//first key not below key
+int bptree_lower_bound(struct bptree *tree, uint64_t key, struct bptree_iter *iter)
+{
+    iter->leaf = NULL;
+    if (tree->root == NULL)
+        return 0;
+    struct bptree_leaf *leaf = bptree_descend(tree, key, NULL);
+    unsigned i = bptree_count_less(leaf->head.keys, key);
+    if (i == leaf->head.count) {
+        leaf = leaf->next;
+        i = 0;
+    }
+    iter->leaf = leaf;
+    iter->index = (uint16_t)i;
+    return leaf != NULL;
+}
+
+int bptree_next(struct bptree_iter *iter)
+{
+    if (++iter->index < iter->leaf->head.count)
+        return 1;
+    iter->leaf = iter->leaf->next;
+    iter->index = 0;
+    return iter->leaf != NULL;
+}
+
+int bptree_prev(struct bptree_iter *iter)
+{
+    if (iter->index > 0) {
+        iter->index--;
+        return 1;
+    }
+    iter->leaf = iter->leaf->prev;
+    if (iter->leaf == NULL)
+        return 0;
+    iter->index = iter->leaf->head.count - 1;
+    return 1;
+}
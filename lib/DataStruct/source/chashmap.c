@@ -0,0 +1,315 @@
+#include "chashmap.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define CHASHMAP_RECLAIM_BATCH 32    //retired entries before a remove tries to free them
+
+static void *chashmap_malloc(void *ctx, size_t size)
+{
+    (void)ctx;
+    return malloc(size);
+}
+
+static void chashmap_free(void *ctx, void *ptr)
+{
+    (void)ctx;
+    free(ptr);
+}
+
+static inline void *chashmap_alloc(struct chashmap *map, size_t size)
+{
+    return map->allocator.alloc(map->allocator.ctx, size);
+}
+
+static inline void chashmap_release(struct chashmap *map, void *ptr)
+{
+    map->allocator.free(map->allocator.ctx, ptr);
+}
+
+static inline void chashmap_lock(atomic_flag *lock)
+{
+    while (atomic_flag_test_and_set_explicit(lock, memory_order_acquire)) {
+    }
+}
+
+static inline void chashmap_unlock(atomic_flag *lock)
+{
+    atomic_flag_clear_explicit(lock, memory_order_release);
+}
+
+static uword_t chashmap_hash(struct chashmap *map, void *key, size_t len)
+{
+    if (map->key_type == HASHMAP_KEY_STRING)
+        return hashmap_hash_bytes(key, len);
+    uword_t h = (uword_t)key * GOLDEN_RATIO_PRIME;
+    return h ^ (h >> (PLATFORM_BITS / 2));
+}
+
+static inline size_t chashmap_key_len(struct chashmap *map, void *key)
+{
+    return map->key_type == HASHMAP_KEY_STRING ? strlen((char *)key) : 0;
+}
+
+static inline int chashmap_key_equal(struct chashmap *map, struct chashmap_entry *e,
+                                     void *key, size_t len, uint32_t hash)
+{
+    if (e->hash != hash)
+        return 0;
+    if (e->key == key)
+        return 1;
+    return (map->key_type == HASHMAP_KEY_STRING) && (e->len == len) && (memcmp(e->key, key, len) == 0);
+}
+
+static inline _Atomic(struct chashmap_entry *) *chashmap_bucket(struct chashmap *map, uword_t h)
+{
+    return &map->buckets[h & (map->bucket_count - 1)];
+}
+
+static inline atomic_flag *chashmap_stripe(struct chashmap *map, uword_t h)
+{
+    return &map->stripes[h & (map->stripe_count - 1)].lock;
+}
+
+int chashmap_init(struct chashmap *map, size_t bucket_count, size_t stripe_count, int key_type,
+                  const struct hashmap_allocator *allocator)
+{
+    uword_t buckets = 1;
+    uword_t stripes = 1;
+    while (buckets < bucket_count)
+        buckets <<= 1;
+    while ((stripes < stripe_count) && (stripes < buckets))
+        stripes <<= 1;
+
+    map->allocator = allocator ? *allocator : (struct hashmap_allocator) {
+            .alloc = chashmap_malloc,
+            .free = chashmap_free,
+            .ctx = NULL
+    };
+    map->bucket_count = buckets;
+    map->stripe_count = stripes;
+    map->key_type = key_type;
+    atomic_init(&map->count, 0);
+    atomic_flag_clear(&map->reclaim_lock);
+    atomic_init(&map->epoch, 1);
+    map->readers = NULL;
+    map->retired = NULL;
+    map->retired_count = 0;
+
+    map->buckets = chashmap_alloc(map, sizeof(*map->buckets) * buckets);
+    map->stripes = chashmap_alloc(map, sizeof(struct chashmap_stripe) * stripes);
+    if ((map->buckets == NULL) || (map->stripes == NULL)) {
+        if (map->buckets != NULL)
+            chashmap_release(map, map->buckets);
+        if (map->stripes != NULL)
+            chashmap_release(map, map->stripes);
+        return -1;
+    }
+    for (uword_t i = 0; i < buckets; i++)
+        atomic_init(&map->buckets[i], NULL);
+    for (uword_t i = 0; i < stripes; i++)
+        atomic_flag_clear(&map->stripes[i].lock);
+    return 0;
+}
+
+//no reader may be inside chashmap_get any more
+void chashmap_destroy(struct chashmap *map)
+{
+    for (uword_t i = 0; i < map->bucket_count; i++) {
+        struct chashmap_entry *e = atomic_load_explicit(&map->buckets[i], memory_order_relaxed);
+        while (e != NULL) {
+            struct chashmap_entry *next = atomic_load_explicit(&e->next, memory_order_relaxed);
+            chashmap_release(map, e);
+            e = next;
+        }
+    }
+    while (map->retired != NULL) {
+        struct chashmap_entry *e = map->retired;
+        map->retired = e->retired_next;
+        chashmap_release(map, e);
+    }
+    chashmap_release(map, map->buckets);
+    chashmap_release(map, map->stripes);
+    map->buckets = NULL;
+    map->stripes = NULL;
+}
+
+void chashmap_reader_register(struct chashmap *map, struct chashmap_reader *reader)
+{
+    atomic_init(&reader->state, 0);
+    chashmap_lock(&map->reclaim_lock);
+    reader->next = map->readers;
+    map->readers = reader;
+    chashmap_unlock(&map->reclaim_lock);
+}
+
+void chashmap_reader_unregister(struct chashmap *map, struct chashmap_reader *reader)
+{
+    chashmap_lock(&map->reclaim_lock);
+    struct chashmap_reader **link = &map->readers;
+    while ((*link != NULL) && (*link != reader))
+        link = &(*link)->next;
+    if (*link != NULL)
+        *link = reader->next;
+    chashmap_unlock(&map->reclaim_lock);
+}
+
+/*
+ * The epoch has to be published before the first bucket is read, and a writer
+ * may advance it in between: read it again and republish until both agree.
+ */
+static inline void chashmap_read_enter(struct chashmap *map, struct chashmap_reader *reader)
+{
+    uword_t epoch;
+    do {
+        epoch = atomic_load(&map->epoch);
+        atomic_store_explicit(&reader->state, (epoch << 1) | 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+    } while (atomic_load(&map->epoch) != epoch);
+}
+
+static inline void chashmap_read_exit(struct chashmap_reader *reader)
+{
+    atomic_store_explicit(&reader->state, 0, memory_order_release);
+}
+
+static struct chashmap_entry *chashmap_find(struct chashmap *map, uword_t h, void *key, size_t len)
+{
+    struct chashmap_entry *e = atomic_load_explicit(chashmap_bucket(map, h), memory_order_acquire);
+    while (e != NULL) {
+        if (chashmap_key_equal(map, e, key, len, (uint32_t)h))
+            return e;
+        e = atomic_load_explicit(&e->next, memory_order_acquire);
+    }
+    return NULL;
+}
+
+//a NULL reader is allowed, the lookup then holds the stripe lock instead
+void *chashmap_get(struct chashmap *map, struct chashmap_reader *reader, void *key)
+{
+    size_t len = chashmap_key_len(map, key);
+    uword_t h = chashmap_hash(map, key, len);
+    void *value = NULL;
+
+    if (reader == NULL) {
+        atomic_flag *stripe = chashmap_stripe(map, h);
+        chashmap_lock(stripe);
+        struct chashmap_entry *e = chashmap_find(map, h, key, len);
+        if (e != NULL)
+            value = atomic_load_explicit(&e->value, memory_order_relaxed);
+        chashmap_unlock(stripe);
+        return value;
+    }
+
+    chashmap_read_enter(map, reader);
+    struct chashmap_entry *e = chashmap_find(map, h, key, len);
+    if (e != NULL)
+        value = atomic_load_explicit(&e->value, memory_order_acquire);
+    chashmap_read_exit(reader);
+    return value;
+}
+
+//-1 when no memory for a new entry was left
+int chashmap_put(struct chashmap *map, void *key, void *value)
+{
+    size_t len = chashmap_key_len(map, key);
+    uword_t h = chashmap_hash(map, key, len);
+    atomic_flag *stripe = chashmap_stripe(map, h);
+
+    chashmap_lock(stripe);
+    struct chashmap_entry *e = chashmap_find(map, h, key, len);
+    if (e != NULL) {
+        atomic_store_explicit(&e->value, value, memory_order_release);
+        chashmap_unlock(stripe);
+        return 0;
+    }
+
+    e = chashmap_alloc(map, sizeof(struct chashmap_entry));
+    if (e == NULL) {
+        chashmap_unlock(stripe);
+        return -1;
+    }
+    _Atomic(struct chashmap_entry *) *bucket = chashmap_bucket(map, h);
+    e->key = key;
+    e->hash = (uint32_t)h;
+    e->len = (uint32_t)len;
+    atomic_init(&e->value, value);
+    atomic_init(&e->next, atomic_load_explicit(bucket, memory_order_relaxed));
+    //readers see the entry only once it is complete
+    atomic_store_explicit(bucket, e, memory_order_release);
+    atomic_fetch_add_explicit(&map->count, 1, memory_order_relaxed);
+    chashmap_unlock(stripe);
+    return 0;
+}
+
+/*
+ * Entries retired in epoch e are unreachable for readers that entered after it.
+ * The epoch only moves on once every active reader has seen the current one,
+ * so when it reaches e + 2 nobody can still hold such an entry.
+ * Caller holds reclaim_lock.
+ */
+static void chashmap_reclaim_locked(struct chashmap *map)
+{
+    uword_t epoch = atomic_load(&map->epoch);
+    int advance = 1;
+    for (struct chashmap_reader *r = map->readers; r != NULL; r = r->next) {
+        uword_t state = atomic_load(&r->state);
+        if ((state & 1) && ((state >> 1) != epoch)) {
+            advance = 0;
+            break;
+        }
+    }
+    if (advance)
+        atomic_store(&map->epoch, ++epoch);
+
+    //the list is newest first: cut it at the first entry old enough
+    struct chashmap_entry **link = &map->retired;
+    while ((*link != NULL) && ((*link)->retired_epoch + 2 > epoch))
+        link = &(*link)->retired_next;
+    struct chashmap_entry *e = *link;
+    *link = NULL;
+    while (e != NULL) {
+        struct chashmap_entry *next = e->retired_next;
+        chashmap_release(map, e);
+        map->retired_count--;
+        e = next;
+    }
+}
+
+void chashmap_reclaim(struct chashmap *map)
+{
+    chashmap_lock(&map->reclaim_lock);
+    chashmap_reclaim_locked(map);
+    chashmap_unlock(&map->reclaim_lock);
+}
+
+int chashmap_remove(struct chashmap *map, void *key)
+{
+    size_t len = chashmap_key_len(map, key);
+    uword_t h = chashmap_hash(map, key, len);
+    atomic_flag *stripe = chashmap_stripe(map, h);
+
+    chashmap_lock(stripe);
+    _Atomic(struct chashmap_entry *) *link = chashmap_bucket(map, h);
+    struct chashmap_entry *e = atomic_load_explicit(link, memory_order_relaxed);
+    while ((e != NULL) && !chashmap_key_equal(map, e, key, len, (uint32_t)h)) {
+        link = &e->next;
+        e = atomic_load_explicit(link, memory_order_relaxed);
+    }
+    if (e == NULL) {
+        chashmap_unlock(stripe);
+        return 0;
+    }
+    //e->next stays valid for readers still standing on e
+    atomic_store_explicit(link, atomic_load_explicit(&e->next, memory_order_relaxed), memory_order_release);
+    atomic_fetch_sub_explicit(&map->count, 1, memory_order_relaxed);
+    chashmap_unlock(stripe);
+
+    chashmap_lock(&map->reclaim_lock);
+    e->retired_epoch = atomic_load(&map->epoch);
+    e->retired_next = map->retired;
+    map->retired = e;
+    if (++map->retired_count >= CHASHMAP_RECLAIM_BATCH)
+        chashmap_reclaim_locked(map);
+    chashmap_unlock(&map->reclaim_lock);
+    return 1;
+}
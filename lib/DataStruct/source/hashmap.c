@@ -14,99 +14,482 @@ __attribute__((always_inline)) inline uword_t hash_long(uword_t val)
     return val * GOLDEN_RATIO_PRIME;
 }
 
-static uword_t hashmap_hash(struct hashmap *map, void *key)
+#if PLATFORM_BITS == 64
+    #define HASH_SEED0 0xa0761d6478bd642fULL
+    #define HASH_SEED1 0xe7037ed1a0b428dbULL
+    #define HASH_SEED2 0x8ebc6af09c88c6e3ULL
+#else
+    #define HASH_SEED0 0x9e3779b1U
+    #define HASH_SEED1 0x85ebca6bU
+    #define HASH_SEED2 0xc2b2ae35U
+#endif
+
+//full width product of a and b, folded back to one word
+static inline uword_t hash_mum(uword_t a, uword_t b)
 {
-    switch (map->key_type) {
-        case HASHMAP_KEY_STRING: {
-            char *s = key;
-            uword_t h = 0;
-            while (*s)
-                h = h * GOLDEN_RATIO_PRIME + (unsigned char)(*s++);
-            return h;
+#if PLATFORM_BITS == 64
+    __uint128_t r = (__uint128_t)a * b;
+#else
+    uint64_t r = (uint64_t)a * b;
+#endif
+    return (uword_t)r ^ (uword_t)(r >> PLATFORM_BITS);
+}
+
+static inline uword_t hash_read(const unsigned char *p, size_t len)
+{
+    uword_t w = 0;
+    memcpy(&w, p, len);
+    return w;
+}
+
+/*
+ * wyhash style: two words per multiply, the tail is read zero padded.
+ * memcpy keeps the loads legal on cores that fault on unaligned words.
+ */
+uword_t hashmap_hash_bytes(const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    const size_t word = sizeof(uword_t);
+    uword_t seed = HASH_SEED0 ^ (uword_t)len;
+
+    while (len > 2 * word) {
+        seed = hash_mum(hash_read(p, word) ^ HASH_SEED1, hash_read(p + word, word) ^ seed);
+        p += 2 * word;
+        len -= 2 * word;
+    }
+    uword_t a = hash_read(p, len < word ? len : word);
+    uword_t b = len > word ? hash_read(p + word, len - word) : 0;
+    return hash_mum(hash_mum(a ^ HASH_SEED1, b ^ seed) ^ HASH_SEED2, seed ^ HASH_SEED1);
+}
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#if defined(__SSE2__) || defined(__ARM_NEON) || defined(__ARM_NEON__)
+static inline int hashmap_equal16(const unsigned char *x, const unsigned char *y)
+{
+#if defined(__SSE2__)
+    __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)x), _mm_loadu_si128((const __m128i *)y));
+    return _mm_movemask_epi8(eq) == 0xffff;
+#else
+    uint8x16_t eq = vceqq_u8(vld1q_u8(x), vld1q_u8(y));
+    uint8x8_t min = vpmin_u8(vget_low_u8(eq), vget_high_u8(eq));
+    return vget_lane_u64(vreinterpret_u64_u8(min), 0) == ~(uint64_t)0;
+#endif
+}
+#endif
+
+//equal hashes already make a match likely, keys of 16 bytes and more are compared 16 at a time
+static int hashmap_bytes_equal(const void *a, const void *b, size_t len)
+{
+#if defined(__SSE2__) || defined(__ARM_NEON) || defined(__ARM_NEON__)
+    const unsigned char *x = a;
+    const unsigned char *y = b;
+    if (len >= 16) {
+        for (size_t i = 0; i + 16 < len; i += 16) {
+            if (!hashmap_equal16(x + i, y + i))
+                return 0;
         }
-        case HASHMAP_KEY_INT:
-        case HASHMAP_KEY_PTR:
-            return hash_long((uword_t)key);
-        default:
-            return 0;
+        //the last 16 bytes, overlapping what was already compared
+        return hashmap_equal16(x + len - 16, y + len - 16);
     }
+#endif
+    return memcmp(a, b, len) == 0;
 }
 
-static int hashmap_key_equal(struct hashmap *map, void *a, void *b)
+//a key as looked up: strings carry their length, the hash is worked out once
+struct hashmap_lookup {
+    void *key;
+    size_t len;
+    uword_t hash;
+};
+
+static void hashmap_lookup_init(struct hashmap *map, struct hashmap_lookup *q, void *key, size_t len)
 {
+    q->key = key;
+    q->len = len;
     switch (map->key_type) {
         case HASHMAP_KEY_STRING:
-            return strcmp((char *)a, (char *)b) == 0;
+            q->hash = hashmap_hash_bytes(key, len);
+            break;
         case HASHMAP_KEY_INT:
-        case HASHMAP_KEY_PTR:
-            return a == b;
+        case HASHMAP_KEY_PTR: {
+            //the low bits of the product only depend on the low bits of the key,
+            //aligned pointers would share a few buckets, fold the high half in
+            uword_t h = hash_long((uword_t)key);
+            q->hash = h ^ (h >> (PLATFORM_BITS / 2));
+            break;
+        }
         default:
-            return 0;
+            q->hash = 0;
     }
 }
 
-void hashmap_init(struct hashmap *map, size_t bucket_count, int key_type)
+static inline size_t hashmap_key_len(struct hashmap *map, void *key)
+{
+    return map->key_type == HASHMAP_KEY_STRING ? strlen((char *)key) : 0;
+}
+
+static inline int hashmap_key_equal(struct hashmap *map, struct hashmap_entry *e, struct hashmap_lookup *q)
+{
+    if (e->hash != (uint32_t)q->hash)
+        return 0;
+    if (e->key == q->key)
+        return 1;
+    if (map->key_type != HASHMAP_KEY_STRING)
+        return 0;
+    return (e->len == q->len) && hashmap_bytes_equal(e->key, q->key, q->len);
+}
+
+struct hashmap_slab {
+    struct hashmap_slab *next;
+    struct hashmap_entry entries[];
+};
+
+static void *hashmap_malloc(void *ctx, size_t size)
+{
+    (void)ctx;
+    return malloc(size);
+}
+
+static void hashmap_free(void *ctx, void *ptr)
+{
+    (void)ctx;
+    free(ptr);
+}
+
+static const struct hashmap_allocator hashmap_libc = {
+        .alloc = hashmap_malloc,
+        .free = hashmap_free,
+        .ctx = NULL
+};
+
+static inline void *hashmap_alloc(struct hashmap *map, size_t size)
+{
+    return map->allocator.alloc(map->allocator.ctx, size);
+}
+
+static inline void hashmap_release(struct hashmap *map, void *ptr)
+{
+    map->allocator.free(map->allocator.ctx, ptr);
+}
+
+/*
+ * In slab mode a removed entry goes on free_entries and the slabs themselves
+ * are only given back by hashmap_destroy.
+ */
+static struct hashmap_entry *hashmap_entry_alloc(struct hashmap *map)
+{
+    if (map->slab_entries == 0)
+        return hashmap_alloc(map, sizeof(struct hashmap_entry));
+
+    if (map->free_entries != NULL) {
+        struct list_node *p = map->free_entries;
+        map->free_entries = p->next;
+        return container_of(p, struct hashmap_entry, node);
+    }
+
+    if (map->slab_left == 0) {
+        struct hashmap_slab *slab = hashmap_alloc(map, sizeof(struct hashmap_slab) +
+                                                       sizeof(struct hashmap_entry) * map->slab_entries);
+        if (slab == NULL)
+            return NULL;
+        slab->next = map->slabs;
+        map->slabs = slab;
+        map->slab_next = slab->entries;
+        map->slab_left = map->slab_entries;
+    }
+    map->slab_left--;
+    return map->slab_next++;
+}
+
+static void hashmap_entry_free(struct hashmap *map, struct hashmap_entry *e)
+{
+    if (map->slab_entries == 0) {
+        hashmap_release(map, e);
+        return;
+    }
+    e->node.next = map->free_entries;
+    map->free_entries = &e->node;
+}
+
+int hashmap_init_alloc(struct hashmap *map, size_t bucket_count, int key_type,
+                       const struct hashmap_allocator *allocator, size_t slab_entries)
 {
     uword_t count = next_power_of_two((uword_t)bucket_count);
-    map->bucket_count = count;
-    map->key_type = key_type;
+    *map = (struct hashmap) {
+            .bucket_count = count,
+            .key_type = key_type,
+            .count = 0,
+            .old_buckets = NULL,
+            .allocator = allocator ? *allocator : hashmap_libc,
+            .slab_entries = slab_entries,
+            .slabs = NULL,
+            .free_entries = NULL
+    };
 
-    map->buckets = malloc(sizeof(struct list_node) * count);
+    map->buckets = hashmap_alloc(map, sizeof(struct list_node) * count);
+    if (map->buckets == NULL)
+        return -1;
     for (uword_t i = 0; i < count; i++)
         list_node_init(&map->buckets[i]);
+    return 0;
+}
+
+int hashmap_init(struct hashmap *map, size_t bucket_count, int key_type)
+{
+    return hashmap_init_alloc(map, bucket_count, key_type, NULL, 0);
+}
+
+static void hashmap_free_chain(struct hashmap *map, struct list_node *bucket)
+{
+    while (!list_empty(bucket)) {
+        struct list_node *p = bucket->next;
+        list_remove(p);
+        hashmap_release(map, container_of(p, struct hashmap_entry, node));
+    }
 }
 
-static struct list_node *hashmap_bucket(struct hashmap *map, void *key)
+void hashmap_destroy(struct hashmap *map)
 {
-    uword_t h = hashmap_hash(map, key);
+    if (map->slab_entries == 0) {
+        //during a resize only the new buckets of migrated old ones are set up
+        uword_t live = map->old_buckets ? map->migrate_index : map->bucket_count;
+        for (uword_t i = 0; i < live; i++) {
+            hashmap_free_chain(map, &map->buckets[i]);
+            if (map->old_buckets)
+                hashmap_free_chain(map, &map->buckets[i + map->old_bucket_count]);
+        }
+        if (map->old_buckets) {
+            for (uword_t i = map->migrate_index; i < map->old_bucket_count; i++)
+                hashmap_free_chain(map, &map->old_buckets[i]);
+        }
+    }
+    while (map->slabs != NULL) {
+        struct hashmap_slab *slab = map->slabs;
+        map->slabs = slab->next;
+        hashmap_release(map, slab);
+    }
+    if (map->old_buckets != NULL)
+        hashmap_release(map, map->old_buckets);
+    if (map->buckets != NULL)
+        hashmap_release(map, map->buckets);
+    map->old_buckets = NULL;
+    map->buckets = NULL;
+    map->free_entries = NULL;
+    map->slab_left = 0;
+    map->count = 0;
+}
+
+static struct list_node *hashmap_bucket(struct hashmap *map, uword_t h)
+{
+    if (map->old_buckets != NULL) {
+        uword_t i = h & (map->old_bucket_count - 1);
+        if (i >= map->migrate_index)
+            return &map->old_buckets[i];
+    }
     return &map->buckets[h & (map->bucket_count - 1)];
 }
 
-void hashmap_put(struct hashmap *map, void *key, void *value)
+/*
+ * Old bucket i splits into new buckets i and i + old_bucket_count. Those two are
+ * only set up here, so the doubled array costs a malloc and no O(n) pass.
+ */
+static void hashmap_migrate(struct hashmap *map)
 {
-    struct list_node *bucket = hashmap_bucket(map, key);
-    struct list_node *p;
+    uword_t old_count = map->old_bucket_count;
 
-    for (p = bucket->next; p != bucket; p = p->next) {
-        struct hashmap_entry *e = container_of(p, struct hashmap_entry, node);
-        if (hashmap_key_equal(map, e->key, key)) {
-            e->value = value;
-            return;
+    for (int n = 0; (n < HASHMAP_MIGRATE_STEP) && (map->migrate_index < old_count); n++) {
+        uword_t i = map->migrate_index++;
+        struct list_node *old = &map->old_buckets[i];
+        list_node_init(&map->buckets[i]);
+        list_node_init(&map->buckets[i + old_count]);
+        while (!list_empty(old)) {
+            struct list_node *p = old->next;
+            struct hashmap_entry *e = container_of(p, struct hashmap_entry, node);
+            list_remove(p);
+            list_add_next(&map->buckets[e->hash & (map->bucket_count - 1)], p);
         }
     }
 
-    struct hashmap_entry *entry = malloc(sizeof(struct hashmap_entry));
-    entry->key = key;
-    entry->value = value;
-    list_node_init(&entry->node);
-    list_add_next(bucket, &entry->node);
+    if (map->migrate_index == old_count) {
+        hashmap_release(map, map->old_buckets);
+        map->old_buckets = NULL;
+        map->old_bucket_count = 0;
+        map->migrate_index = 0;
+    }
 }
 
-void *hashmap_get(struct hashmap *map, void *key)
+//if the bigger array can't be had the map keeps working, just with longer chains
+static void hashmap_grow(struct hashmap *map)
+{
+    struct list_node *buckets = hashmap_alloc(map, sizeof(struct list_node) * map->bucket_count * 2);
+    if (buckets == NULL)
+        return;
+
+    map->old_buckets = map->buckets;
+    map->old_bucket_count = map->bucket_count;
+    map->migrate_index = 0;
+    map->buckets = buckets;
+    map->bucket_count *= 2;
+}
+
+static struct hashmap_entry *hashmap_find(struct hashmap *map, struct list_node *bucket, struct hashmap_lookup *q)
 {
-    struct list_node *bucket = hashmap_bucket(map, key);
     struct list_node *p;
 
     for (p = bucket->next; p != bucket; p = p->next) {
         struct hashmap_entry *e = container_of(p, struct hashmap_entry, node);
-        if (hashmap_key_equal(map, e->key, key))
-            return e->value;
+        if (hashmap_key_equal(map, e, q))
+            return e;
     }
     return NULL;
 }
 
-int hashmap_remove(struct hashmap *map, void *key)
+static int hashmap_put_lookup(struct hashmap *map, struct hashmap_lookup *q, void *value)
 {
-    struct list_node *bucket = hashmap_bucket(map, key);
-    struct list_node *p;
+    if (map->old_buckets != NULL)
+        hashmap_migrate(map);
 
-    for (p = bucket->next; p != bucket; p = p->next) {
-        struct hashmap_entry *e = container_of(p, struct hashmap_entry, node);
-        if (hashmap_key_equal(map, e->key, key)) {
-            list_remove(&e->node);
-            free(e);
-            return 1;
-        }
+    struct list_node *bucket = hashmap_bucket(map, q->hash);
+    struct hashmap_entry *e = hashmap_find(map, bucket, q);
+    if (e != NULL) {
+        e->value = value;
+        return 0;
     }
+
+    struct hashmap_entry *entry = hashmap_entry_alloc(map);
+    if (entry == NULL)
+        return -1;
+    entry->key = q->key;
+    entry->value = value;
+    entry->hash = (uint32_t)q->hash;
+    entry->len = (uint32_t)q->len;
+    list_node_init(&entry->node);
+    list_add_next(bucket, &entry->node);
+    map->count++;
+
+    if ((map->old_buckets == NULL) &&
+        (map->count > map->bucket_count * HASHMAP_MAX_LOAD))
+        hashmap_grow(map);
     return 0;
 }
+
+static void *hashmap_get_lookup(struct hashmap *map, struct hashmap_lookup *q)
+{
+    if (map->old_buckets != NULL)
+        hashmap_migrate(map);
+
+    struct hashmap_entry *e = hashmap_find(map, hashmap_bucket(map, q->hash), q);
+    if (e == NULL)
+        return NULL;
+    return e->value;
+}
+
+static int hashmap_remove_lookup(struct hashmap *map, struct hashmap_lookup *q)
+{
+    if (map->old_buckets != NULL)
+        hashmap_migrate(map);
+
+    struct hashmap_entry *e = hashmap_find(map, hashmap_bucket(map, q->hash), q);
+    if (e == NULL)
+        return 0;
+
+    list_remove(&e->node);
+    hashmap_entry_free(map, e);
+    map->count--;
+    return 1;
+}
+
+//-1 when no memory for a new entry was left
+int hashmap_put(struct hashmap *map, void *key, void *value)
+{
+    struct hashmap_lookup q;
+    hashmap_lookup_init(map, &q, key, hashmap_key_len(map, key));
+    return hashmap_put_lookup(map, &q, value);
+}
+
+void *hashmap_get(struct hashmap *map, void *key)
+{
+    struct hashmap_lookup q;
+    hashmap_lookup_init(map, &q, key, hashmap_key_len(map, key));
+    return hashmap_get_lookup(map, &q);
+}
+
+int hashmap_remove(struct hashmap *map, void *key)
+{
+    struct hashmap_lookup q;
+    hashmap_lookup_init(map, &q, key, hashmap_key_len(map, key));
+    return hashmap_remove_lookup(map, &q);
+}
+
+/*
+ * HASHMAP_KEY_STRING keys given with their length: no strlen, and the bytes
+ * need no terminating zero, e.g. a topic name inside a received packet.
+ */
+int hashmap_put_len(struct hashmap *map, const void *key, size_t len, void *value)
+{
+    struct hashmap_lookup q;
+    hashmap_lookup_init(map, &q, (void *)key, len);
+    return hashmap_put_lookup(map, &q, value);
+}
+
+void *hashmap_get_len(struct hashmap *map, const void *key, size_t len)
+{
+    struct hashmap_lookup q;
+    hashmap_lookup_init(map, &q, (void *)key, len);
+    return hashmap_get_lookup(map, &q);
+}
+
+int hashmap_remove_len(struct hashmap *map, const void *key, size_t len)
+{
+    struct hashmap_lookup q;
+    hashmap_lookup_init(map, &q, (void *)key, len);
+    return hashmap_remove_lookup(map, &q);
+}
+
+static uword_t hashmap_chain_length(struct list_node *bucket)
+{
+    uword_t n = 0;
+    for (struct list_node *p = bucket->next; p != bucket; p = p->next)
+        n++;
+    return n;
+}
+
+static void hashmap_stats_bucket(struct hashmap_stats *stats, struct list_node *bucket)
+{
+    uword_t n = hashmap_chain_length(bucket);
+    if (n != 0)
+        stats->used_buckets++;
+    if (n > stats->max_chain)
+        stats->max_chain = n;
+}
+
+/*
+ * Walks every chain, O(n). During a resize the chains of both arrays are counted
+ * and load is taken against the new size.
+ */
+void hashmap_stats(struct hashmap *map, struct hashmap_stats *stats)
+{
+    *stats = (struct hashmap_stats) {
+            .count = map->count,
+            .bucket_count = map->bucket_count,
+            .load = map->count * 100 / map->bucket_count,
+            .resizing = map->old_buckets != NULL
+    };
+
+    if (map->old_buckets == NULL) {
+        for (uword_t i = 0; i < map->bucket_count; i++)
+            hashmap_stats_bucket(stats, &map->buckets[i]);
+        return;
+    }
+    for (uword_t i = 0; i < map->migrate_index; i++) {
+        hashmap_stats_bucket(stats, &map->buckets[i]);
+        hashmap_stats_bucket(stats, &map->buckets[i + map->old_bucket_count]);
+    }
+    for (uword_t i = map->migrate_index; i < map->old_bucket_count; i++)
+        hashmap_stats_bucket(stats, &map->old_buckets[i]);
+}
@@ -0,0 +1,137 @@
+#include "pairheap.h"
+
+void pairheap_init(struct pairheap *heap)
+{
+    heap->root = NULL;
+    heap->count = 0;
+}
+
+void pairheap_node_init(struct pairheap_node *node)
+{
+    *node = (struct pairheap_node) {
+            .child = NULL,
+            .next = NULL,
+            .prev = NULL,
+            .value = 0
+    };
+}
+
+//the larger root becomes the leftmost child of the smaller, the caller fixes the winner's siblings
+static inline struct pairheap_node *pairheap_meld(struct pairheap_node *a, struct pairheap_node *b)
+{
+    if (b->value < a->value) {
+        struct pairheap_node *t = a;
+        a = b;
+        b = t;
+    }
+    b->prev = a;
+    b->next = a->child;
+    if (a->child != NULL)
+        a->child->prev = b;
+    a->child = b;
+    return a;
+}
+
+/*
+ * Two pass merge of a sibling list: meld neighbours pairwise left to right,
+ * then the pairs into one right to left. The first pass stacks its results
+ * through next, so the second pass starts from the rightmost pair.
+ */
+static struct pairheap_node *pairheap_merge_pairs(struct pairheap_node *first)
+{
+    struct pairheap_node *stack = NULL;
+
+    if (first == NULL)
+        return NULL;
+    while (first != NULL) {
+        struct pairheap_node *a = first;
+        struct pairheap_node *b = a->next;
+        struct pairheap_node *m = a;
+        first = NULL;
+        if (b != NULL) {
+            first = b->next;
+            m = pairheap_meld(a, b);
+        }
+        m->next = stack;
+        stack = m;
+    }
+
+    struct pairheap_node *root = stack;
+    stack = stack->next;
+    while (stack != NULL) {
+        struct pairheap_node *next = stack->next;
+        root = pairheap_meld(root, stack);
+        stack = next;
+    }
+    root->prev = NULL;
+    root->next = NULL;
+    return root;
+}
+
+static inline void pairheap_meld_root(struct pairheap *heap, struct pairheap_node *node)
+{
+    if (heap->root == NULL) {
+        node->prev = NULL;
+        node->next = NULL;
+        heap->root = node;
+        return;
+    }
+    heap->root = pairheap_meld(heap->root, node);
+    heap->root->prev = NULL;
+    heap->root->next = NULL;
+}
+
+void pairheap_insert(struct pairheap *heap, struct pairheap_node *node)
+{
+    node->child = NULL;
+    pairheap_meld_root(heap, node);
+    heap->count++;
+}
+
+struct pairheap_node *pairheap_pop(struct pairheap *heap)
+{
+    struct pairheap_node *root = heap->root;
+    if (root == NULL)
+        return NULL;
+    heap->root = pairheap_merge_pairs(root->child);
+    heap->count--;
+    root->child = NULL;
+    return root;
+}
+
+//takes node and its subtree out of its sibling list, node must not be the root
+static inline void pairheap_cut(struct pairheap_node *node)
+{
+    if (node->prev->child == node)
+        node->prev->child = node->next;
+    else
+        node->prev->next = node->next;
+    if (node->next != NULL)
+        node->next->prev = node->prev;
+    node->prev = NULL;
+    node->next = NULL;
+}
+
+void pairheap_remove(struct pairheap *heap, struct pairheap_node *node)
+{
+    if (node == heap->root) {
+        pairheap_pop(heap);
+        return;
+    }
+    pairheap_cut(node);
+    struct pairheap_node *rest = pairheap_merge_pairs(node->child);
+    if (rest != NULL)
+        pairheap_meld_root(heap, rest);
+    node->child = NULL;
+    heap->count--;
+}
+
+//value must not be above node's current one
+void pairheap_decrease(struct pairheap *heap, struct pairheap_node *node, uint64_t value)
+{
+    node->value = value;
+    if (node == heap->root)
+        return;
+    pairheap_cut(node);
+    pairheap_meld_root(heap, node);
+}
@@ -1,5 +1,8 @@
 #include "radix.h"
 
+void *heap_malloc(size_t WantSize);
+void heap_free(void *xReturn);
+
 
 __attribute__((always_inline)) inline uint8_t log2_clz64(uint64_t value)
 {
@@ -14,6 +17,15 @@ static inline uint8_t radix_tree_height(uint64_t index)
     return msb / BIT_LEVEL + 1;
 }
 
+#define RADIX_TREE_BIT(offset)  ((radix_tree_bitmap)1 << (offset))
+//a tag past the last selects the occupied bitmap
+#define RADIX_TREE_ANY          RADIX_TREE_MAX_TAGS
+
+static inline radix_tree_bitmap radix_tree_node_bits(struct radix_tree_node *node, unsigned int tag)
+{
+    return (tag < RADIX_TREE_MAX_TAGS) ? node->tags[tag] : node->occupied;
+}
+
 
 void radix_tree_init(struct radix_tree_root *root)
 {
@@ -65,6 +77,12 @@ int radix_tree_grow_height(struct radix_tree_root *root, uint8_t height)
         root->rnode->parent = new_node;
         new_node->slots[0] = root->rnode;
         new_node->count++;
+        new_node->occupied = RADIX_TREE_BIT(0);
+        for (unsigned int tag = 0; tag < RADIX_TREE_MAX_TAGS; tag++) {
+            if (root->rnode->tags[tag]) {
+                new_node->tags[tag] = RADIX_TREE_BIT(0);
+            }
+        }
         root->rnode = new_node;
     }
     return (int)root->height;
@@ -86,6 +104,7 @@ int radix_tree_grow_node(struct radix_tree_root *root, size_t index, void *item)
             }
 
             node->count++;
+            node->occupied |= RADIX_TREE_BIT(offset);
             ((struct radix_tree_node *)node->slots[offset])->offset = offset;
             ((struct radix_tree_node *)node->slots[offset])->parent = node;
         }
@@ -100,6 +119,7 @@ int radix_tree_grow_node(struct radix_tree_root *root, size_t index, void *item)
     }
     leaf->slots[offset] = item;
     leaf->count++;
+    leaf->occupied |= RADIX_TREE_BIT(offset);
 
     return 0;
 }
@@ -116,7 +136,7 @@ int radix_tree_insert(struct radix_tree_root *root, size_t index, void *item)
         if (!*node_ptr) {
             return -1;
         }
-        (*node_ptr)->parent = (struct radix_tree_node *)root;
+        (*node_ptr)->parent = NULL;
         root->height = height;
         return radix_tree_grow_node(root, index, item);
     }
@@ -169,7 +189,7 @@ void *radix_tree_lookup(struct radix_tree_root *root, size_t index)
     uint32_t shift = (height - 1) * BIT_LEVEL;
     uint8_t offset;
 
-    if (!node) {
+    if (!node || radix_tree_height(index) > root->height) {
         return NULL;
     }
 
@@ -189,7 +209,6 @@ void *radix_tree_lookup(struct radix_tree_root *root, size_t index)
 
 void *radix_tree_node_left(struct radix_tree_node *node)
 {
-    int offset;
     int height;
     if (!node) {
         return NULL;
@@ -197,14 +216,10 @@ void *radix_tree_node_left(struct radix_tree_node *node)
 
     height = (int)node->height;
     while (height > 0) {
-        if (!node) {
+        if (!node->occupied) {
             return NULL;
         }
-        offset = 0;
-        while ((offset < SIZE_LEVEL) && (!node->slots[offset])) {
-            offset++;
-        }
-        node = (struct radix_tree_node *)node->slots[offset];
+        node = (struct radix_tree_node *)node->slots[__builtin_ctzll(node->occupied)];
         height--;
     }
     return node;
@@ -216,30 +231,57 @@ __attribute__((always_inline)) inline void *radix_tree_root_left(struct radix_tr
     return radix_tree_node_left(root->rnode);
 }
 
-void *radix_tree_delete(struct radix_tree_root *root, size_t index)
+//the node holding index's slot, NULL if there is none
+static struct radix_tree_node *radix_tree_lookup_leaf(struct radix_tree_root *root, size_t index)
 {
     struct radix_tree_node *node = root->rnode;
-    int height = (int)root->height;
-    uint8_t shift = (height - 1) * BIT_LEVEL;
-    uint8_t offset;
+    uint32_t shift;
 
-    if (height < radix_tree_height(index)) return NULL;
+    if (!node || radix_tree_height(index) > root->height) {
+        return NULL;
+    }
 
-    while (height > 1) {
-        if (!node) return NULL;
-        offset = (index >> shift) & (SIZE_LEVEL - 1);
-        node = (struct radix_tree_node *)node->slots[offset];
+    shift = (root->height - 1) * BIT_LEVEL;
+    while (shift > 0) {
+        node = (struct radix_tree_node *)node->slots[(index >> shift) & (SIZE_LEVEL - 1)];
+        if (!node) {
+            return NULL;
+        }
         shift -= BIT_LEVEL;
-        height--;
     }
+    return node;
+}
+
+//clear tag on a slot and on the ancestors left with nothing tagged below them
+static void radix_tree_tag_clear_node(struct radix_tree_node *node, uint8_t offset, unsigned int tag)
+{
+    while (node) {
+        node->tags[tag] &= ~RADIX_TREE_BIT(offset);
+        if (node->tags[tag]) {
+            break;
+        }
+        offset = node->offset;
+        node = node->parent;
+    }
+}
+
+void *radix_tree_delete(struct radix_tree_root *root, size_t index)
+{
+    struct radix_tree_node *node = radix_tree_lookup_leaf(root, index);
+    uint8_t offset = index & (SIZE_LEVEL - 1);
 
     if (!node) return NULL;
 
-    offset = index & (SIZE_LEVEL - 1);
     void *item = node->slots[offset];
     if (!item) return NULL;
 
+    for (unsigned int tag = 0; tag < RADIX_TREE_MAX_TAGS; tag++) {
+        if (node->tags[tag] & RADIX_TREE_BIT(offset)) {
+            radix_tree_tag_clear_node(node, offset, tag);
+        }
+    }
     node->slots[offset] = NULL;
+    node->occupied &= ~RADIX_TREE_BIT(offset);
     node->count--;
 
     while (node->count == 0 && node != root->rnode) {
@@ -247,6 +289,7 @@ void *radix_tree_delete(struct radix_tree_root *root, size_t index)
         uint8_t off = node->offset;
         radix_tree_node_free(root, node);
         parent->slots[off] = NULL;
+        parent->occupied &= ~RADIX_TREE_BIT(off);
         parent->count--;
         node = parent;
     }
@@ -260,53 +303,151 @@ void *radix_tree_delete(struct radix_tree_root *root, size_t index)
     return item;
 }
 
-void *radix_tree_lookup_upper_bound(struct radix_tree_root *root, size_t index) {
-    uint8_t offset;
-    uint32_t shift = (root->height - 1) * BIT_LEVEL;
-
+/*
+ * Collect up to max_items items from *index upward whose slots are set in the
+ * tag bitmap (RADIX_TREE_ANY: every item), leaving in *index the index of the
+ * last one. One descent to *index, then the walk moves right: ctz on a node's
+ * bitmap finds the next slot worth entering, and a node with nothing right of the
+ * current slot is left for its parent. Every slot entered leads to an item, apart
+ * from those on the path to *index, so the walk costs O(height + items found)
+ * whatever the gaps between them.
+ */
+static unsigned int radix_tree_gather(struct radix_tree_root *root, void **results, size_t *index,
+                                      unsigned int max_items, unsigned int tag)
+{
     struct radix_tree_node *node = root->rnode;
-    if (!node) return NULL;
+    size_t at = *index;
+    uint32_t shift;
+    unsigned int n = 0;
 
-    while (node && node->height > 1) {
-        offset = (index >> shift) & (SIZE_LEVEL - 1);
-        if (node->slots[offset]) {
-            node = node->slots[offset];
-            shift -= BIT_LEVEL;
+    if (!node || !max_items || radix_tree_height(at) > root->height) {
+        return 0;
+    }
+
+    shift = (root->height - 1) * BIT_LEVEL;
+    for (;;) {
+        //indexes below this node differ from at in their low bits only, span - 1 of them
+        size_t span = (size_t)SIZE_LEVEL << shift;
+        uint8_t offset = (at >> shift) & (SIZE_LEVEL - 1);
+        radix_tree_bitmap bits = radix_tree_node_bits(node, tag) >> offset;
+
+        if (bits) {
+            uint8_t next = offset + __builtin_ctzll(bits);
+            if (next != offset) {
+                at = (at & ~(span - 1)) | ((size_t)next << shift);
+            }
+            if (shift) {
+                node = (struct radix_tree_node *)node->slots[next];
+                shift -= BIT_LEVEL;
+                continue;
+            }
+
+            results[n++] = node->slots[next];
+            *index = at;
+            if (n == max_items || ++at == 0) {
+                return n;
+            }
+            if (at & (SIZE_LEVEL - 1)) {
+                continue;
+            }
         } else {
-            while(++offset < SIZE_LEVEL) {
-                if (node->slots[offset]) {
-                    return radix_tree_node_left(node->slots[offset]);
-                }
+            at = (at | (span - 1)) + 1;
+            if (at == 0) {
+                return n;
             }
+        }
 
-            break;
+        //at is past this node, climb to the ancestor it falls in
+        do {
+            node = node->parent;
+            shift += BIT_LEVEL;
+        } while (node && !((at >> shift) & (SIZE_LEVEL - 1)));
+        if (!node) {
+            return n;
         }
     }
+}
 
-    // if in leaf layer
-    if (node && node->height == 1) {
-        offset = index & (SIZE_LEVEL - 1);
-        if (node->slots[offset]) {
-            return node->slots[offset];
-        }
+void *radix_tree_lookup_upper_bound(struct radix_tree_root *root, size_t index)
+{
+    void *item;
+    return radix_tree_gather(root, &item, &index, 1, RADIX_TREE_ANY) ? item : NULL;
+}
 
-        while (++offset < SIZE_LEVEL) {
-            if (node->slots[offset]) {
-                return node->slots[offset];
-            }
-        }
+unsigned int radix_tree_gang_lookup(struct radix_tree_root *root, void **results,
+                                    size_t first_index, unsigned int max_items)
+{
+    return radix_tree_gather(root, results, &first_index, max_items, RADIX_TREE_ANY);
+}
+
+unsigned int radix_tree_gang_lookup_tag(struct radix_tree_root *root, void **results,
+                                        size_t first_index, unsigned int max_items, unsigned int tag)
+{
+    if (tag >= RADIX_TREE_MAX_TAGS) {
+        return 0;
+    }
+    return radix_tree_gather(root, results, &first_index, max_items, tag);
+}
+
+//the first item tagged at or after *index, whose index is stored back in *index
+void *radix_tree_next_tag(struct radix_tree_root *root, size_t *index, unsigned int tag)
+{
+    void *item;
+    if (tag >= RADIX_TREE_MAX_TAGS) {
+        return NULL;
     }
+    return radix_tree_gather(root, &item, index, 1, tag) ? item : NULL;
+}
 
-    while (node && node->parent) {
-        uint8_t off = node->offset;
+//returns the item, NULL if index has none
+void *radix_tree_tag_set(struct radix_tree_root *root, size_t index, unsigned int tag)
+{
+    struct radix_tree_node *node = radix_tree_lookup_leaf(root, index);
+    uint8_t offset = index & (SIZE_LEVEL - 1);
+    void *item;
+
+    if (tag >= RADIX_TREE_MAX_TAGS || !node || !node->slots[offset]) {
+        return NULL;
+    }
+
+    item = node->slots[offset];
+    //an ancestor already tagged has all of its own ancestors tagged
+    while (node && !(node->tags[tag] & RADIX_TREE_BIT(offset))) {
+        node->tags[tag] |= RADIX_TREE_BIT(offset);
+        offset = node->offset;
         node = node->parent;
-        while (++off < SIZE_LEVEL) {
-            if (node->slots[off]) {
-                return radix_tree_node_left(node->slots[off]);
-            }
-        }
+    }
+    return item;
+}
+
+void *radix_tree_tag_clear(struct radix_tree_root *root, size_t index, unsigned int tag)
+{
+    struct radix_tree_node *node = radix_tree_lookup_leaf(root, index);
+    uint8_t offset = index & (SIZE_LEVEL - 1);
 
+    if (tag >= RADIX_TREE_MAX_TAGS || !node || !node->slots[offset]) {
+        return NULL;
+    }
+
+    if (node->tags[tag] & RADIX_TREE_BIT(offset)) {
+        radix_tree_tag_clear_node(node, offset, tag);
     }
+    return node->slots[offset];
+}
+
+int radix_tree_tag_get(struct radix_tree_root *root, size_t index, unsigned int tag)
+{
+    struct radix_tree_node *node = radix_tree_lookup_leaf(root, index);
+    uint8_t offset = index & (SIZE_LEVEL - 1);
 
-    return NULL;
-}
\ No newline at end of file
+    if (tag >= RADIX_TREE_MAX_TAGS || !node || !node->slots[offset]) {
+        return 0;
+    }
+    return (node->tags[tag] & RADIX_TREE_BIT(offset)) != 0;
+}
+
+//whether any item carries tag
+int radix_tree_tagged(struct radix_tree_root *root, unsigned int tag)
+{
+    return tag < RADIX_TREE_MAX_TAGS && root->rnode && root->rnode->tags[tag];
+}
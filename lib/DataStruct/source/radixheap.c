@@ -0,0 +1,112 @@
+#include "radixheap.h"
+
+void radixheap_init(struct radixheap *heap, uint64_t start)
+{
+    for (uint8_t i = 0; i < RADIXHEAP_BUCKETS; i++) {
+        heap->bucket[i] = NULL;
+    }
+    heap->last = start;
+    heap->occupied = 0;
+    heap->count = 0;
+}
+
+void radixheap_node_init(struct radixheap_node *node)
+{
+    *node = (struct radixheap_node) {
+            .next = NULL,
+            .prev = NULL,
+            .value = 0,
+            .bucket = 0
+    };
+}
+
+static inline uint8_t radixheap_bucket_of(struct radixheap *heap, uint64_t value)
+{
+    uint64_t diff = value ^ heap->last;
+    return diff ? (uint8_t)(64 - __builtin_clzll(diff)) : 0;
+}
+
+static inline void radixheap_push(struct radixheap *heap, struct radixheap_node *node, uint8_t b)
+{
+    node->bucket = b;
+    node->prev = NULL;
+    node->next = heap->bucket[b];
+    if (node->next != NULL)
+        node->next->prev = node;
+    heap->bucket[b] = node;
+    if (b > 0)
+        heap->occupied |= 1ULL << (b - 1);
+}
+
+static inline void radixheap_unlink(struct radixheap *heap, struct radixheap_node *node)
+{
+    uint8_t b = node->bucket;
+    if (node->prev != NULL)
+        node->prev->next = node->next;
+    else
+        heap->bucket[b] = node->next;
+    if (node->next != NULL)
+        node->next->prev = node->prev;
+    if ((heap->bucket[b] == NULL) && (b > 0))
+        heap->occupied &= ~(1ULL << (b - 1));
+    node->next = NULL;
+    node->prev = NULL;
+}
+
+//-1 when value is below the last minimum
+int radixheap_insert(struct radixheap *heap, struct radixheap_node *node)
+{
+    if (node->value < heap->last)
+        return -1;
+    radixheap_push(heap, node, radixheap_bucket_of(heap, node->value));
+    heap->count++;
+    return 0;
+}
+
+/*
+ * With bucket 0 empty the minimum is in the lowest bucket left. It becomes last,
+ * and every other node of that bucket shares its bits above the bucket's, so all
+ * of them land in lower buckets.
+ */
+struct radixheap_node *radixheap_min(struct radixheap *heap)
+{
+    if (heap->bucket[0] != NULL)
+        return heap->bucket[0];
+    if (heap->occupied == 0)
+        return NULL;
+
+    uint8_t b = (uint8_t)(__builtin_ctzll(heap->occupied) + 1);
+    struct radixheap_node *node = heap->bucket[b];
+    uint64_t min = node->value;
+    for (node = node->next; node != NULL; node = node->next) {
+        if (node->value < min)
+            min = node->value;
+    }
+
+    node = heap->bucket[b];
+    heap->bucket[b] = NULL;
+    heap->occupied &= ~(1ULL << (b - 1));
+    heap->last = min;
+    while (node != NULL) {
+        struct radixheap_node *next = node->next;
+        radixheap_push(heap, node, radixheap_bucket_of(heap, node->value));
+        node = next;
+    }
+    return heap->bucket[0];
+}
+
+struct radixheap_node *radixheap_pop(struct radixheap *heap)
+{
+    struct radixheap_node *node = radixheap_min(heap);
+    if (node != NULL) {
+        radixheap_unlink(heap, node);
+        heap->count--;
+    }
+    return node;
+}
+
+void radixheap_remove(struct radixheap *heap, struct radixheap_node *node)
+{
+    radixheap_unlink(heap, node);
+    heap->count--;
+}
@@ -36,6 +36,25 @@ static inline void rb_link_node(rb_node *node,  rb_node *parent,
     *rb_link = node;
 }
 
+static inline void rb_augment_update(rb_root *root, rb_node *node)
+{
+    if (root->augment != NULL) {
+        root->augment->update(node);
+    }
+}
+
+//node's subtree changed: recompute it and every ancestor up to the root
+static void rb_augment_propagate(rb_root *root, rb_node *node)
+{
+    if (root->augment == NULL) {
+        return;
+    }
+    while (node != NULL) {
+        root->augment->update(node);
+        node = node->rb_parent;
+    }
+}
+
 
 static inline void rb_rotate_left(rb_node *node,  rb_root *root)
 {
@@ -59,6 +78,9 @@ static inline void rb_rotate_left(rb_node *node,  rb_root *root)
     }
 
     node->rb_parent = right;
+    //node is now below right, so it goes first
+    rb_augment_update(root, node);
+    rb_augment_update(root, right);
 }
 
 static void rb_rotate_right(rb_node *node,  rb_root *root)
@@ -83,6 +105,8 @@ static void rb_rotate_right(rb_node *node,  rb_root *root)
     }
 
     node->rb_parent = left;
+    rb_augment_update(root, node);
+    rb_augment_update(root, left);
 }
 
 
@@ -309,6 +333,8 @@ static void rb_erase(rb_node *node,  rb_root *root)
     }
 
     color:
+    //rotations in rb_erase_color keep the aggregates, so they must be right before it
+    rb_augment_propagate(root, parent);
     if (color == RB_BLACK) {
         rb_erase_color(child, parent, root);
     }
@@ -410,6 +436,7 @@ void rb_replace_node( rb_node *victim,  rb_node *new,
         victim->rb_right->rb_parent = new;
 
     *new = *victim;
+    rb_augment_propagate(root, new);
 }
 
 
@@ -436,10 +463,17 @@ void rb_root_init(rb_root_handle root)
         .rb_node = NULL,
         .first_node = NULL,
         .last_node = NULL,
-        .count = 0
+        .count = 0,
+        .augment = NULL
     };
 }
 
+void rb_root_init_augmented(rb_root_handle root, const rb_augment *augment)
+{
+    rb_root_init(root);
+    root->augment = augment;
+}
+
 
 void rb_node_init(rb_node_handle node)
 {
@@ -482,6 +516,7 @@ void rb_Insert_node(rb_root_handle root,  rb_node *new_node) {
     }
 
     rb_link_node(new_node, parent, link);
+    rb_augment_propagate(root, new_node);
     rb_insert_color(new_node, root);
     root->count++;
 }
@@ -505,6 +540,142 @@ void rb_remove_node(rb_root *root,  rb_node *node)
 }
 
 
+static inline uint32_t rb_size_of(rb_node *node)
+{
+    return node ? container_of(node, rb_size_node, node)->size : 0;
+}
+
+static void rb_size_update(rb_node *node)
+{
+    container_of(node, rb_size_node, node)->size =
+            1 + rb_size_of(node->rb_left) + rb_size_of(node->rb_right);
+}
+
+const rb_augment rb_size_augment = {
+        .update = rb_size_update
+};
+
+rb_node *rb_select(rb_root *root, uint32_t k)
+{
+    rb_node *node = root->rb_node;
+
+    while (node) {
+        uint32_t left = rb_size_of(node->rb_left);
+        if (k < left) {
+            node = node->rb_left;
+        } else if (k > left) {
+            k -= left + 1;
+            node = node->rb_right;
+        } else {
+            return node;
+        }
+    }
+    return NULL;
+}
+
+//nodes before node in order: its left subtree and, for every ancestor entered
+//from the right, that ancestor with its left subtree
+uint32_t rb_rank(rb_node *node)
+{
+    uint32_t rank = rb_size_of(node->rb_left);
+
+    while (node->rb_parent) {
+        if (node == node->rb_parent->rb_right) {
+            rank += rb_size_of(node->rb_parent->rb_left) + 1;
+        }
+        node = node->rb_parent;
+    }
+    return rank;
+}
+
+
+static inline rb_interval_node *rb_interval_of(rb_node *node)
+{
+    return container_of(node, rb_interval_node, node);
+}
+
+static void rb_interval_update(rb_node *node)
+{
+    rb_interval_node *self = rb_interval_of(node);
+    uint64_t max_end = self->end;
+
+    if (node->rb_left && rb_interval_of(node->rb_left)->max_end > max_end) {
+        max_end = rb_interval_of(node->rb_left)->max_end;
+    }
+    if (node->rb_right && rb_interval_of(node->rb_right)->max_end > max_end) {
+        max_end = rb_interval_of(node->rb_right)->max_end;
+    }
+    self->max_end = max_end;
+}
+
+const rb_augment rb_interval_augment = {
+        .update = rb_interval_update
+};
+
+/*
+ * Leftmost interval of the subtree overlapping [lo, hi].
+ * A left subtree reaching lo is taken even when nothing in it overlaps:
+ * then all its starts are past hi and so is every start to its right.
+ */
+static rb_node *rb_interval_search(rb_node *node, uint64_t lo, uint64_t hi)
+{
+    while (1) {
+        if (node->rb_left && rb_interval_of(node->rb_left)->max_end >= lo) {
+            node = node->rb_left;
+            continue;
+        }
+        if (node->value <= hi) {
+            if (rb_interval_of(node)->end >= lo) {
+                return node;
+            }
+            if (node->rb_right && rb_interval_of(node->rb_right)->max_end >= lo) {
+                node = node->rb_right;
+                continue;
+            }
+        }
+        return NULL;
+    }
+}
+
+rb_node *rb_interval_first(rb_root *root, uint64_t lo, uint64_t hi)
+{
+    rb_node *node = root->rb_node;
+
+    if (!node || rb_interval_of(node)->max_end < lo) {
+        return NULL;
+    }
+    return rb_interval_search(node, lo, hi);
+}
+
+rb_node *rb_interval_next(rb_node *node, uint64_t lo, uint64_t hi)
+{
+    rb_node *right = node->rb_right;
+    rb_node *prev;
+
+    while (1) {
+        if (right && rb_interval_of(right)->max_end >= lo) {
+            return rb_interval_search(right, lo, hi);
+        }
+        //climb until node is entered from its left child
+        do {
+            prev = node;
+            node = node->rb_parent;
+            if (!node) {
+                return NULL;
+            }
+            right = node->rb_right;
+        } while (prev == right);
+
+        if (node->value > hi) {
+            return NULL;
+        }
+        if (rb_interval_of(node)->end >= lo) {
+            return node;
+        }
+    }
+}
+
+
 rb_node *search_node(rb_root *root, uint32_t key) {
     rb_node *node = root->rb_node;
 
@@ -0,0 +1,337 @@
+#include "swissmap.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+/*
+ * Control bytes: a full slot keeps the low 7 bits H2 of its hash (top bit clear),
+ * empty and deleted have the top bit set, so one signed compare tells them apart.
+ */
+#define CTRL_EMPTY    ((int8_t)-128)
+#define CTRL_DELETED  ((int8_t)-2)
+
+#define SWISSMAP_CLONED (SWISSMAP_GROUP - 1)
+
+//bit i set: byte i of the group matched
+typedef uint16_t group_mask;
+
+#if defined(__SSE2__)
+
+static inline group_mask group_match(const int8_t *ctrl, int8_t h2)
+{
+    __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+    return (group_mask)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(h2)));
+}
+
+static inline group_mask group_match_free(const int8_t *ctrl)
+{
+    __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+    return (group_mask)_mm_movemask_epi8(group);
+}
+
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+//NEON has no movemask: weight each lane with its bit and add the halves up pairwise
+static inline group_mask neon_movemask(uint8x16_t lanes)
+{
+    static const uint8_t weight[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x16_t bits = vandq_u8(lanes, vld1q_u8(weight));
+    uint8x8_t sum = vpadd_u8(vget_low_u8(bits), vget_high_u8(bits));
+    sum = vpadd_u8(sum, sum);
+    sum = vpadd_u8(sum, sum);
+    return vget_lane_u16(vreinterpret_u16_u8(sum), 0);
+}
+
+static inline group_mask group_match(const int8_t *ctrl, int8_t h2)
+{
+    return neon_movemask(vceqq_s8(vld1q_s8(ctrl), vdupq_n_s8(h2)));
+}
+
+static inline group_mask group_match_free(const int8_t *ctrl)
+{
+    return neon_movemask(vcltq_s8(vld1q_s8(ctrl), vdupq_n_s8(0)));
+}
+
+#else
+
+static inline group_mask group_match(const int8_t *ctrl, int8_t h2)
+{
+    group_mask mask = 0;
+    for (uint8_t i = 0; i < SWISSMAP_GROUP; i++) {
+        mask |= (group_mask)(ctrl[i] == h2) << i;
+    }
+    return mask;
+}
+
+static inline group_mask group_match_free(const int8_t *ctrl)
+{
+    group_mask mask = 0;
+    for (uint8_t i = 0; i < SWISSMAP_GROUP; i++) {
+        mask |= (group_mask)(ctrl[i] < 0) << i;
+    }
+    return mask;
+}
+
+#endif
+
+static inline group_mask group_match_empty(const int8_t *ctrl)
+{
+    return group_match(ctrl, CTRL_EMPTY);
+}
+
+static inline uint8_t mask_first(group_mask mask)
+{
+    return (uint8_t)__builtin_ctz(mask);
+}
+
+static inline uint8_t mask_last_zeros(group_mask mask)
+{
+    return (uint8_t)(__builtin_clz(mask) - (sizeof(unsigned int) * 8 - SWISSMAP_GROUP));
+}
+
+/*
+ * H1 picks the group and H2 is kept in the control byte, so every bit of the hash
+ * counts. Int and pointer keys go through the murmur3 mixer, aligned pointers
+ * would leave the low bits weak.
+ */
+static inline uword_t swissmap_mix(uword_t h)
+{
+#if PLATFORM_BITS == 64
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+#else
+    h ^= h >> 16;
+    h *= 0x85ebca6bU;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35U;
+    h ^= h >> 16;
+#endif
+    return h;
+}
+
+static uword_t swissmap_hash(struct swissmap *map, void *key)
+{
+    switch (map->key_type) {
+        case HASHMAP_KEY_STRING:
+            return hashmap_hash_bytes(key, strlen((char *)key));
+        case HASHMAP_KEY_INT:
+        case HASHMAP_KEY_PTR:
+            return swissmap_mix((uword_t)key);
+        default:
+            return 0;
+    }
+}
+
+static inline uword_t swissmap_h1(uword_t h)
+{
+    return h >> 7;
+}
+
+static inline int8_t swissmap_h2(uword_t h)
+{
+    return (int8_t)(h & 0x7f);
+}
+
+static inline int swissmap_key_equal(struct swissmap *map, void *a, void *b)
+{
+    if (a == b)
+        return 1;
+    if (map->key_type == HASHMAP_KEY_STRING)
+        return strcmp((char *)a, (char *)b) == 0;
+    return 0;
+}
+
+static inline uword_t swissmap_max_load(uword_t capacity)
+{
+    return capacity - capacity / 8;
+}
+
+/*
+ * The group at the end reads past the last slot: the first SWISSMAP_CLONED
+ * control bytes are mirrored there, so every slot also has a clone to update.
+ */
+static inline void swissmap_set_ctrl(struct swissmap *map, uword_t i, int8_t ctrl)
+{
+    uword_t mask = map->capacity - 1;
+    map->ctrl[i] = ctrl;
+    map->ctrl[((i - SWISSMAP_CLONED) & mask) + SWISSMAP_CLONED] = ctrl;
+}
+
+//slot index of key, map->capacity when it isn't there
+static uword_t swissmap_find(struct swissmap *map, void *key, uword_t h)
+{
+    uword_t mask = map->capacity - 1;
+    uword_t pos = swissmap_h1(h) & mask;
+    uword_t step = 0;
+    int8_t h2 = swissmap_h2(h);
+
+    //the slot most likely to hold key, fetched while the control bytes are being compared
+    __builtin_prefetch(&map->slots[pos]);
+    while (1) {
+        const int8_t *group = map->ctrl + pos;
+        group_mask match = group_match(group, h2);
+        while (match) {
+            uword_t i = (pos + mask_first(match)) & mask;
+            if (swissmap_key_equal(map, map->slots[i].key, key))
+                return i;
+            match &= match - 1;
+        }
+        if (group_match_empty(group))
+            return map->capacity;
+        //triangular steps in whole groups visit every group of a power of two table
+        step += SWISSMAP_GROUP;
+        pos = (pos + step) & mask;
+    }
+}
+
+//first empty or deleted slot on the probe sequence of h
+static uword_t swissmap_find_free(struct swissmap *map, uword_t h)
+{
+    uword_t mask = map->capacity - 1;
+    uword_t pos = swissmap_h1(h) & mask;
+    uword_t step = 0;
+
+    while (1) {
+        group_mask free_slot = group_match_free(map->ctrl + pos);
+        if (free_slot)
+            return (pos + mask_first(free_slot)) & mask;
+        step += SWISSMAP_GROUP;
+        pos = (pos + step) & mask;
+    }
+}
+
+static int swissmap_alloc(struct swissmap *map, uword_t capacity)
+{
+    size_t slot_size = sizeof(struct swissmap_slot) * capacity;
+    char *block = malloc(slot_size + capacity + SWISSMAP_CLONED);
+    if (block == NULL)
+        return -1;
+
+    map->slots = (struct swissmap_slot *)block;
+    map->ctrl = (int8_t *)(block + slot_size);
+    memset(map->ctrl, CTRL_EMPTY, capacity + SWISSMAP_CLONED);
+    map->capacity = capacity;
+    map->count = 0;
+    map->growth_left = swissmap_max_load(capacity);
+    return 0;
+}
+
+/*
+ * Move every entry into a fresh table, which also drops the tombstones.
+ * The size only doubles when the live entries fill more than half of the load.
+ */
+static int swissmap_rehash(struct swissmap *map)
+{
+    struct swissmap old = *map;
+    uword_t capacity = old.capacity;
+    if (old.count >= swissmap_max_load(capacity) / 2)
+        capacity *= 2;
+
+    if (swissmap_alloc(map, capacity) != 0) {
+        *map = old;
+        return -1;
+    }
+
+    for (uword_t i = 0; i < old.capacity; i++) {
+        if (old.ctrl[i] < 0)
+            continue;
+        uword_t h = swissmap_hash(map, old.slots[i].key);
+        uword_t j = swissmap_find_free(map, h);
+        swissmap_set_ctrl(map, j, swissmap_h2(h));
+        map->slots[j] = old.slots[i];
+    }
+    map->count = old.count;
+    map->growth_left -= old.count;
+    free(old.slots);
+    return 0;
+}
+
+__attribute__((always_inline)) static inline uword_t swissmap_round_up(uword_t x)
+{
+    if (x <= SWISSMAP_GROUP)
+        return SWISSMAP_GROUP;
+    return (uword_t)1 << (PLATFORM_BITS - CLZ(x - 1));
+}
+
+int swissmap_init(struct swissmap *map, size_t count, int key_type)
+{
+    map->key_type = key_type;
+    return swissmap_alloc(map, swissmap_round_up((uword_t)count + (uword_t)count / 7 + 1));
+}
+
+void swissmap_destroy(struct swissmap *map)
+{
+    free(map->slots);
+    map->slots = NULL;
+    map->ctrl = NULL;
+    map->capacity = 0;
+    map->count = 0;
+}
+
+int swissmap_put(struct swissmap *map, void *key, void *value)
+{
+    uword_t h = swissmap_hash(map, key);
+    uword_t i = swissmap_find(map, key, h);
+    if (i != map->capacity) {
+        map->slots[i].value = value;
+        return 0;
+    }
+
+    i = swissmap_find_free(map, h);
+    if ((map->ctrl[i] == CTRL_EMPTY) && (map->growth_left == 0)) {
+        if (swissmap_rehash(map) != 0)
+            return -1;
+        i = swissmap_find_free(map, h);
+    }
+    if (map->ctrl[i] == CTRL_EMPTY)
+        map->growth_left--;
+
+    swissmap_set_ctrl(map, i, swissmap_h2(h));
+    map->slots[i] = (struct swissmap_slot) {
+            .key = key,
+            .value = value
+    };
+    map->count++;
+    return 0;
+}
+
+void *swissmap_get(struct swissmap *map, void *key)
+{
+    uword_t i = swissmap_find(map, key, swissmap_hash(map, key));
+    if (i == map->capacity)
+        return NULL;
+    return map->slots[i].value;
+}
+
+/*
+ * A probe only goes on past a group with no empty byte. If every group of 16 that
+ * covers slot i still has one, no probe ever passed i and it can become empty again,
+ * otherwise it must stay a tombstone.
+ */
+int swissmap_remove(struct swissmap *map, void *key)
+{
+    uword_t i = swissmap_find(map, key, swissmap_hash(map, key));
+    if (i == map->capacity)
+        return 0;
+
+    uword_t mask = map->capacity - 1;
+    group_mask after = group_match_empty(map->ctrl + i);
+    group_mask before = group_match_empty(map->ctrl + ((i - SWISSMAP_GROUP) & mask));
+    if (after && before &&
+        (mask_first(after) + mask_last_zeros(before) < SWISSMAP_GROUP)) {
+        swissmap_set_ctrl(map, i, CTRL_EMPTY);
+        map->growth_left++;
+    } else {
+        swissmap_set_ctrl(map, i, CTRL_DELETED);
+    }
+    map->count--;
+    return 1;
+}
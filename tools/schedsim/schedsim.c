@@ -0,0 +1,654 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 skaiui2
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *  https://github.com/skaiui2/SKRTOS_sparrow
+ */
+
+/*
+ * Offline schedule simulator.
+ *
+ * It replays a periodic task set tick by tick with the same selection rules
+ * as the four kernels, so a system can be sized before it is flashed:
+ *
+ *   table  : one task per priority, the highest ready priority runs.
+ *   list   : ReadyListArray + SaveNode/SwitchFlag time slice rotation.
+ *   rbtree : highest priority, equals first in, first out, or rotated by TimeSliceTick
+ *            after TimeSlice ticks of running when it is not 0.
+ *   edf    : smallest (AbsoluteClock + respondLine) at insertion wins.
+ *
+ * Every task is the usual loop "work wcet ticks; TaskDelay(period)", so by
+ * default the next release is the completion time plus the period, as it is
+ * on the target. "-m periodic" releases jobs at fixed multiples of the period.
+ *
+ * The next wake time of every task is kept in a min-heap, the simulation
+ * length is the hyperperiod (lcm of the periods) unless "-t" is given.
+ *
+ * build: gcc -O2 -o schedsim schedsim.c
+ * usage: schedsim [-p table|list|rbtree|edf|all] [-m delay|periodic] [-t ticks] [-v] taskset
+ *
+ * taskset, one task per line, '#' starts a comment, trailing fields optional:
+ *   name  period  wcet  priority  respondLine  deadline  TimeSlice  offset
+ * respondLine and deadline default to the period, TimeSlice and offset to 0.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define Class(class)    \
+typedef struct  class  class;\
+struct class
+
+#define MaxTask         64
+#define NameLength      16
+#define configMaxPriority 32
+#define DefaultHorizon  1000000ULL
+#define None            (-1)
+
+#define ModeDelay       0
+#define ModePeriodic    1
+
+Class(SimTask)
+{
+    char name[NameLength];
+    uint32_t period;
+    uint32_t wcet;
+    uint32_t priority;
+    uint32_t respondLine;
+    uint32_t deadline;
+    uint32_t TimeSlice;
+    uint32_t offset;
+
+    uint64_t release;   //release time of the current job
+    uint64_t key;       //EDF ready key
+    uint64_t seq;       //insertion order
+    uint32_t remain;
+    uint32_t SliceLeft; //rbtree policy: ticks left before TimeSliceTick requeues it
+    uint8_t  ready;
+    int      next;      //list policy: circular ready list
+
+    uint64_t jobs;
+    uint64_t done;
+    uint64_t miss;
+    uint64_t resp_sum;
+    uint64_t resp_max;
+    uint64_t preempt;
+};
+
+Class(WakeHeap)
+{
+    uint64_t time[MaxTask];
+    int task[MaxTask];
+    int count;
+};
+
+Class(ReadyList)
+{
+    int head;
+    int tail;
+    int save;
+    uint32_t count;
+    uint32_t SwitchFlag;
+};
+
+Class(Policy)
+{
+    const char *name;
+    void (*init)(void);
+    void (*add)(int i);
+    void (*remove)(int i);
+    int  (*pick)(void);
+    void (*tick)(int i);    //SysTick on the running task, before the schedule
+    uint8_t edf_miss;   //EDF fails on exec >= deadline, the others on >
+};
+
+
+static SimTask Task[MaxTask];
+static int TaskNumber;
+static WakeHeap Heap;
+static ReadyList ReadyListArray[configMaxPriority];
+static uint64_t NowTick;
+static uint64_t InsertSeq;
+
+
+static void heap_push(uint64_t time, int task)
+{
+    int i = Heap.count++;
+    while (i > 0) {
+        int parent = (i - 1) >> 1;
+        if (Heap.time[parent] <= time) {
+            break;
+        }
+        Heap.time[i] = Heap.time[parent];
+        Heap.task[i] = Heap.task[parent];
+        i = parent;
+    }
+    Heap.time[i] = time;
+    Heap.task[i] = task;
+}
+
+static int heap_pop(void)
+{
+    int top = Heap.task[0];
+    uint64_t time = Heap.time[--Heap.count];
+    int task = Heap.task[Heap.count];
+    int i = 0;
+
+    while (1) {
+        int child = (i << 1) + 1;
+        if (child >= Heap.count) {
+            break;
+        }
+        if ((child + 1 < Heap.count) && (Heap.time[child + 1] < Heap.time[child])) {
+            child++;
+        }
+        if (time <= Heap.time[child]) {
+            break;
+        }
+        Heap.time[i] = Heap.time[child];
+        Heap.task[i] = Heap.task[child];
+        i = child;
+    }
+    Heap.time[i] = time;
+    Heap.task[i] = task;
+    return top;
+}
+
+
+/*
+ * table version: StateTable bit per priority, FindHighestPriority.
+ */
+static void table_init(void) { }
+
+static void table_tick(int i) { }
+
+static void table_add(int i)
+{
+    Task[i].ready = 1;
+}
+
+static void table_remove(int i)
+{
+    Task[i].ready = 0;
+}
+
+static int table_pick(void)
+{
+    int best = None;
+    for (int i = 0; i < TaskNumber; i++) {
+        if (Task[i].ready && ((best == None) || (Task[i].priority > Task[best].priority))) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+
+/*
+ * rbtree version: ReadyTree keyed by priority and a falling insert sequence,
+ * so last_node is the task inserted first among the highest priority.
+ */
+static void rbtree_add(int i)
+{
+    Task[i].ready = 1;
+    Task[i].seq = InsertSeq++;
+    Task[i].SliceLeft = Task[i].TimeSlice;
+}
+
+//TimeSliceTick: the running task used up its slice, reinsert it behind its equal priorities
+static void rbtree_tick(int i)
+{
+    if ((i == None) || (Task[i].TimeSlice == 0) || !Task[i].ready) {
+        return;
+    }
+    if (--Task[i].SliceLeft == 0) {
+        rbtree_add(i);
+    }
+}
+
+static int rbtree_pick(void)
+{
+    int best = None;
+    for (int i = 0; i < TaskNumber; i++) {
+        if (!Task[i].ready) {
+            continue;
+        }
+        if ((best == None) || (Task[i].priority > Task[best].priority)
+            || ((Task[i].priority == Task[best].priority) && (Task[i].seq < Task[best].seq))) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+
+/*
+ * EDF version: ReadyTree keyed by AbsoluteClock + respondLine at insertion,
+ * first_node only moves on a strictly smaller key, so equal keys are FIFO.
+ */
+static void edf_add(int i)
+{
+    Task[i].ready = 1;
+    Task[i].key = NowTick + Task[i].respondLine;
+    Task[i].seq = InsertSeq++;
+}
+
+static int edf_pick(void)
+{
+    int best = None;
+    for (int i = 0; i < TaskNumber; i++) {
+        if (!Task[i].ready) {
+            continue;
+        }
+        if ((best == None) || (Task[i].key < Task[best].key)
+            || ((Task[i].key == Task[best].key) && (Task[i].seq < Task[best].seq))) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+
+/*
+ * list version: a copy of ListAdd/ListRemove/TaskSwitchContext,
+ * node value is the TimeSlice, SaveNode and SwitchFlag rotate equal priorities.
+ */
+static void list_init(void)
+{
+    for (int i = 0; i < configMaxPriority; i++) {
+        ReadyListArray[i] = (ReadyList){
+            .head = None,
+            .tail = None,
+            .save = None,
+            .count = 0,
+            .SwitchFlag = 0
+        };
+    }
+}
+
+static void list_add(int i)
+{
+    ReadyList *xList = &ReadyListArray[Task[i].priority];
+    uint32_t value = Task[i].TimeSlice;
+
+    Task[i].ready = 1;
+    if (xList->count == 0) {
+        xList->head = i;
+        xList->tail = i;
+        Task[i].next = i;
+    } else if (value <= Task[xList->head].TimeSlice) {
+        Task[i].next = xList->head;
+        Task[xList->tail].next = i;
+        xList->head = i;
+    } else if (value >= Task[xList->tail].TimeSlice) {
+        Task[i].next = Task[xList->tail].next;
+        Task[xList->tail].next = i;
+        xList->tail = i;
+    } else {
+        int find = xList->head;
+        while (Task[Task[find].next].TimeSlice <= value) {
+            find = Task[find].next;
+        }
+        Task[i].next = Task[find].next;
+        Task[find].next = i;
+    }
+    xList->save = xList->head;
+    xList->count++;
+}
+
+static void list_remove(int i)
+{
+    ReadyList *xList = &ReadyListArray[Task[i].priority];
+    int prev = xList->head;
+
+    Task[i].ready = 0;
+    xList->save = Task[xList->save].next;
+    while (Task[prev].next != i) {
+        prev = Task[prev].next;
+    }
+
+    if (xList->count == 1) {
+        xList->head = None;
+        xList->tail = None;
+    } else if (xList->head == i) {
+        xList->head = Task[i].next;
+        Task[xList->tail].next = Task[i].next;
+    } else {
+        Task[prev].next = Task[i].next;
+        if (xList->tail == i) {
+            xList->tail = prev;
+        }
+    }
+    xList->count--;
+}
+
+static int list_pick(void)
+{
+    int index = configMaxPriority - 1;
+    while ((index >= 0) && (ReadyListArray[index].count == 0)) {
+        index--;
+    }
+    if (index < 0) {
+        return None;
+    }
+
+    ReadyList *TopPrioritiesList = &ReadyListArray[index];
+    if (TopPrioritiesList->SwitchFlag > 0) {
+        TopPrioritiesList->SwitchFlag -= 1;
+    } else {
+        TopPrioritiesList->save = Task[TopPrioritiesList->save].next;
+        TopPrioritiesList->SwitchFlag = Task[TopPrioritiesList->save].TimeSlice;
+    }
+    return TopPrioritiesList->save;
+}
+
+
+static const Policy PolicyTable[] = {
+        {"table",  table_init, table_add,  table_remove, table_pick,  table_tick,  0},
+        {"list",   list_init,  list_add,   list_remove,  list_pick,   table_tick,  0},
+        {"rbtree", table_init, rbtree_add, table_remove, rbtree_pick, rbtree_tick, 0},
+        {"edf",    table_init, edf_add,    table_remove, edf_pick,    table_tick,  1},
+};
+
+
+static uint64_t gcd(uint64_t a, uint64_t b)
+{
+    while (b) {
+        uint64_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+static uint64_t hyperperiod(uint64_t limit)
+{
+    uint64_t l = 1;
+    for (int i = 0; i < TaskNumber; i++) {
+        l = l / gcd(l, Task[i].period) * Task[i].period;
+        if (l > limit) {
+            return limit;
+        }
+    }
+    return l;
+}
+
+
+static void job_release(const Policy *policy, int i, uint64_t release)
+{
+    Task[i].release = release;
+    Task[i].remain = Task[i].wcet;
+    Task[i].jobs++;
+    policy->add(i);
+}
+
+static void job_finish(const Policy *policy, int i, uint8_t mode)
+{
+    uint64_t resp = NowTick - Task[i].release;
+    uint64_t next;
+
+    Task[i].done++;
+    Task[i].resp_sum += resp;
+    if (resp > Task[i].resp_max) {
+        Task[i].resp_max = resp;
+    }
+    if (policy->edf_miss ? (resp >= Task[i].deadline) : (resp > Task[i].deadline)) {
+        Task[i].miss++;
+    }
+    policy->remove(i);
+
+    if (mode == ModePeriodic) {
+        next = Task[i].release + Task[i].period;
+        if (next < NowTick) {
+            next = NowTick;
+        }
+    } else {
+        next = NowTick + Task[i].period;
+    }
+    heap_push(next, i);
+}
+
+
+static void simulate(const Policy *policy, uint8_t mode, uint64_t horizon, uint8_t verbose)
+{
+    uint64_t busy = 0;
+    uint64_t switches = 0;
+    double utilization = 0;
+    int current;
+
+    policy->init();
+    Heap.count = 0;
+    NowTick = 0;
+    InsertSeq = 0;
+    for (int i = 0; i < TaskNumber; i++) {
+        SimTask *t = &Task[i];
+        t->ready = 0;
+        t->jobs = t->done = t->miss = t->resp_sum = t->resp_max = t->preempt = 0;
+        utilization += (double)t->wcet / (double)t->period;
+        if (t->offset) {
+            heap_push(t->offset, i);
+        } else {
+            job_release(policy, i, 0);
+        }
+    }
+
+    if (verbose) {
+        printf("\n%s: ", policy->name);
+    }
+
+    current = policy->pick();
+    for (NowTick = 0; NowTick < horizon; ) {
+        int last = current;
+        if (current != None) {
+            Task[current].remain--;
+            busy++;
+        }
+        if (verbose) {
+            putchar(current == None ? '.' : ('a' + current % 26));
+        }
+        NowTick++;
+
+        //the job ends inside the tick and calls TaskDelay, which schedules.
+        if ((current != None) && (Task[current].remain == 0)) {
+            job_finish(policy, current, mode);
+            current = policy->pick();
+        }
+
+        //SysTick: CheckTicks wakes the due tasks, charges the slice of the running one, then schedules.
+        while (Heap.count && (Heap.time[0] <= NowTick)) {
+            job_release(policy, heap_pop(), NowTick);
+        }
+        policy->tick(current);
+        current = policy->pick();
+
+        if (current != last) {
+            switches++;
+            if ((last != None) && Task[last].ready) {
+                Task[last].preempt++;
+            }
+        }
+    }
+
+    //jobs still pending at the end whose deadline has passed are misses too.
+    for (int i = 0; i < TaskNumber; i++) {
+        if (Task[i].ready && (NowTick - Task[i].release > Task[i].deadline)) {
+            Task[i].miss++;
+        }
+    }
+
+    if (verbose) {
+        putchar('\n');
+    }
+    printf("\npolicy: %s  ticks: %llu  utilization: %.3f  busy: %.1f%%  idle: %llu  switches: %llu\n",
+           policy->name, (unsigned long long)horizon, utilization,
+           100.0 * (double)busy / (double)horizon,
+           (unsigned long long)(horizon - busy), (unsigned long long)switches);
+    printf("%-16s %7s %5s %4s %5s %5s %8s %8s %9s %7s\n",
+           "task", "period", "wcet", "prio", "line", "dead", "jobs", "misses", "resp avg", "max");
+    for (int i = 0; i < TaskNumber; i++) {
+        SimTask *t = &Task[i];
+        printf("%-16s %7u %5u %4u %5u %5u %8llu %8llu %9.2f %7llu\n",
+               t->name, t->period, t->wcet, t->priority, t->respondLine, t->deadline,
+               (unsigned long long)t->jobs, (unsigned long long)t->miss,
+               t->done ? (double)t->resp_sum / (double)t->done : 0.0,
+               (unsigned long long)t->resp_max);
+    }
+}
+
+
+static int load_taskset(const char *path)
+{
+    char line[256];
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), fp)) {
+        char *comment = strchr(line, '#');
+        SimTask t = {0};
+        unsigned int v[7] = {0, 0, 0, 0, 0, 0, 0};
+        int n;
+
+        if (comment) {
+            *comment = '\0';
+        }
+        n = sscanf(line, "%15s %u %u %u %u %u %u %u", t.name,
+                   &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6]);
+        if (n <= 0) {
+            continue;
+        }
+        if ((n < 3) || (v[0] == 0) || (v[1] == 0)) {
+            fprintf(stderr, "%s: task '%s' needs a period and a wcet\n", path, t.name);
+            fclose(fp);
+            return -1;
+        }
+        if (TaskNumber == MaxTask) {
+            fprintf(stderr, "%s: more than %d tasks\n", path, MaxTask);
+            fclose(fp);
+            return -1;
+        }
+        t.period = v[0];
+        t.wcet = v[1];
+        t.priority = (n > 3) ? v[2] : 0;
+        t.respondLine = (n > 4) ? v[3] : t.period;
+        t.deadline = (n > 5) ? v[4] : t.period;
+        t.TimeSlice = (n > 6) ? v[5] : 0;
+        t.offset = (n > 7) ? v[6] : 0;
+        if (t.priority >= configMaxPriority) {
+            fprintf(stderr, "%s: task '%s' priority must be below %d\n", path, t.name, configMaxPriority);
+            fclose(fp);
+            return -1;
+        }
+        Task[TaskNumber++] = t;
+    }
+    fclose(fp);
+
+    if (TaskNumber == 0) {
+        fprintf(stderr, "%s: empty task set\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+static int table_priority_unique(void)
+{
+    uint32_t used = 0;
+    for (int i = 0; i < TaskNumber; i++) {
+        if (used & (1UL << Task[i].priority)) {
+            return 0;
+        }
+        used |= (1UL << Task[i].priority);
+    }
+    return 1;
+}
+
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [-p table|list|rbtree|edf|all] [-m delay|periodic] [-t ticks] [-v] taskset\n",
+            name);
+}
+
+int main(int argc, char **argv)
+{
+    const char *policy = "all";
+    const char *path = NULL;
+    uint8_t mode = ModeDelay;
+    uint8_t verbose = 0;
+    uint64_t horizon = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-p") && (i + 1 < argc)) {
+            policy = argv[++i];
+        } else if (!strcmp(argv[i], "-m") && (i + 1 < argc)) {
+            i++;
+            if (!strcmp(argv[i], "periodic")) {
+                mode = ModePeriodic;
+            } else if (strcmp(argv[i], "delay")) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "-t") && (i + 1 < argc)) {
+            horizon = strtoull(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "-v")) {
+            verbose = 1;
+        } else if (argv[i][0] != '-') {
+            path = argv[i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!path) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (load_taskset(path) < 0) {
+        return 1;
+    }
+    if (horizon == 0) {
+        horizon = hyperperiod(DefaultHorizon);
+    }
+
+    int found = 0;
+    for (size_t i = 0; i < sizeof(PolicyTable) / sizeof(PolicyTable[0]); i++) {
+        const Policy *p = &PolicyTable[i];
+        if (strcmp(policy, "all") && strcmp(policy, p->name)) {
+            continue;
+        }
+        found = 1;
+        if ((p->init == table_init) && (p->add == table_add) && !table_priority_unique()) {
+            printf("\npolicy: table  skipped, the table version needs a unique priority per task\n");
+            continue;
+        }
+        simulate(p, mode, horizon, verbose);
+    }
+    if (!found) {
+        usage(argv[0]);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,397 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 skaiui2
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *  https://github.com/skaiui2/SKRTOS_sparrow
+ */
+
+/*
+ * Converts a dump of trace_buffer (kernel/trace) into Chrome trace JSON,
+ * which chrome://tracing and ui.perfetto.dev open directly.
+ *
+ * Process "CPU" has one track with the running task and one with the
+ * interrupts recorded by trace_isr_enter/trace_isr_exit. Process "Tasks" has
+ * a track per task with its waits (delay, suspended, wait on an IPC object)
+ * and an instant event every time it becomes ready, so the time from the
+ * wake to the switch-in is the scheduling latency.
+ *
+ * The 32-bit cycle counter may wrap between two events, it is unwrapped as
+ * long as consecutive events are less than 2^32 cycles apart.
+ *
+ * build: gcc -O2 -o trace2json trace2json.c
+ * usage: trace2json [-f hz] [-o out.json] trace.bin
+ *
+ * dump on the target, gdb:  dump binary value trace.bin trace_buffer
+ * -f overrides the cycle counter frequency stored in the dump.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdarg.h>
+
+#define Class(class)    \
+typedef struct  class  class;\
+struct class
+
+//must match kernel/trace/include/trace.h
+#define TraceMagic      0x45435254
+#define TraceSwitch     0
+#define TraceReady      1
+#define TraceDelay      2
+#define TraceSuspend    3
+#define TraceBlock      4
+#define TraceIPCWait    5
+#define TraceIPCWake    6
+#define TraceISREnter   7
+#define TraceISRExit    8
+#define TraceTickISR    0xffff
+
+#define HeaderSize      16
+#define EventSize       16
+#define MaxIsrDepth     16
+
+#define PidCPU          1
+#define PidTasks        2
+#define TidRunning      1
+#define TidIsr          2
+
+#define StateNone       0
+
+Class(Event)
+{
+    uint64_t cycles;
+    uint32_t task;
+    uint32_t object;
+    uint8_t type;
+    uint8_t priority;
+};
+
+Class(Task)
+{
+    uint32_t handle;
+    uint8_t priority;
+    uint8_t state;          //StateNone or the Trace* code of the open wait slice
+    uint32_t object;
+    double since;
+};
+
+static Task *tasks;
+static size_t TaskNumber;
+static FILE *out;
+static int first = 1;
+static double ClockMHz;
+
+
+static uint32_t get32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static double to_us(uint64_t cycles)
+{
+    return (double)cycles / ClockMHz;
+}
+
+static void emit(const char *fmt, ...)
+{
+    va_list ap;
+    fputs(first ? "\n  " : ",\n  ", out);
+    first = 0;
+    va_start(ap, fmt);
+    vfprintf(out, fmt, ap);
+    va_end(ap);
+}
+
+
+static size_t task_index(uint32_t handle)
+{
+    for (size_t i = 0; i < TaskNumber; i++) {
+        if (tasks[i].handle == handle) {
+            return i;
+        }
+    }
+    tasks = realloc(tasks, (TaskNumber + 1) * sizeof(Task));
+    if (!tasks) {
+        perror("realloc");
+        exit(1);
+    }
+    tasks[TaskNumber] = (Task){ .handle = handle, .state = StateNone };
+    emit("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%zu,\"args\":{\"name\":\"task 0x%08x\"}}",
+         PidTasks, TaskNumber + 1, handle);
+    return TaskNumber++;
+}
+
+static void slice(int pid, size_t tid, const char *name, double begin, double end, const char *args)
+{
+    emit("{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%zu,\"ts\":%.3f,\"dur\":%.3f%s%s%s}",
+         name, pid, tid, begin, end - begin, args ? ",\"args\":{" : "", args ? args : "", args ? "}" : "");
+}
+
+static void instant(size_t tid, const char *name, double ts)
+{
+    emit("{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":%d,\"tid\":%zu,\"ts\":%.3f}",
+         name, PidTasks, tid, ts);
+}
+
+static void close_wait(size_t i, double now)
+{
+    Task *t = &tasks[i];
+    char name[32];
+
+    switch (t->state) {
+    case TraceDelay:
+        strcpy(name, "delay");
+        break;
+    case TraceSuspend:
+        strcpy(name, "suspended");
+        break;
+    case TraceBlock:
+        strcpy(name, "blocked");
+        break;
+    case TraceIPCWait:
+        snprintf(name, sizeof(name), "wait 0x%08x", t->object);
+        break;
+    default:
+        return;
+    }
+    slice(PidTasks, i + 1, name, t->since, now, NULL);
+    t->state = StateNone;
+}
+
+static void open_wait(size_t i, uint8_t state, uint32_t object, double now)
+{
+    Task *t = &tasks[i];
+
+    //TaskDelay after blocking on an IPC object is the timeout of that wait
+    if ((state == TraceDelay) && ((t->state == TraceBlock) || (t->state == TraceIPCWait))) {
+        return;
+    }
+    close_wait(i, now);
+    t->state = state;
+    t->object = object;
+    t->since = now;
+}
+
+
+static void convert(const Event *event, size_t count)
+{
+    long running = -1;
+    double RunSince = 0;
+    uint32_t IsrStack[MaxIsrDepth];
+    double IsrSince[MaxIsrDepth];
+    int IsrDepth = 0;
+    uint64_t base = event[0].cycles;
+    double now = 0;
+
+    emit("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"CPU\"}}", PidCPU);
+    emit("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"Tasks\"}}", PidTasks);
+    emit("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"running\"}}", PidCPU, TidRunning);
+    emit("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"interrupts\"}}", PidCPU, TidIsr);
+
+    for (size_t n = 0; n < count; n++) {
+        const Event *e = &event[n];
+        now = to_us(e->cycles - base);
+        char args[64];
+        char name[32];
+
+        switch (e->type) {
+        case TraceSwitch: {
+            size_t i = task_index(e->task);
+            tasks[i].priority = e->priority;
+            if (running == (long)i) {
+                break;
+            }
+            if (running >= 0) {
+                snprintf(name, sizeof(name), "task 0x%08x", tasks[running].handle);
+                snprintf(args, sizeof(args), "\"priority\":%u", tasks[running].priority);
+                slice(PidCPU, TidRunning, name, RunSince, now, args);
+            }
+            running = (long)i;
+            RunSince = now;
+            break;
+        }
+        case TraceReady: {
+            size_t i = task_index(e->task);
+            close_wait(i, now);
+            instant(i + 1, "ready", now);
+            break;
+        }
+        case TraceDelay:
+        case TraceSuspend:
+        case TraceBlock:
+        case TraceIPCWait:
+            open_wait(task_index(e->task), e->type, e->object, now);
+            break;
+        case TraceIPCWake: {
+            size_t i = task_index(e->task);
+            close_wait(i, now);
+            instant(i + 1, "wake", now);
+            break;
+        }
+        case TraceISREnter:
+            if (IsrDepth < MaxIsrDepth) {
+                IsrStack[IsrDepth] = e->object;
+                IsrSince[IsrDepth] = now;
+            }
+            IsrDepth++;
+            break;
+        case TraceISRExit:
+            if (IsrDepth == 0) {
+                break;  //entered before the oldest event in the ring
+            }
+            IsrDepth--;
+            if (IsrDepth < MaxIsrDepth) {
+                if (IsrStack[IsrDepth] == TraceTickISR) {
+                    strcpy(name, "tick");
+                } else {
+                    snprintf(name, sizeof(name), "irq %u", IsrStack[IsrDepth]);
+                }
+                slice(PidCPU, TidIsr, name, IsrSince[IsrDepth], now, NULL);
+            }
+            break;
+        default:
+            fprintf(stderr, "unknown event type %u at %zu\n", e->type, n);
+            break;
+        }
+    }
+
+    //close what is still open at the last event
+    if (running >= 0) {
+        char name[32];
+        snprintf(name, sizeof(name), "task 0x%08x", tasks[running].handle);
+        slice(PidCPU, TidRunning, name, RunSince, now, NULL);
+    }
+    for (size_t i = 0; i < TaskNumber; i++) {
+        close_wait(i, now);
+    }
+}
+
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-f hz] [-o out.json] trace.bin\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = NULL;
+    const char *OutPath = NULL;
+    double hz = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-f") && (i + 1 < argc)) {
+            hz = strtod(argv[++i], NULL);
+        } else if (!strcmp(argv[i], "-o") && (i + 1 < argc)) {
+            OutPath = argv[++i];
+        } else if (argv[i][0] != '-') {
+            path = argv[i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!path) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    FILE *in = fopen(path, "rb");
+    if (!in) {
+        perror(path);
+        return 1;
+    }
+    fseek(in, 0, SEEK_END);
+    long length = ftell(in);
+    fseek(in, 0, SEEK_SET);
+    uint8_t *data = malloc(length > 0 ? (size_t)length : 1);
+    if (!data || (length < HeaderSize) || (fread(data, 1, (size_t)length, in) != (size_t)length)) {
+        fprintf(stderr, "%s: can not read the trace header\n", path);
+        return 1;
+    }
+    fclose(in);
+
+    uint32_t magic = get32(data);
+    uint32_t size = get32(data + 4);
+    uint32_t ClockHz = get32(data + 8);
+    uint32_t index = get32(data + 12);
+    if (magic != TraceMagic) {
+        fprintf(stderr, "%s: bad magic 0x%08x, not a trace_buffer dump\n", path, magic);
+        return 1;
+    }
+    if ((size == 0) || (size & (size - 1)) || ((uint64_t)length < HeaderSize + (uint64_t)size * EventSize)) {
+        fprintf(stderr, "%s: ring size %u does not match the file length %ld\n", path, size, length);
+        return 1;
+    }
+    if (hz == 0) {
+        hz = ClockHz;
+    }
+    if (hz <= 0) {
+        fprintf(stderr, "%s: no cycle counter frequency, give it with -f\n", path);
+        return 1;
+    }
+    ClockMHz = hz / 1e6;
+
+    //index counts every event ever recorded, the ring keeps the newest size of them
+    size_t count = (index < size) ? index : size;
+    if (count == 0) {
+        fprintf(stderr, "%s: no events recorded\n", path);
+        return 1;
+    }
+    Event *event = malloc(count * sizeof(Event));
+    uint64_t high = 0;
+    uint32_t last = 0;
+    for (size_t n = 0; n < count; n++) {
+        const uint8_t *p = data + HeaderSize + (size_t)((index - count + n) & (size - 1)) * EventSize;
+        uint32_t timestamp = get32(p);
+        if ((n > 0) && (timestamp < last)) {
+            high += 1ULL << 32;
+        }
+        last = timestamp;
+        event[n] = (Event){
+                .cycles = high | timestamp,
+                .task = get32(p + 4),
+                .object = get32(p + 8),
+                .type = p[12],
+                .priority = p[13]
+        };
+    }
+
+    out = OutPath ? fopen(OutPath, "w") : stdout;
+    if (!out) {
+        perror(OutPath);
+        return 1;
+    }
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    convert(event, count);
+    fprintf(out, "\n]}\n");
+
+    fprintf(stderr, "%zu events, %zu tasks, %.3f ms\n", count, TaskNumber,
+            to_us(event[count - 1].cycles - event[0].cycles) / 1000.0);
+    if (out != stdout) {
+        fclose(out);
+    }
+    free(event);
+    free(data);
+    free(tasks);
+    return 0;
+}